@@ -0,0 +1,59 @@
+#!/bin/bash
+# Compare the banks_<run_no>.root files written by two builds of hipo2root, and
+# the time taken by the make_ntuples of each build to read its own file.
+#
+# Usage: ./compare_banks_layout.sh old_dir new_dir infile
+#   old_dir, new_dir : checkouts of this repository, already built with make.
+#   infile           : reconstructed HIPO file, named <text>run_no.hipo.
+
+set -e
+
+if [ $# -ne 3 ]; then
+    sed -n 5,8p "$0"
+    exit 1
+fi
+old_dir=$1
+new_dir=$2
+infile=$3
+
+# Run number, as hipo2root gets it from the filename.
+run_num=$(basename "${infile}" .hipo | grep -o '[0-9]*$')
+run_num=$(printf "%06d" $((10#${run_num})))
+
+work_dir=$(mktemp -d)
+mkdir -p ${work_dir}/old ${work_dir}/new ${work_dir}/data
+echo "Writing outputs to ${work_dir}."
+
+# Convert the same input with both versions.
+for version in old new; do
+    dir_var=${version}_dir
+    ${!dir_var}/bin/hipo2root -w ${work_dir}/${version} ${infile}
+done
+old_banks=${work_dir}/old/banks_${run_num}.root
+new_banks=${work_dir}/new/banks_${run_num}.root
+
+# Both make_ntuples read the same sampling fraction parameters, extracted once
+#     and left out of the timing.
+${new_dir}/bin/extract_sf -w ${work_dir}/new -d ${work_dir}/data ${new_banks}
+
+# Time each make_ntuples reading its own banks file, single-threaded.
+declare -A read_time
+for version in old new; do
+    dir_var=${version}_dir
+    start=$(date +%s.%N)
+    ${!dir_var}/bin/make_ntuples -w ${work_dir}/${version} \
+        -d ${work_dir}/data ${work_dir}/${version}/banks_${run_num}.root
+    end=$(date +%s.%N)
+    read_time[${version}]=$(awk "BEGIN {print ${end} - ${start}}")
+done
+
+old_size=$(stat -c %s ${old_banks})
+new_size=$(stat -c %s ${new_banks})
+echo
+echo "banks_${run_num}.root size:"
+echo "    old: ${old_size} bytes"
+ratio=$(awk "BEGIN {printf \"%.3f\", ${new_size}/${old_size}}")
+echo "    new: ${new_size} bytes (${ratio} of old)"
+echo "make_ntuples time:"
+echo "    old: ${read_time[old]} s"
+echo "    new: ${read_time[new]} s"
@@ -0,0 +1,104 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022-2023 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+// details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#ifndef RGE_BINSTORE
+#define RGE_BINSTORE
+
+// --+ preamble +---------------------------------------------------------------
+// C.
+#include <stdlib.h>
+
+// C++.
+#include <unordered_map>
+
+// typedefs.
+typedef unsigned int uint;
+typedef long unsigned int luint;
+typedef long int lint;
+
+// --+ internal +---------------------------------------------------------------
+/**
+ * Largest number of cells stored densely from the start, 8 MiB of counters.
+ *     Larger stores start sparse.
+ */
+static const luint BINSTORE_MAXDENSE = 1lu << 20;
+
+/**
+ * A sparse store is converted to dense once more than 1/BINSTORE_MAXFILL of
+ *     its cells are filled. Past that point, a hash map entry takes more
+ *     memory than a dense counter for every cell.
+ */
+static const luint BINSTORE_MAXFILL  = 4;
+
+// --+ structs +----------------------------------------------------------------
+/** Maximum number of dimensions of a bin store. */
+#define RGE_BINSTORE_MAXDIMS 5
+
+/**
+ * Event counters of an N-dimensional binning, with cells indexed by their
+ *     flattened, row-major position. Counters are stored in a dense array
+ *     when the binning is small, and in a hash map of the filled cells when
+ *     it's large and mostly empty.
+ *
+ * @param ndims  : number of dimensions.
+ * @param nbins  : number of bins in each dimension.
+ * @param ncells : total number of cells.
+ * @param dense  : array of ncells counters, or NULL if sparse.
+ * @param sparse : map from cell to counter of the filled cells, or NULL if
+ *                 dense.
+ */
+typedef struct {
+    int ndims;
+    luint nbins[RGE_BINSTORE_MAXDIMS];
+    luint ncells;
+    luint *dense;
+    std::unordered_map<luint, luint> *sparse;
+} rge_binstore;
+
+// --+ internal +---------------------------------------------------------------
+/** Convert a sparse bin store to dense, keeping its counters. */
+static int make_dense(rge_binstore *store);
+
+// --+ library +----------------------------------------------------------------
+/**
+ * Create an empty bin store. The layout is chosen from the number of cells.
+ *
+ * @param store : bin store to initialize.
+ * @param ndims : number of dimensions, at most RGE_BINSTORE_MAXDIMS.
+ * @param nbins : number of bins in each dimension.
+ * @return      : success code (0).
+ */
+int rge_binstore_init(rge_binstore *store, int ndims, luint *nbins);
+
+/** Add n to the counter of cell. */
+int rge_binstore_add(rge_binstore *store, luint cell, luint n);
+
+/** Get the counter of cell. */
+luint rge_binstore_get(rge_binstore *store, luint cell);
+
+/**
+ * Add all counters of src to dst. Both stores must have the same number of
+ *     cells. src is left untouched.
+ *
+ * @param dst : bin store to which counters are added.
+ * @param src : bin store from which counters are read.
+ * @return    : success code (0).
+ */
+int rge_binstore_merge(rge_binstore *dst, rge_binstore *src);
+
+/** Free the counters of a bin store. */
+int rge_binstore_free(rge_binstore *store);
+
+#endif
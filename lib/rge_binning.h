@@ -0,0 +1,106 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022-2023 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+// details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#ifndef RGE_BINNING
+#define RGE_BINNING
+
+// --+ preamble +---------------------------------------------------------------
+// C.
+#include <math.h>
+#include <stdlib.h>
+
+// C++.
+#include <algorithm>
+
+// typedefs.
+typedef unsigned int uint;
+typedef long unsigned int luint;
+typedef long int lint;
+
+// --+ internal +---------------------------------------------------------------
+/**
+ * Maximum relative difference between the width of each bin and the average
+ *     width for a binning to be looked up arithmetically.
+ */
+static const double BINNING_UNIFORMTOL = 1e-6;
+
+// --+ structs +----------------------------------------------------------------
+/**
+ * Binning of one variable. Bins are defined by their edges, and a value falls
+ *     in bin i if edges[i] < value < edges[i+1]. Values outside of the
+ *     binning or exactly on an edge aren't in any bin.
+ *
+ * @param nbins     : number of bins.
+ * @param edges     : nbins+1 edges, in increasing order.
+ * @param uniform   : true if all bins have the same width. Uniform binnings
+ *                    find bins arithmetically, and the rest by binary search.
+ * @param inv_width : inverse of the bin width, if uniform.
+ */
+typedef struct {
+    luint nbins;
+    double *edges;
+    bool uniform;
+    double inv_width;
+} rge_binning;
+
+// --+ library +----------------------------------------------------------------
+/**
+ * Initialize a binning from its edges. The edges are copied.
+ *
+ * @param binning : binning to initialize.
+ * @param nedges  : number of edges, at least 2.
+ * @param edges   : array of edges, in increasing order.
+ * @return        : success code (0).
+ */
+int rge_binning_init(rge_binning *binning, luint nedges, double *edges);
+
+/**
+ * Initialize a binning of nbins bins of the same width between low and high.
+ *
+ * @param binning : binning to initialize.
+ * @param low     : lower limit of the first bin.
+ * @param high    : upper limit of the last bin.
+ * @param nbins   : number of bins.
+ * @return        : success code (0).
+ */
+int rge_binning_init_uniform(
+        rge_binning *binning, double low, double high, luint nbins
+);
+
+/**
+ * Find the bin of a value.
+ *
+ * @param binning : binning.
+ * @param value   : value to look up.
+ * @return        : bin of value, or -1 if value isn't in any bin.
+ */
+lint rge_binning_find(const rge_binning *binning, double value);
+
+/**
+ * Find the flattened, row-major bin of a set of values over several binnings.
+ *
+ * @param binnings : array of ndims binnings.
+ * @param ndims    : number of binnings.
+ * @param values   : array of ndims values, one per binning.
+ * @return         : flattened bin, or -1 if any value isn't in any bin.
+ */
+lint rge_binning_find_nd(
+        const rge_binning *binnings, luint ndims, const double *values
+);
+
+/** Free the edges of a binning. */
+int rge_binning_free(rge_binning *binning);
+
+#endif
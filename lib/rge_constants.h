@@ -41,6 +41,8 @@ typedef struct {
 // --+ library +----------------------------------------------------------------
 /** Data tree name used by various programs. */
 #define RGE_TREENAMEDATA "data"
+/** Tree name used by make_ntuples when writing one entry per event. */
+#define RGE_TREENAMEEVENTS "events"
 
 /** Detector constants. */
 #define RGE_NSECTORS     6 /** # of CLAS12 sectors. */
@@ -59,6 +61,13 @@ typedef struct {
 #define RGE_VARS_SIZE 38
 extern const char *RGE_VARS[RGE_VARS_SIZE];
 
+/**
+ * ROOT leaflist type code of each variable in RGE_VARS: 'I' (Int_t), 'L'
+ *     (Long64_t), 'F' (Float_t), or 'O' (Bool_t). Identifiers and counters are
+ *     stored as integers so that they are exact, and kinematics as floats.
+ */
+extern const char RGE_VARTYPES[RGE_VARS_SIZE];
+
 /** Metadata variables. */
 const RGE_VAR RGE_RUNNO   = {.addr = 0, .name = "run_num"};
 const RGE_VAR RGE_EVENTNO = {.addr = 1, .name = "event_num"};
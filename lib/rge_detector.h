@@ -0,0 +1,144 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022-2023 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+// details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#ifndef RGE_DETECTOR
+#define RGE_DETECTOR
+
+// --+ preamble +---------------------------------------------------------------
+// C.
+#include <math.h>
+
+// C++.
+#include <vector>
+
+// rge-analysis.
+#include "rge_err_handler.h"
+#include "rge_hipo_bank.h"
+
+// typedefs.
+typedef unsigned int uint;
+typedef long unsigned int luint;
+typedef long int lint;
+
+// --+ structs +----------------------------------------------------------------
+/**
+ * Per-event index of the rows of a bank grouped by pindex, in compressed sparse
+ *     row (CSR) layout. The rows associated to particle pindex are
+ *     rows[offsets[pindex]] to rows[offsets[pindex+1] - 1], in the same order
+ *     as they appear in the bank. Vectors are kept between events to avoid
+ *     reallocating them.
+ *
+ * @param npindex : number of particles indexed.
+ * @param offsets : array of size npindex+1 with the start of each particle's
+ *                  rows in the rows array.
+ * @param rows    : bank rows, grouped by pindex.
+ */
+typedef struct {
+    luint npindex;
+    std::vector<luint> offsets;
+    std::vector<luint> rows;
+} rge_pindexmap;
+
+/**
+ * Detector data associated to one particle, obtained from the calorimeter,
+ *     Cherenkov, and scintillator banks.
+ *
+ * @param energy_PCAL : energy deposited in PCAL.
+ * @param energy_ECIN : energy deposited in ECIN.
+ * @param energy_ECOU : energy deposited in ECOU.
+ * @param nphe_HTCC   : number of photoelectrons deposited in HTCC.
+ * @param nphe_LTCC   : number of photoelectrons deposited in LTCC.
+ * @param tof         : most precise time of flight available. INFINITY if
+ *                      there are no FTOF or ECAL hits.
+ * @param tof_lyr     : layer from which tof was taken. FTOF layers are stored
+ *                      as-is, ECAL layers are stored as 10 + layer, and 0 means
+ *                      that no layer was found.
+ */
+typedef struct {
+    double energy_PCAL, energy_ECIN, energy_ECOU;
+    int nphe_HTCC, nphe_LTCC;
+    double tof;
+    int tof_lyr;
+} rge_detsummary;
+
+/** Bank columns read by rge_detsummary_fill(). */
+#define RGE_DETSUMMARY_CALCOLS ( \
+        RGE_COL(RGE_CAL_PINDEX) | RGE_COL(RGE_CAL_LAYER) | \
+        RGE_COL(RGE_CAL_ENERGY) | RGE_COL(RGE_CAL_TIME) \
+)
+#define RGE_DETSUMMARY_CHKVCOLS RGE_ALLCOLS
+#define RGE_DETSUMMARY_SCICOLS  RGE_ALLCOLS
+
+// --+ internal +---------------------------------------------------------------
+/** Detector IDs from CLAS12 reconstruction. */
+static const uint FTOF_ID = 12;
+static const uint HTCC_ID = 15;
+static const uint LTCC_ID = 16;
+
+/** FTOF layer IDs from CLAS12 reconstruction. */
+static const uint FTOF1A_LYR = 1;
+static const uint FTOF1B_LYR = 2;
+static const uint FTOF2_LYR  = 3;
+
+/**
+ * Rank the TOF precision of a hit. Higher is better, and 0 means that the hit
+ *     can't be used to get the TOF. In order of decreasing precision, the list
+ *     of detectors are:
+ *     FTOF1B > FTOF1A > FTOF2 > PCAL > ECIN > ECOU.
+ *
+ * @param tof_lyr : layer as stored in rge_detsummary.tof_lyr.
+ * @return        : precision rank of the layer.
+ */
+static int tof_rank(int tof_lyr);
+
+// --+ library +----------------------------------------------------------------
+/**
+ * Build a pindex map of bank b. Rows with a pindex outside of [0, npindex) are
+ *     left out of the map.
+ *
+ * @param m       : pointer to the rge_pindexmap to fill.
+ * @param b       : bank to index.
+ * @param col     : column of b containing the pindex.
+ * @param npindex : number of particles in the event.
+ * @return        : success code (0).
+ */
+int rge_pindexmap_fill(
+        rge_pindexmap *m, rge_hipobank *b, uint col, luint npindex
+);
+
+/**
+ * Fill the detector summary of every particle in the event, going once through
+ *     each of the calorimeter, Cherenkov, and scintillator banks. The TOF is
+ *     taken from the most precise FTOF hit, and from the most precise ECAL
+ *     layer if there are no FTOF hits. If a layer is hit more than once, the
+ *     first hit is used.
+ *
+ * @param calorimeter  : pointer to the calorimeter rge_hipobank.
+ * @param cherenkov    : pointer to the Cherenkov rge_hipobank.
+ * @param scintillator : pointer to the scintillator rge_hipobank.
+ * @param npart        : number of particles in the event.
+ * @param summaries    : vector that will be resized to npart and filled.
+ * @return             : error code. 0 if successful, 1 otherwise. The function
+ *                       only returns 1 if there's an invalid calorimeter layer
+ *                       or Cherenkov detector ID, suggesting data corruption or
+ *                       a change in the bank structure.
+ */
+int rge_detsummary_fill(
+        rge_hipobank *calorimeter, rge_hipobank *cherenkov,
+        rge_hipobank *scintillator, luint npart,
+        std::vector<rge_detsummary> *summaries
+);
+
+#endif
@@ -45,8 +45,17 @@ static int handle_err();
  *     ends abruptly without setting an error number. To check for undefined
  *     errors, all run() functions in the code should have a line with
  *     `rge_errno = RGEERR_NOERR;` before returning 0.
+ *
+ * Each thread has its own rge_errno, so library calls made from different
+ *     threads don't overwrite each other's errors. Worker threads should hand
+ *     their rge_errno to the thread that calls rge_print_usage().
+ *
+ * The error is per thread, not per call, so a failed call leaves its code in
+ *     rge_errno until the next failure. Library functions decide whether
+ *     they failed from the return values of the calls they make, and only
+ *     read rge_errno after one of them returned an error.
  */
-extern uint rge_errno;
+extern thread_local uint rge_errno;
 
 /**
  * Print usage and exit.
@@ -73,6 +82,9 @@ int rge_print_usage(const char *msg);
 #define RGEERR_INVALIDPID               18
 #define RGEERR_TOOMANYNUMBERS           19
 #define RGEERR_BADBINNING               20
+#define RGEERR_INVALIDNTHREADS          21
+#define RGEERR_INVALIDNTUPLEVARS        22
+#define RGEERR_BADBINEDGES              23
 // --+  50 -  99 file errors +--------------------------------------------------
 #define RGEERR_NOINPUTFILE              50
 #define RGEERR_NOSAMPFRACFILE           51
@@ -92,6 +104,15 @@ int rge_print_usage(const char *msg);
 #define RGEERR_OUTFILEEXISTS            65
 #define RGEERR_OUTPUTROOTFAILED         66
 #define RGEERR_OUTPUTTEXTFAILED         67
+#define RGEERR_INVALIDINPUTFILE         68
+#define RGEERR_MISSINGBANK              69
+#define RGEERR_OUTDATEDNTUPLEFILE       70
+#define RGEERR_MISSINGNTUPLEVAR         71
+#define RGEERR_BADSFPARTIAL             72
+#define RGEERR_SFLOCKFAILED             73
+#define RGEERR_BADACCFILE               74
+#define RGEERR_OUTPUTACCFAILED          75
+#define RGEERR_ACCMISMATCH              76
 // --+ 100 - 149 detector errors +----------------------------------------------
 #define RGEERR_INVALIDCALLAYER         100
 #define RGEERR_INVALIDCALSECTOR        101
@@ -105,12 +126,16 @@ int rge_print_usage(const char *msg);
 #define RGEERR_UNSUPPORTEDTYPE         154
 #define RGEERR_INVALIDENTRY            155
 #define RGEERR_WRONGENTRYTYPE          156
+#define RGEERR_BADHIPOSCHEMA           157
+#define RGEERR_TOOMANYBANKS            158
+#define RGEERR_THREADMISMATCH          159
 // --+ 200 - 249 particle errors +----------------------------------------------
 #define RGEERR_PIDNOTFOUND             201
 #define RGEERR_UNSUPPORTEDPID          202
 // --+ 900 - 999 miscellaneous +------------------------------------------------
 #define RGEERR_ANGLEOUTOFRANGE         900
 #define RGEERR_NOACCDATA               901
+#define RGEERR_OUTOFMEMORY             902
 // -----------------------------------------------------------------------------
 
 #endif
@@ -0,0 +1,128 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022-2023 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+// details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#ifndef RGE_EVENTLOADER
+#define RGE_EVENTLOADER
+
+// --+ preamble +---------------------------------------------------------------
+// C.
+#include <string.h>
+#include <unistd.h>
+
+// ROOT.
+#include <TFile.h>
+#include <TTree.h>
+
+// HIPO.
+#include "bank.h"
+#include "dictionary.h"
+#include "event.h"
+#include "reader.h"
+
+// rge-analysis.
+#include "rge_constants.h"
+#include "rge_err_handler.h"
+#include "rge_hipo_bank.h"
+
+// typedefs.
+typedef unsigned int uint;
+typedef long unsigned int luint;
+typedef long int lint;
+
+// --+ structs +----------------------------------------------------------------
+/** Maximum number of banks that can be read by one rge_eventloader. */
+#define RGE_MAXBANKS 6
+
+/** Size in bytes of the TTreeCache used when reading ROOT input. */
+#define RGE_TREECACHESIZE 30000000
+
+/**
+ * Struct reading events into a set of rge_hipobanks, either from a ROOT file
+ *     written by hipo2root or directly from a HIPO file. Which backend is used
+ *     is decided from the input file's extension.
+ *
+ * @param is_hipo   : true if reading from a HIPO file.
+ * @param nevents   : number of events in the input file.
+ * @param nbanks    : number of banks registered with rge_loader_add_bank().
+ * @param banks     : pointers to the registered banks.
+ * @param root_file : ROOT input file.
+ * @param tree      : TTree in the ROOT input file. Only the branches of the
+ *                    registered banks' entries in use are enabled and cached.
+ * @param learning  : true until the first event is read, while branches are
+ *                    still being added to the TTreeCache.
+ * @param reader    : HIPO reader.
+ * @param factory   : HIPO dictionary.
+ * @param event     : HIPO event buffer.
+ * @param hbanks    : HIPO banks associated to each registered bank.
+ */
+typedef struct {
+    bool is_hipo;
+    lint nevents;
+    uint nbanks;
+    rge_hipobank *banks[RGE_MAXBANKS];
+
+    // ROOT input.
+    TFile *root_file;
+    TTree *tree;
+    bool learning;
+
+    // HIPO input.
+    hipo::reader reader;
+    hipo::dictionary factory;
+    hipo::event event;
+    hipo::bank hbanks[RGE_MAXBANKS];
+} rge_eventloader;
+
+// --+ library +----------------------------------------------------------------
+/**
+ * Open filename and prepare l to read events from it.
+ *
+ * @param l        : pointer to the rge_eventloader to initialize.
+ * @param filename : input filename, with either a .root or a .hipo extension.
+ * @return         : error code. 0 if successful, 1 otherwise.
+ */
+int rge_loader_open(rge_eventloader *l, const char *filename);
+
+/** Check if the input file of l contains bank bank_version. */
+bool rge_loader_has_bank(rge_eventloader *l, const char *bank_version);
+
+/**
+ * Register bank b so that it's filled by every call to rge_loader_get_event().
+ *     b must outlive l. Every bank must be added before the first event is
+ *     read.
+ *
+ * @param l       : pointer to the rge_eventloader.
+ * @param b       : pointer to an rge_hipobank initialized with
+ *                  rge_hipobank_init().
+ * @param colmask : columns of b used by the program, built with RGE_COL(). The
+ *                  other columns are not read.
+ * @return        : error code. 0 if successful, 1 if there's no room for more
+ *                  banks or if the bank is not in the input file.
+ */
+int rge_loader_add_bank(rge_eventloader *l, rge_hipobank *b, uint colmask);
+
+/** Read event idx of the input file into every registered bank. */
+int rge_loader_get_event(rge_eventloader *l, lint idx);
+
+/**
+ * Get the number of bytes read from the input file so far, including TTreeCache
+ *     reads. Returns -1 for HIPO input.
+ */
+lint rge_loader_bytes_read(rge_eventloader *l);
+
+/** Close the input file of l. */
+int rge_loader_close(rge_eventloader *l);
+
+#endif
@@ -19,23 +19,33 @@
 // --+ preamble +---------------------------------------------------------------
 // C.
 #include <limits.h>
+#include <unistd.h>
 
 // C++.
-#include <map>
-#include <utility>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 // ROOT.
+#include <Math/MinimizerOptions.h>
 #include <TCanvas.h>
 #include <TF1.h>
 #include <TFile.h>
 #include <TGraphErrors.h>
 #include <TH1.h>
 #include <TH2.h>
+#include <TParameter.h>
+#include <TROOT.h>
 #include <TStyle.h>
 
 // rge-analysis.
 #include "../lib/rge_constants.h"
+#include "../lib/rge_detector.h"
 #include "../lib/rge_err_handler.h"
+#include "../lib/rge_event_loader.h"
 #include "../lib/rge_hipo_bank.h"
 #include "../lib/rge_math_utils.h"
 #include "../lib/rge_progress.h"
@@ -60,56 +70,306 @@ static const int ECAL_IDX = 3; /** ECAL idx in arrays. */
 static const double SF_PMIN  = 1.0; /** Minimum value. */
 static const double SF_PMAX  = 9.0; /** Maximum value. */
 static const double SF_PSTEP = 0.4; /** Step size to separate each bin. */
+static const int    SF_NPBINS = 20;  /** (SF_PMAX - SF_PMIN) / SF_PSTEP. */
+
+/** Size of the strings where histogram names are written. */
+static const int SF_NAMELEN = 128;
 
 /** Chi2 conformity for sampling fraction fits. */
 static const int SF_CHI2CONFORMITY = 2;
 
+/** Keys of the run number and projection setting in partial files. */
+static const char *SF_PARTIAL_RUNNO   = "run_no";
+static const char *SF_PARTIAL_PROJECT = "project";
+
+/** Number of parameters of the 1D E/p fit function. */
+static const int SF_GAUS_NPARS = 6;
+
+/** Moment estimate of the 1D E/p fit parameters. */
+static const int    SF_SEED_NSIDEBAND = 5;   /** Bins per sideband. */
+static const int    SF_SEED_NITER     = 3;   /** Truncation iterations. */
+static const double SF_SEED_NSIGMA    = 2.5; /** Truncation window, in RMS. */
+/** RMS of a Gaussian truncated at SF_SEED_NSIGMA sigma, in units of sigma. */
+static const double SF_SEED_RMSCORR   = 0.9547;
+/**
+ * Maximum chi2/ndf of the estimate for it to be used as the fit result
+ *     without running Minuit. Kept below SF_CHI2CONFORMITY.
+ */
+static const double SF_SEED_MAXCHI2   = 1.0;
+
+/**
+ * Write the name of the 1D E/p histogram of a calorimeter, sector, and
+ *     momentum bin to name.
+ *
+ * @param name     : string where the name is written.
+ * @param cal_i    : calorimeter index, as in CALNAME.
+ * @param sector_i : sector index, from 0 to RGE_NSECTORS-1.
+ * @param pbin     : momentum bin, from 0 to SF_NPBINS-1.
+ * @return         : success code (0).
+ */
+static int name_1D(char *name, int cal_i, int sector_i, int pbin);
+
+/** Write the key of a histogram in a partial file to key. */
+static int partial_key_2D(char *key, int cal_i, int sector_i);
+static int partial_key_1D(char *key, int cal_i, int sector_i, int pbin);
+
+/**
+ * Get the momentum bin of total momentum p.
+ *
+ * @param p : total momentum, in GeV.
+ * @return  : momentum bin, or -1 if p falls outside of [SF_PMIN, SF_PMAX].
+ */
+static int get_pbin(double p);
+
+/**
+ * Estimate the parameters of the 1D E/p fit function from the moments of a
+ *     histogram in [lo, hi]. The background is a line through the mean of
+ *     SF_SEED_NSIDEBAND bins at each end of the range. The Gaussian mean and
+ *     sigma are the mean and RMS of the background-subtracted histogram,
+ *     truncated SF_SEED_NITER times to SF_SEED_NSIGMA RMS around the mean.
+ *
+ * @param h    : E/p histogram.
+ * @param lo   : lower limit of the fit range.
+ * @param hi   : upper limit of the fit range.
+ * @param seed : array where the estimated parameters are written.
+ * @return     : true if the estimate is usable, false if the histogram has no
+ *               signal over the background in the range.
+ */
+static bool estimate_gaus(TH1 *h, double lo, double hi, double *seed);
+
+/**
+ * Compute the chi2 of a function against the non-empty bins of a histogram
+ *     in [lo, hi], as done by ROOT's default fit.
+ *
+ * @param h   : histogram.
+ * @param f   : function.
+ * @param lo  : lower limit of the range.
+ * @param hi  : upper limit of the range.
+ * @param npt : int where the number of bins used is written.
+ * @return    : chi2.
+ */
+static double range_chi2(TH1 *h, TF1 *f, double lo, double hi, int *npt);
+
+// --+ structs +----------------------------------------------------------------
+/**
+ * Sampling fraction study of one run: histograms and fits. Histograms are
+ *     filled one event at a time with rge_sfstudy_fill(), so that programs
+ *     reading the input for other reasons can fill them during the same pass.
+ *     They can also be written to a partial file and added to the histograms
+ *     of other studies of the same run before fitting.
+ *
+ * @param project     : if true, h1D is not filled. Instead, it is projected
+ *                      from h2D before fitting, since the p bins of h2D are
+ *                      aligned with the momentum bins.
+ * @param fixed_seeds : if true, 1D fits start from fixed parameters instead of
+ *                      the moment estimate of estimate_gaus(), and are always
+ *                      run. Meant to compare fit statistics.
+ * @param h1D         : E/p histograms, per calorimeter, sector, and momentum
+ *                      bin.
+ * @param h2D         : p vs E/p histograms, per calorimeter and sector.
+ * @param dotgraph    : means of the 1D fits, to which polyfit is fitted.
+ * @param polyfit     : sampling fraction fits.
+ * @param cal_map     : calorimeter rows grouped by pindex, reused every event.
+ */
+typedef struct {
+    bool project, fixed_seeds;
+    TH1 *h1D[NCALS][RGE_NSECTORS][SF_NPBINS];
+    TH2 *h2D[NCALS][RGE_NSECTORS];
+    TGraphErrors *dotgraph[NCALS][RGE_NSECTORS];
+    TF1 *polyfit[NCALS][RGE_NSECTORS];
+    rge_pindexmap cal_map;
+} rge_sfstudy;
+
+/** Bank columns read by rge_sfstudy_fill(). */
+#define RGE_SFSTUDY_PARTCOLS ( \
+        RGE_COL(RGE_PART_PX) | RGE_COL(RGE_PART_PY) | RGE_COL(RGE_PART_PZ) \
+)
+#define RGE_SFSTUDY_TRKCOLS RGE_COL(RGE_TRK_PINDEX)
+#define RGE_SFSTUDY_CALCOLS ( \
+        RGE_COL(RGE_CAL_PINDEX) | RGE_COL(RGE_CAL_LAYER) | \
+        RGE_COL(RGE_CAL_SECTOR) | RGE_COL(RGE_CAL_ENERGY) \
+)
+
+// --+ internal +---------------------------------------------------------------
 /**
- * Insert a 1-dimensional histogram of floats into a map.
+ * Statistics of the 1D fits, to check the cost and yield of the fit stage.
  *
- * @param map  : Map onto which we'll insert the histogram.
- * @param k    : Name of the particle (or set of particles) in the histogram.
- * @param n    : Name of the histogram to be inserted.
- * @param xn   : Name of the variable in the histogram's x axis.
- * @param bins : Number of bins in the histogram.
- * @param min  : Minimum value for the x axis of the histogram.
- * @param max  : Maximum value for the x axis of the histogram.
- * @return     : Success code (0).
- */
-static int insert_TH1F(
-        std::map<const char *, TH1 *> *map, const char *k, const char *n,
-        const char *xn, int bins, double min, double max
+ * @param nslices   : number of 1D histograms fitted.
+ * @param nestimate : slices where the moment estimate was good enough to be
+ *                    used without running Minuit.
+ * @param nminuit   : slices fitted with Minuit.
+ * @param nfailed   : Minuit fits that didn't converge.
+ * @param ncalls    : calls to the fit function made by Minuit.
+ * @param npoints   : slices whose mean was added to the dotgraph.
+ */
+typedef struct {
+    int nslices, nestimate, nminuit, nfailed, npoints;
+    lint ncalls;
+} sf_fitstats;
+
+/**
+ * Fit the 1D histograms of one calorimeter and sector, and then fit the
+ *     dotgraph built from their means.
+ *
+ * @param sf         : sampling fraction study.
+ * @param cal_i      : calorimeter index, as in CALNAME.
+ * @param sector_i   : sector index, from 0 to RGE_NSECTORS-1.
+ * @param sf_gaus    : 1D fit function, reset before each fit.
+ * @param minuit_mtx : mutex held during each call to the minimizer, or NULL
+ *                     if the minimizer can run in several threads at once.
+ * @param fitresults : array where the dotgraph fit parameters are written.
+ * @param stats      : fit statistics of the calorimeter and sector.
+ * @return           : success code (0).
+ */
+static int fit_sector(
+        rge_sfstudy *sf, int cal_i, int sector_i, TF1 *sf_gaus,
+        std::mutex *minuit_mtx, double fitresults[RGE_NSFPARAMS][2],
+        sf_fitstats *stats
 );
 
 /**
- * Insert a 2-dimensional histogram of floats into a map.
+ * Fit thread. Create a fit function and fit calorimeter-sector pairs taken
+ *     from next_task until there are none left. Each pair only touches its own
+ *     histograms, dotgraph, polyfit, and entries of fitresults and stats.
+ */
+static void fit_worker(
+        rge_sfstudy *sf, std::atomic<int> *next_task, int thread_i,
+        std::mutex *minuit_mtx,
+        double fitresults[NCALS][RGE_NSECTORS][RGE_NSFPARAMS][2],
+        sf_fitstats stats[NCALS][RGE_NSECTORS]
+);
+
+/**
+ * Add the histograms of a partial file to sf. If sf_init is false, sf is
+ *     first created with the settings of the partial and sf_init is set.
+ *     Otherwise, the partial must match the run number and projection setting
+ *     of sf.
  *
- * @param map   : Map onto which we'll insert the histogram.
- * @param k     : Name of the particle (or set of particles) in the histogram.
- * @param n     : Name of the histogram to be inserted.
- * @param nx    : Name of the variable in the histogram's x axis.
- * @param ny    : Name of the variable in the histogram's y axis.
- * @param xbins : Number of bins in the x axis of the histogram.
- * @param ybins : Number of bins in the y axis of the histogram.
- * @param xmin  : Minimum value for the x axis of the histogram.
- * @param xmax  : Maximum value for the x axis of the histogram.
- * @param ymin  : Minimum value for the y axis of the histogram.
- * @param ymax  : Maximum value for the y axis of the histogram.
- * @return      : Success code (0).
- */
-static int insert_TH2F(
-        std::map<const char *, TH1 *> *map, const char *k, const char *n,
-        const char *nx, const char *ny, int xbins, double xmin, double xmax,
-        int ybins, double ymin, double ymax
+ * @param sf          : sampling fraction study.
+ * @param sf_init     : whether sf has been created.
+ * @param file        : partial file written by rge_sfstudy_write().
+ * @param fixed_seeds : fixed seeds setting used if sf is created.
+ * @param run_no      : run number of sf. Written if sf is created.
+ * @return            : error code. 0 if successful, 1 otherwise.
+ */
+static int add_partial(
+        rge_sfstudy *sf, bool *sf_init, TFile *file, bool fixed_seeds,
+        int *run_no
 );
 
 // --+ library +----------------------------------------------------------------
+/**
+ * Create the histograms and fit functions of a sampling fraction study.
+ *
+ * @param sf          : sampling fraction study to initialize.
+ * @param project     : project 1D histograms from 2D histograms instead of
+ *                      filling them.
+ * @param fixed_seeds : start 1D fits from fixed parameters instead of a moment
+ *                      estimate.
+ * @return            : success code (0).
+ */
+int rge_sfstudy_init(rge_sfstudy *sf, bool project, bool fixed_seeds);
+
+/**
+ * Fill the histograms of a sampling fraction study with one event. Events
+ *     without particles, tracks, or calorimeter hits are skipped.
+ *
+ * @param sf          : sampling fraction study.
+ * @param particle    : REC::Particle bank of the event.
+ * @param track       : REC::Track bank of the event.
+ * @param calorimeter : REC::Calorimeter bank of the event.
+ * @return            : error code. 0 if successful, 1 otherwise.
+ */
+int rge_sfstudy_fill(
+        rge_sfstudy *sf, rge_hipobank *particle, rge_hipobank *track,
+        rge_hipobank *calorimeter
+);
+
+/**
+ * Write the histograms of a sampling fraction study to a partial file, to be
+ *     added to other studies of the same run with rge_sfstudy_add().
+ *
+ * @param sf       : sampling fraction study.
+ * @param filename : name of the partial file.
+ * @param run_no   : run number of the study.
+ * @return         : error code. 0 if successful, 1 otherwise.
+ */
+int rge_sfstudy_write(rge_sfstudy *sf, char *filename, int run_no);
+
+/**
+ * Get the run number and projection setting of a partial file written by
+ *     rge_sfstudy_write().
+ *
+ * @param file    : partial file.
+ * @param run_no  : int where the run number is written.
+ * @param project : bool where the projection setting is written.
+ * @return        : error code. 0 if successful, 1 otherwise.
+ */
+int rge_sfstudy_read_info(TFile *file, int *run_no, bool *project);
+
+/**
+ * Add the histograms of a partial file to the histograms of a sampling
+ *     fraction study. The partial must have the same projection setting as
+ *     the study.
+ *
+ * @param sf   : sampling fraction study.
+ * @param file : partial file written by rge_sfstudy_write().
+ * @return     : error code. 0 if successful, 1 otherwise.
+ */
+int rge_sfstudy_add(rge_sfstudy *sf, TFile *file);
+
+/**
+ * Fit the histograms of a sampling fraction study and write the fits and the
+ *     sampling fraction parameters to the output files. Fits of different
+ *     calorimeters and sectors run in parallel, and the results don't depend
+ *     on nthreads.
+ *
+ * @param sf          : sampling fraction study.
+ * @param work_dir    : directory where the output root file is written.
+ * @param sf_filename : sampling fraction parameters file to write.
+ * @param run_no      : run number, used to name the output root file.
+ * @param nthreads    : number of threads used to fit.
+ * @return            : error code. 0 if successful, 1 otherwise.
+ */
+int rge_sfstudy_fit(
+        rge_sfstudy *sf, char *work_dir, const char *sf_filename, int run_no,
+        int nthreads
+);
+
+/** Free the histograms and fit functions of a sampling fraction study. */
+int rge_sfstudy_free(rge_sfstudy *sf);
+
 /**
  * run() function of the extract_sf program. Check USAGE_MESSAGE from extract_sf
- *     for details.
+ *     for details. If partial_filename isn't NULL, the histograms are written
+ *     to it instead of being fitted.
  */
 int rge_extract_sf(
-        char *in_filename, char *work_dir, char *data_dir, lint nevn, int run_no
+        char *in_filename, char *work_dir, char *data_dir, lint nevn,
+        int run_no, bool project, bool fixed_seeds, int nthreads,
+        char *partial_filename
+);
+
+/**
+ * run() function of the extract_sf program in merge mode (-m). Add up the
+ *     histograms of partial files of the same run and fit them. If
+ *     partial_filename isn't NULL, the merged histograms are written to it
+ *     instead of being fitted.
+ *
+ * @param in_filenames     : partial files to merge.
+ * @param n_in             : number of partial files.
+ * @param work_dir         : directory where the output root file is written.
+ * @param data_dir         : directory where the output text file is written.
+ * @param fixed_seeds      : start 1D fits from fixed parameters instead of a
+ *                           moment estimate.
+ * @param nthreads         : number of threads used to fit.
+ * @param partial_filename : partial file where the merged histograms are
+ *                           written, or NULL to fit them.
+ * @return                 : error code. 0 if successful, 1 otherwise.
+ */
+int rge_merge_sf(
+        char **in_filenames, int n_in, char *work_dir, char *data_dir,
+        bool fixed_seeds, int nthreads, char *partial_filename
 );
 
 #endif
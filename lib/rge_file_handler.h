@@ -18,10 +18,23 @@
 
 // --+ preamble +---------------------------------------------------------------
 // C.
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
+// C++.
+#include <algorithm>
+
 // rge-analysis.
+#include "rge_bin_store.h"
 #include "rge_constants.h"
 #include "rge_err_handler.h"
 
@@ -30,9 +43,92 @@ typedef unsigned int uint;
 typedef long unsigned int luint;
 typedef long int lint;
 
+// --+ structs +----------------------------------------------------------------
+/** Version of the binary acceptance correction file format. */
+#define RGE_ACCFILE_VERSION 1
+
+/**
+ * Header of a binary acceptance correction file. It is followed by the edges
+ *     of the 5 binnings, the list of PIDs as 64-bit integers, and, starting at
+ *     counts_offset, the thrown and simulated counts of each PID as arrays of
+ *     nbins 64-bit integers ordered [Q2][nu][z_h][Pt2][phi_PQ]. Everything is
+ *     written in the byte order of the machine that wrote it.
+ *
+ * @param magic         : ACCFILE_MAGIC.
+ * @param version       : RGE_ACCFILE_VERSION.
+ * @param nedges        : number of edges of each binning.
+ * @param npids         : number of PIDs.
+ * @param nbins         : total number of bins.
+ * @param counts_offset : position of the counts in the file, a multiple of
+ *                        ACCFILE_ALIGN.
+ */
+typedef struct {
+    char magic[8];
+    luint version;
+    luint nedges[5];
+    luint npids;
+    luint nbins;
+    luint counts_offset;
+} rge_accheader;
+
+/**
+ * Acceptance correction data read by rge_read_acc_corr_file(). Counts for a
+ *     particular PID are stored in an array instead of a 5D array, in the
+ *     shape acc_corr[Q2 bin][nu bin][zh bin][PT2 bin][phiPQ bin].
+ *
+ * @param nedges   : number of edges of each binning.
+ * @param edges    : edges of each binning.
+ * @param npids    : number of PIDs.
+ * @param pids     : list of PIDs.
+ * @param nbins    : total number of bins.
+ * @param n_thrown : number of thrown events in each bin, for each PID.
+ * @param n_simul  : number of simulated events in each bin, for each PID.
+ * @param map      : memory where a binary file is mapped, or NULL if the
+ *                   data was read from a text file.
+ * @param map_size : size of map.
+ */
+typedef struct {
+    luint nedges[5];
+    double *edges[5];
+    luint npids;
+    lint *pids;
+    luint nbins;
+    luint **n_thrown;
+    luint **n_simul;
+    void *map;
+    luint map_size;
+} rge_accdata;
+
 // --+ internal +---------------------------------------------------------------
-/** Integer where to dump the unused return value of fscanf. */
-static int fscanf_dump;
+/**
+ * Integer where to dump the unused return value of fscanf. Thread-local so that
+ *     files can be read concurrently.
+ */
+static thread_local int fscanf_dump;
+
+/** Seconds between checks while waiting for a sampling fraction lock. */
+static const int SFLOCK_POLL  = 5;
+/**
+ * Seconds after which a sampling fraction lock that wasn't touched is assumed
+ *     to belong to a dead process.
+ */
+static const int SFLOCK_STALE = 1800;
+
+/** Write the name of the lock file of sampling fraction file sf_filename. */
+static int sflock_name(char *lock_filename, const char *sf_filename);
+
+/**
+ * Remove the lock file lock_filename, found stale with stat stale_stat. The
+ *     lock is first renamed to a name of this process, which only one process
+ *     can do, and then checked to still be the stale file. If another process
+ *     removed the stale lock and took a new one in between, the new lock is
+ *     put back instead.
+ *
+ * @return : true if the stale lock was removed by this process.
+ */
+static bool break_sflock(
+        const char *lock_filename, const struct stat *stale_stat
+);
 
 /**
  * Read binning data from text file and fill binning sizes array, bin_edges
@@ -63,10 +159,71 @@ static int get_bin_edges(
  * @return          : success code (0).
  */
 static int get_acc_corr(
-        FILE *file_in, luint pids_size, luint nbins, lint *pids, int **n_thrown,
-        int **n_simul
+        FILE *file_in, luint pids_size, luint nbins, lint *pids,
+        luint **n_thrown, luint **n_simul
+);
+
+/** First bytes of a binary acceptance correction file. */
+static const char ACCFILE_MAGIC[8] = "RGEACC";
+/** Alignment of the count arrays in binary acceptance correction files. */
+static const luint ACCFILE_ALIGN = 64;
+/** Number of counts written to a file at once. */
+static const luint ACCFILE_CHUNK = 4096;
+
+/**
+ * Write the counters of a bin store to an acceptance correction file, as a
+ *     5-dimensional array. Stores with fewer dimensions only fill the first
+ *     bin of the missing ones.
+ *
+ * @param file    : acceptance correction file.
+ * @param evn_cnt : bin store.
+ * @param nbins   : number of bins of each of the 5 binnings.
+ * @param text    : write the counters as a line of text instead of binary.
+ * @return        : success code (0).
+ */
+static int write_counts(
+        FILE *file, rge_binstore *evn_cnt, luint nbins[5], bool text
+);
+
+/**
+ * Write the edges of the 5 binnings and the list of PIDs to an acceptance
+ *     correction file. In binary files, this includes the header and the
+ *     padding up to the counts.
+ */
+static int write_acc_header(
+        FILE *file, luint nedges[5], double **edges, luint npids,
+        const lint *pids, bool text
+);
+
+/** Write an array of nbins counts to an acceptance correction file. */
+static int write_count_array(
+        FILE *file, luint *counts, luint nbins, bool text
 );
 
+/**
+ * Largest relative difference between two edges for them to be considered
+ *     the same when merging acceptance correction files.
+ */
+static const double ACCFILE_EDGETOL = 1e-8;
+
+/**
+ * Check that the header of a binary acceptance correction file matches this
+ *     version and file_size. nbins is recomputed from the edges, and every
+ *     size is checked for overflow, so a corrupt header can't point outside
+ *     the file.
+ *
+ * @param header    : header read from the file.
+ * @param file_size : size of the file, in bytes.
+ * @return          : true if the header is valid, false otherwise.
+ */
+static bool acc_header_valid(const rge_accheader *header, luint file_size);
+
+/** Read a binary acceptance correction file by mapping it to memory. */
+static int map_acc_corr(int fd, rge_accdata *acc);
+
+/** Read a text acceptance correction file, written by older versions. */
+static int read_acc_corr_text(FILE *file, rge_accdata *acc);
+
 // --+ library +----------------------------------------------------------------
 /**
  * Get sampling fraction parameters from file. File contents must follow CCDB
@@ -84,35 +241,83 @@ int rge_get_sf_params(
 );
 
 /**
- * Read acc_corr.txt file to get the acceptance correction for each bin for each
- *     PID. Acceptance correction for a particular PID is stored in an array
- *     instead of a 5D array to avoid writing it as *******acc_corr, in addition
- *     to simplicity in access. To access the array, think of it as a 5D array
- *     in the shape acc_corr[Q2 bin][nu bin][zh bin][PT2 bin][phiPQ bin],
- *     multiplying each entry by the appropiate size.
+ * Get the lock to compute the sampling fraction file sf_filename, or wait
+ *     until another process writes it. Locks are files created with O_EXCL
+ *     next to sf_filename, so that only one process of the ones sharing the
+ *     data directory gets it. A lock whose file wasn't touched in SFLOCK_STALE
+ *     seconds is removed with break_sflock().
+ *
+ * @param sf_filename : sampling fraction file.
+ * @param acquired    : set to true if this process got the lock, and so has
+ *                      to write sf_filename and call rge_sflock_release(). Set
+ *                      to false if sf_filename was written by another process.
+ * @return            : error code. 0 if successful, 1 otherwise.
+ */
+int rge_sflock_acquire(const char *sf_filename, bool *acquired);
+
+/**
+ * Update the modification time of the lock of sf_filename, so that other
+ *     processes don't take it as stale. Should be called every few minutes
+ *     while the lock is held.
+ */
+int rge_sflock_touch(const char *sf_filename);
+
+/** Release the lock of sf_filename. */
+int rge_sflock_release(const char *sf_filename);
+
+/**
+ * Read an acceptance correction file. Binary files written by acc_corr are
+ *     mapped to memory, so reading them takes the same time for any number of
+ *     bins. Text files exported by acc_corr -t are parsed.
+ *
+ * @param acc_filename : acceptance correction file.
+ * @param acc          : acceptance correction data to fill. Free it with
+ *                       rge_acc_corr_free().
+ * @return             : error code. 0 if successful, 1 otherwise.
+ */
+int rge_read_acc_corr_file(char *acc_filename, rge_accdata *acc);
+
+/**
+ * Write an acceptance correction file.
  *
- * @param acc_filename : char array with the filename containing the acceptance
- *                       correction to be processed.
- * @param bin_nedges   : array that we'll fill with the size of each of the 5
- *                       bin_edges.
- * @param bin_edges    : pointer to a 2-dimensional array that we'll fill with
- *                       the bin walls for each binning.
- * @param pids_size    : int where we'll write the number of PIDs in the file.
- * @param nbins        : int where we'll write the total number of bins.
- * @param pids         : pointer to an array where we'll write the list of PIDs
- *                       in the acceptance correction file.
- * @param n_thrown     : pointer to a 2-dimensional array where we'll write the
- *                       number of thrown events in each bin for each PID.
- * @param n_simul      : pointer to a 2-dimensional array where we'll write the
- *                       number of simulated events in each bin for each PID.
- * @return             : error code:
- *                         * 0: Function performed correctly.
- *                         * 1: Failed to access acceptance correction file.
- */
-int rge_read_acc_corr_file(
-        char *acc_filename, luint bin_nedges[5], double ***bin_edges,
-        luint *pids_size, luint *nbins, lint **pids, int ***n_thrown,
-        int ***n_simul
+ * @param filename : output file.
+ * @param nedges   : number of edges of each of the 5 binnings.
+ * @param edges    : edges of each of the 5 binnings.
+ * @param npids    : number of PIDs.
+ * @param pids     : list of PIDs.
+ * @param n_thrown : bin store with the thrown events of each PID.
+ * @param n_simul  : bin store with the simulated events of each PID.
+ * @param text     : write the text format instead of the binary one.
+ * @return         : error code. 0 if successful, 1 otherwise.
+ */
+int rge_write_acc_corr_file(
+        char *filename, luint nedges[5], double **edges, luint npids,
+        int *pids, rge_binstore *n_thrown, rge_binstore *n_simul, bool text
 );
 
+/**
+ * Write acceptance correction data to a file, in the same format as
+ *     rge_write_acc_corr_file().
+ *
+ * @param filename : output file.
+ * @param acc      : acceptance correction data.
+ * @param text     : write the text format instead of the binary one.
+ * @return         : error code. 0 if successful, 1 otherwise.
+ */
+int rge_write_acc_data(char *filename, rge_accdata *acc, bool text);
+
+/**
+ * Add the thrown and simulated counts of src to dst. Both must have the same
+ *     binnings and the same list of PIDs, although PIDs can be in a different
+ *     order. Counts are added as 64-bit integers.
+ *
+ * @param dst : acceptance correction data to which counts are added.
+ * @param src : acceptance correction data from which counts are read.
+ * @return    : error code. 0 if successful, 1 otherwise.
+ */
+int rge_merge_acc_data(rge_accdata *dst, rge_accdata *src);
+
+/** Free or unmap acceptance correction data. */
+int rge_acc_corr_free(rge_accdata *acc);
+
 #endif
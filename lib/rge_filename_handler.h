@@ -99,6 +99,25 @@ int rge_handle_root_filename(char *filename, int *run_no, double *beam_energy);
  */
 int rge_handle_root_filename(char *filename, int *run_no);
 
+/**
+ * Handle an input filename that can be either a root or a hipo file, checking
+ *     its validity, file existence, and grabbing the run number and beam
+ *     energy from it.
+ *
+ * @param filename    : filename to be processed.
+ * @param run_no      : pointer to the int where the run number will be written.
+ * @param beam_energy : pointer to the double where the beam energy will be
+ *                      written.
+ * @return            : error code.
+ */
+int rge_handle_input_filename(char *filename, int *run_no, double *beam_energy);
+
+/**
+ * Run rge_handle_input_filename(char *, int *, double *) without writing the
+ *     beam_energy to a variable.
+ */
+int rge_handle_input_filename(char *filename, int *run_no);
+
 /**
  * Handle a hipo filename, checking its validity, file existence, and grabbing
  *     the run number from it.
@@ -18,6 +18,8 @@
 
 // --+ preamble +---------------------------------------------------------------
 // C.
+#include <limits.h>
+#include <stdlib.h>
 #include "string.h"
 
 // C++.
@@ -25,6 +27,7 @@
 #include <vector>
 
 // ROOT.
+#include <TLeaf.h>
 #include <TTree.h>
 
 // HIPO.
@@ -62,25 +65,102 @@ struct cmp_str {
 /**
  * Struct containing one entry of a particular hipo bank.
  *
+ * @param name   : name of the entry in the hipo bank schema.
  * @param addr   : address of the entry in the hipo bank, as in BANK::NAME::VAR.
- * @param data   : vector with the data of the entry.
+ * @param data   : C array with the data of the entry, stored in its native
+ *                 hipo type.
  * @param branch : pointer to TBranch where to write the data.
  * @param type   : integer containing primitive type in hipo bank, as defined in
  *                 the internal variables.
+ * @param item   : position of the entry in the hipo bank schema. -1 until set
+ *                 by rge_link_schema().
  */
 typedef struct {
+    const char *name;
     const char *addr;
-    std::vector<double> *data;
+    void *data;
     TBranch *branch;
     uint type;
+    int item;
 } rge_hipoentry;
 
-/** Struct containing a map of all entries associated to a hipo bank. */
+/** Maximum number of entries (columns) in any of the supported banks. */
+#define RGE_MAXCOLS 12
+
+/** Bitmask selecting column col of a bank, and all columns of a bank. */
+#define RGE_COL(col) (1u << (col))
+#define RGE_ALLCOLS  (~0u)
+
+/**
+ * Struct containing all entries associated to a hipo bank. Entries are stored
+ *     in the order given by the column indices below, so that accessing one is
+ *     a single array index instead of a lookup by name.
+ *
+ * In the TTree, each bank is stored as one count branch (BANK::NAME::nrows)
+ *     plus one C array branch per entry, with its length given by the count
+ *     branch. Arrays are allocated with room for capacity rows and are grown
+ *     as needed.
+ *
+ * Only the entries in colmask are read from a TTree or a hipo bank. Accessing
+ *     any other entry is an error.
+ *
+ * @param name         : bank name, as in BANK::NAME.
+ * @param nrows        : number of rows in the current event.
+ * @param ncols        : number of entries in the bank.
+ * @param colmask      : bitmask of the entries in use, built with RGE_COL().
+ * @param capacity     : number of rows each entry's array can hold.
+ * @param count        : number of rows as stored in the count branch.
+ * @param count_branch : pointer to the count TBranch.
+ * @param entries      : array of entries.
+ */
 typedef struct {
+    const char *name;
     luint nrows;
-    std::map<const char *, rge_hipoentry, cmp_str> entries;
+    uint ncols;
+    uint colmask;
+    luint capacity;
+    Int_t count;
+    TBranch *count_branch;
+    rge_hipoentry entries[RGE_MAXCOLS];
 } rge_hipobank;
 
+// --+ column indices +---------------------------------------------------------
+/** REC::Particle columns. */
+enum {
+    RGE_PART_PID, RGE_PART_VX, RGE_PART_VY, RGE_PART_VZ, RGE_PART_PX,
+    RGE_PART_PY, RGE_PART_PZ, RGE_PART_VT, RGE_PART_CHARGE, RGE_PART_BETA,
+    RGE_PART_CHI2PID, RGE_PART_STATUS, RGE_PART_NCOLS
+};
+
+/** REC::Track columns. */
+enum {
+    RGE_TRK_INDEX, RGE_TRK_PINDEX, RGE_TRK_SECTOR, RGE_TRK_NDF, RGE_TRK_CHI2,
+    RGE_TRK_NCOLS
+};
+
+/** REC::Calorimeter columns. */
+enum {
+    RGE_CAL_PINDEX, RGE_CAL_LAYER, RGE_CAL_SECTOR, RGE_CAL_ENERGY,
+    RGE_CAL_TIME, RGE_CAL_NCOLS
+};
+
+/** REC::Cherenkov columns. */
+enum {
+    RGE_CHKV_PINDEX, RGE_CHKV_DETECTOR, RGE_CHKV_NPHE, RGE_CHKV_NCOLS
+};
+
+/** REC::Scintillator columns. */
+enum {
+    RGE_SCI_PINDEX, RGE_SCI_TIME, RGE_SCI_DETECTOR, RGE_SCI_LAYER,
+    RGE_SCI_NCOLS
+};
+
+/** FMT::Tracks columns. */
+enum {
+    RGE_FMT_INDEX, RGE_FMT_NDF, RGE_FMT_VX, RGE_FMT_VY, RGE_FMT_VZ, RGE_FMT_PX,
+    RGE_FMT_PY, RGE_FMT_PZ, RGE_FMT_NCOLS
+};
+
 // --+ internal +---------------------------------------------------------------
 /** internal variables to refer to different primitive types. */
 static const uint BYTE  = 0;
@@ -88,45 +168,109 @@ static const uint SHORT = 1;
 static const uint INT   = 2;
 static const uint FLOAT = 3;
 
-/** Internal iterator used to loop through entries. */
-static std::map<const char *, rge_hipoentry, cmp_str>::const_iterator it;
+/** Number of rows allocated for each entry when a bank is initialized. */
+static const luint INIT_CAPACITY = 32;
 
 /**
- * Initialize and return one rge_hipoentry. Parameters addr and type are
+ * Initialize and return one rge_hipoentry. Parameters name, addr, and type are
  *     initialized to input, data is initialized to an empty vector to be read
  *     from hipo, and branch is initialized to a nullptr to be handled by root.
  */
-static rge_hipoentry entry_init(const char *in_addr, uint in_type);
+static rge_hipoentry entry_init(
+        const char *in_name, const char *in_addr, uint in_type
+);
+
+/** Size in bytes of one element of primitive type type. */
+static size_t type_size(uint type);
+
+/** ROOT leaflist type code of primitive type type. */
+static char type_code(uint type);
+
+/** Type ID used by hipo schemas for primitive type type. */
+static int hipo_type(uint type);
+
+/**
+ * Write to out the ROOT leaf name associated to addr, with every "::" replaced
+ *     by "_". out should have room for strlen(addr) + 1 characters.
+ */
+static void leaf_name(char *out, const char *addr);
+
+/**
+ * Make sure that every entry in b has room for nrows rows, re-pointing the
+ *     entries' branches if the arrays are reallocated. Returns 1 if an array
+ *     can't be grown, leaving it as it was.
+ */
+static int reserve_rows(rge_hipobank *b, luint nrows);
 
 /** Set b.nrows to in_rows. */
 static int set_nrows(rge_hipobank *b, luint in_nrows);
 
-/** Get entry number idx with name var from bank b. */
-static double get_entry(rge_hipobank *b, const char *var, luint idx);
+/** Get entry number idx from column col of bank b. */
+static double get_entry(rge_hipobank *b, uint col, luint idx);
 
 // --+ library +----------------------------------------------------------------
 /** Initialize rge_hipobank based on static map related to bank_version. */
 rge_hipobank rge_hipobank_init(const char *bank_version);
 
-/** Initialize rge_hipobank and set branch addresses to t's branches. */
-rge_hipobank rge_hipobank_init(const char *bank_version, TTree *t);
+/** Write to addr the name of the count branch of bank bank_version. */
+int rge_count_addr(const char *bank_version, char *addr);
+
+/** Set the addresses of t's branches to the entries of b in use. */
+int rge_set_branch_addresses(rge_hipobank *b, TTree *t);
 
-/** Link branches of t to entries of b. */
+/** Create one count branch and one array branch per entry of b in t. */
 int rge_link_branches(rge_hipobank *b, TTree *t);
 
-/** Fill entries in rb with data from hb. */
-int rge_fill(rge_hipobank *rb, hipo::bank hb);
+/** Free the arrays allocated for b. */
+int rge_hipobank_free(rge_hipobank *b);
+
+/**
+ * Find the position of each of rb's entries in schema s. Must be called once
+ *     per input file before rge_fill().
+ *
+ * @param rb : rge_hipobank to link.
+ * @param s  : hipo schema of the bank that will be read into rb.
+ * @return   : error code. 0 if successful, 1 if an entry is missing from s or
+ *             has a different type.
+ */
+int rge_link_schema(rge_hipobank *rb, hipo::schema *s);
+
+/**
+ * Fill entries in rb with data from hb, copying one column at a time. Column
+ *     offsets are computed from the positions found by rge_link_schema(), so
+ *     no lookup by name is done.
+ */
+int rge_fill(rge_hipobank *rb, hipo::bank *hb);
+
+/**
+ * Append the current rows of b to buf: the number of rows, followed by each
+ *     entry's array. Used to move events between threads.
+ */
+int rge_pack(rge_hipobank *b, std::vector<char> *buf);
 
-/** Read entries from t into b. */
-int rge_get_entries(rge_hipobank *b, TTree *t, int idx);
+/**
+ * Read into b one set of rows written by rge_pack(), starting at position *pos
+ *     of buf. *pos is moved to the end of the rows read.
+ */
+int rge_unpack(rge_hipobank *b, const std::vector<char> *buf, luint *pos);
+
+/**
+ * Read the entries in use of b from their branches.
+ *
+ * @param b         : rge_hipobank linked with rge_set_branch_addresses().
+ * @param local_idx : entry number in the current tree, as returned by
+ *                    TTree::LoadTree().
+ * @return          : error code. 0 if successful, 1 otherwise.
+ */
+int rge_get_entries(rge_hipobank *b, Long64_t local_idx);
 
-/** Get entry number idx with name var from bank b as a double. */
-double rge_get_double(rge_hipobank *b, const char *var, luint idx);
+/** Get entry number idx from column col of bank b as a double. */
+double rge_get_double(rge_hipobank *b, uint col, luint idx);
 
-/** Get entry number idx with name var from bank b as an int. */
-int rge_get_int(rge_hipobank *b, const char *var, luint idx);
+/** Get entry number idx from column col of bank b as an int. */
+int rge_get_int(rge_hipobank *b, uint col, luint idx);
 
-/** Get entry number idx with name var from bank b as an unsigned int. */
-uint rge_get_uint(rge_hipobank *b, const char *var, luint idx);
+/** Get entry number idx from column col of bank b as an unsigned int. */
+uint rge_get_uint(rge_hipobank *b, uint col, luint idx);
 
 #endif
@@ -33,12 +33,12 @@ typedef long int lint;
 
 // --+ internal +---------------------------------------------------------------
 /** Integer where to dump the unused return value of scanf. */
-static int scanf_dump;
+static thread_local int scanf_dump;
 
 /** Minimum number of FMT layers to accept a track. */
-static uint FMTMINLAYERS = 2;
+static const uint FMTMINLAYERS = 2;
 /** Total number of FMT layers. */
-static uint FMTNLAYERS   = 3;
+static const uint FMTNLAYERS   = 3;
 
 /** Check if character c is a number. Returns 1 if it is, 0 if it isn't. */
 static int is_number(char c);
@@ -92,6 +92,9 @@ int rge_process_pid(lint *pid, char *arg);
 /** Run strtol on arg to get number of FMT layers required. */
 int rge_process_fmtnlayers(lint *nlayers, char *arg);
 
+/** Run strtol on arg to get number of worker threads. */
+int rge_process_nthreads(lint *nthreads, char *arg);
+
 /** Catch a y (yes) or a n (no) from stdin. */
 bool rge_catch_yn();
 
@@ -0,0 +1,311 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022-2023 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+// details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#ifndef RGE_NTUPLE
+#define RGE_NTUPLE
+
+// --+ preamble +---------------------------------------------------------------
+// C.
+#include <stdlib.h>
+#include <string.h>
+
+// ROOT.
+#include <TFile.h>
+#include <TLeaf.h>
+#include <TTree.h>
+
+// rge-analysis.
+#include "rge_constants.h"
+#include "rge_err_handler.h"
+
+// typedefs.
+typedef unsigned int uint;
+typedef long unsigned int luint;
+typedef long int lint;
+
+// --+ structs +----------------------------------------------------------------
+/**
+ * Value of one variable in RGE_VARS. The member in use is given by the
+ *     variable's type code in RGE_VARTYPES. An array of RGE_VARS_SIZE
+ *     rge_varvals holds one ntuple row, and its elements are used as branch
+ *     addresses.
+ *
+ * @param o : value of an 'O' (Bool_t) variable.
+ * @param i : value of an 'I' (Int_t) variable.
+ * @param l : value of an 'L' (Long64_t) variable.
+ * @param f : value of an 'F' (Float_t) variable.
+ */
+typedef union {
+    Bool_t o;
+    Int_t i;
+    Long64_t l;
+    Float_t f;
+} rge_varval;
+
+/**
+ * Masks selecting a subset of RGE_VARS, with one bit per variable address.
+ *     RGE_VARBIT(RGE_Q2.addr) selects Q2, and RGE_ALLVARS selects everything.
+ */
+#define RGE_VARBIT(addr) (1lu << (addr))
+#define RGE_ALLVARS      ((1lu << RGE_VARS_SIZE) - 1)
+
+/**
+ * Variables shared by all particles of an event. In the event layout they are
+ *     stored once per entry, and every other variable is stored as an array
+ *     with one value per particle.
+ */
+#define RGE_EVENTVARS ( \
+        RGE_VARBIT(RGE_RUNNO.addr) | RGE_VARBIT(RGE_EVENTNO.addr) | \
+        RGE_VARBIT(RGE_BEAME.addr) | RGE_VARBIT(RGE_Q2.addr)      | \
+        RGE_VARBIT(RGE_NU.addr)    | RGE_VARBIT(RGE_XB.addr)      | \
+        RGE_VARBIT(RGE_YB.addr)    | RGE_VARBIT(RGE_W2.addr)        \
+)
+
+/** Name of the branch with the number of particles in the event layout. */
+#define RGE_NPARTNAME "npart"
+
+/**
+ * One entry of the event layout: the event variables of an event and arrays
+ *     with the variables of each of its particles. The trigger electron is
+ *     always the first particle.
+ *
+ * @param npart    : number of particles in the event.
+ * @param capacity : number of particles that fit in the arrays.
+ * @param varmask  : variables with a branch in the tree.
+ * @param scalars  : event variables, at their address in RGE_VARS.
+ * @param arrays   : particle variables, at their address in RGE_VARS. Each
+ *                   array has the type given by RGE_VARTYPES, and is NULL for
+ *                   event variables.
+ * @param branches : branch of each particle variable, or NULL if the variable
+ *                   isn't in the tree.
+ */
+typedef struct {
+    Int_t npart;
+    luint capacity;
+    luint varmask;
+    rge_varval scalars[RGE_VARS_SIZE];
+    void *arrays[RGE_VARS_SIZE];
+    TBranch *branches[RGE_VARS_SIZE];
+} rge_eventrow;
+
+/**
+ * Reader of a file written by make_ntuples, in either layout. Each call to
+ *     rge_ntuplereader_get_particle() leaves one particle's variables in vals.
+ *
+ * @param tree     : tree in the file, either RGE_TREENAMEDATA (one entry per
+ *                   particle) or RGE_TREENAMEEVENTS (one entry per event).
+ * @param is_event : true if tree uses the event layout.
+ * @param varmask  : variables present in tree.
+ * @param ev       : entry buffer, only used in the event layout.
+ * @param vals     : variables of the current particle.
+ */
+typedef struct {
+    TTree *tree;
+    bool is_event;
+    luint varmask;
+    rge_eventrow ev;
+    rge_varval vals[RGE_VARS_SIZE];
+} rge_ntuplereader;
+
+// --+ internal +---------------------------------------------------------------
+/** Separator between variables and profiles in rge_ntuple_parse_vars(). */
+static const char *VARS_SEPARATOR = ",";
+
+/**
+ * Named sets of variables accepted by rge_ntuple_parse_vars().
+ *   * all      : every variable in RGE_VARS.
+ *   * electron : trigger electron kinematics and vertex, with the DIS
+ *                variables.
+ *   * sidis    : electron, plus what is needed to identify and bin hadrons.
+ */
+#define NPROFILES 3
+static const char *PROFILE_NAMES[NPROFILES] = {"all", "electron", "sidis"};
+static const luint PROFILE_ELECTRON =
+        RGE_VARBIT(RGE_EVENTNO.addr) | RGE_VARBIT(RGE_PID.addr)   |
+        RGE_VARBIT(RGE_STATUS.addr)  | RGE_VARBIT(RGE_TRIGGERSTATUS.addr) |
+        RGE_VARBIT(RGE_VX.addr)      | RGE_VARBIT(RGE_VY.addr)    |
+        RGE_VARBIT(RGE_VZ.addr)      | RGE_VARBIT(RGE_PX.addr)    |
+        RGE_VARBIT(RGE_PY.addr)      | RGE_VARBIT(RGE_PZ.addr)    |
+        RGE_VARBIT(RGE_P.addr)       | RGE_VARBIT(RGE_THETA.addr) |
+        RGE_VARBIT(RGE_PHI.addr)     | RGE_VARBIT(RGE_Q2.addr)    |
+        RGE_VARBIT(RGE_NU.addr)      | RGE_VARBIT(RGE_XB.addr)    |
+        RGE_VARBIT(RGE_YB.addr)      | RGE_VARBIT(RGE_W2.addr);
+static const luint PROFILE_SIDIS = PROFILE_ELECTRON |
+        RGE_VARBIT(RGE_CHARGE.addr)  | RGE_VARBIT(RGE_SECTOR.addr) |
+        RGE_VARBIT(RGE_ZH.addr)      | RGE_VARBIT(RGE_PT2.addr)    |
+        RGE_VARBIT(RGE_PL2.addr)     | RGE_VARBIT(RGE_PHIPQ.addr)  |
+        RGE_VARBIT(RGE_THETAPQ.addr);
+static const luint PROFILE_MASKS[NPROFILES] = {
+        RGE_ALLVARS, PROFILE_ELECTRON, PROFILE_SIDIS
+};
+
+/** Return the name of the ROOT type associated to type code t. */
+static const char *type_name(char t);
+
+/**
+ * Find the mask associated to a variable or profile name. Returns 0 if name is
+ *     neither.
+ */
+static luint name_mask(const char *name);
+
+/** Initial number of particles that fit in an rge_eventrow. */
+static const luint INIT_NPART = 16;
+
+/** Return the size in bytes of a variable of type code t. */
+static size_t vartype_size(char t);
+
+/**
+ * Make room for npart particles in the arrays of ev, growing them
+ *     geometrically and pointing their branches to the new arrays. Returns 1
+ *     if an array can't be grown, leaving it as it was.
+ */
+static int reserve_particles(rge_eventrow *ev, luint npart);
+
+/** Set the branch addresses of an event layout tree to r->ev. */
+static int set_event_addresses(rge_ntuplereader *r);
+
+// --+ library +----------------------------------------------------------------
+/**
+ * Parse a list of variable and profile names separated by VARS_SEPARATOR into
+ *     a mask of variables.
+ *
+ * @param arg     : list of names, such as "electron,z_h,p_T2".
+ * @param varmask : pointer to the mask that will be filled.
+ * @return        : error code. 0 if successful, 1 if a name is not a variable
+ *                  in RGE_VARS or a profile.
+ */
+int rge_ntuple_parse_vars(const char *arg, luint *varmask);
+
+/**
+ * Create one branch in tree t for each variable in varmask, using the type in
+ *     RGE_VARTYPES.
+ *
+ * @param t       : TTree where the branches will be created.
+ * @param vals    : array of RGE_VARS_SIZE rge_varvals used as branch addresses.
+ * @param varmask : mask of variables to write.
+ * @return        : success code (0).
+ */
+int rge_ntuple_branch(TTree *t, rge_varval *vals, luint varmask);
+
+/**
+ * Check that tree t has a branch for each variable in varmask, and that all of
+ *     its RGE_VARS branches have the type in RGE_VARTYPES.
+ *
+ * @param t       : TTree written by make_ntuples.
+ * @param varmask : mask of variables that are required.
+ * @return        : error code. 0 if successful, 1 otherwise.
+ */
+int rge_ntuple_check(TTree *t, luint varmask);
+
+/**
+ * Set the address of every RGE_VARS branch present in tree t to vals. Values of
+ *     variables without a branch are set to 0.
+ *
+ * @param t       : TTree written by make_ntuples.
+ * @param vals    : array of RGE_VARS_SIZE rge_varvals used as branch
+ *                  addresses.
+ * @param varmask : pointer to the mask that will be filled with the variables
+ *                  present in t.
+ * @return        : error code. 0 if successful, 1 if a branch has a different
+ *                  type than in RGE_VARTYPES, which happens with ntuple files
+ *                  written by an older version of make_ntuples.
+ */
+int rge_ntuple_set_addresses(TTree *t, rge_varval *vals, luint *varmask);
+
+/** Create an empty rge_eventrow. */
+rge_eventrow rge_eventrow_init();
+
+/**
+ * Create the branches of the event layout in tree t: the particle count, one
+ *     branch for each event variable in varmask, and one array branch for
+ *     each particle variable in varmask.
+ *
+ * @param t       : TTree where the branches will be created.
+ * @param ev      : rge_eventrow used as branch addresses.
+ * @param varmask : mask of variables to write.
+ * @return        : error code. 0 if successful, 1 if the arrays can't be
+ *                  allocated.
+ */
+int rge_eventrow_branch(TTree *t, rge_eventrow *ev, luint varmask);
+
+/**
+ * Add a particle to ev. The event variables are taken from the first particle
+ *     added after ev->npart is set to 0.
+ *
+ * @param ev  : pointer to the rge_eventrow.
+ * @param row : array of RGE_VARS_SIZE rge_varvals with the particle's
+ *              variables, as filled by rge_fill_ntuples_arr().
+ * @return    : error code. 0 if successful, 1 if the arrays can't be grown.
+ */
+int rge_eventrow_add(rge_eventrow *ev, const rge_varval *row);
+
+/**
+ * Copy the event variables and the variables of particle idx of ev into row.
+ *
+ * @param ev  : pointer to the rge_eventrow.
+ * @param idx : particle index, smaller than ev->npart.
+ * @param row : array of RGE_VARS_SIZE rge_varvals that will be filled.
+ * @return    : success code (0).
+ */
+int rge_eventrow_get(const rge_eventrow *ev, luint idx, rge_varval *row);
+
+/** Free the arrays of ev. */
+int rge_eventrow_free(rge_eventrow *ev);
+
+/**
+ * Open the tree of a file written by make_ntuples and set the branch addresses
+ *     of every variable present in it.
+ *
+ * @param r : pointer to the rge_ntuplereader.
+ * @param f : file written by make_ntuples.
+ * @return  : error code. 0 if successful, 1 if the file has no tree or its
+ *            branches have unexpected types.
+ */
+int rge_ntuplereader_open(rge_ntuplereader *r, TFile *f);
+
+/**
+ * Load an entry of the tree.
+ *
+ * @param r     : pointer to the rge_ntuplereader.
+ * @param entry : entry number.
+ * @return      : number of particles in the entry. Always 1 in the particle
+ *                layout.
+ */
+luint rge_ntuplereader_get_entry(rge_ntuplereader *r, Long64_t entry);
+
+/**
+ * Copy the variables of particle idx of the current entry into r->vals. Does
+ *     nothing in the particle layout, where the branches point to r->vals.
+ *
+ * @param r   : pointer to the rge_ntuplereader.
+ * @param idx : particle index, smaller than the number of particles returned
+ *              by rge_ntuplereader_get_entry().
+ * @return    : success code (0).
+ */
+int rge_ntuplereader_get_particle(rge_ntuplereader *r, luint idx);
+
+/** Free the buffers of r. */
+int rge_ntuplereader_free(rge_ntuplereader *r);
+
+/**
+ * Get the value of a variable as a double, whatever its type.
+ *
+ * @param vals : array of RGE_VARS_SIZE rge_varvals.
+ * @param addr : address of the variable in RGE_VARS.
+ * @return     : value of the variable.
+ */
+double rge_varval_get(const rge_varval *vals, int addr);
+
+#endif
@@ -25,6 +25,7 @@
 #include "rge_constants.h"
 #include "rge_hipo_bank.h"
 #include "rge_math_utils.h"
+#include "rge_ntuple.h"
 #include "rge_pid_utils.h"
 
 // typedefs.
@@ -65,6 +66,18 @@ typedef struct {
     double beta, vx, vy, vz, px, py, pz, mass;
 } rge_particle;
 
+/** Bank columns read by rge_particle_init(). */
+#define RGE_PARTICLE_PARTCOLS ( \
+        RGE_COL(RGE_PART_CHARGE) | RGE_COL(RGE_PART_BETA) | \
+        RGE_COL(RGE_PART_VX) | RGE_COL(RGE_PART_VY) | RGE_COL(RGE_PART_VZ) | \
+        RGE_COL(RGE_PART_PX) | RGE_COL(RGE_PART_PY) | RGE_COL(RGE_PART_PZ) \
+)
+#define RGE_PARTICLE_TRKCOLS ( \
+        RGE_COL(RGE_TRK_INDEX) | RGE_COL(RGE_TRK_PINDEX) | \
+        RGE_COL(RGE_TRK_SECTOR) \
+)
+#define RGE_PARTICLE_FMTCOLS (RGE_ALLCOLS & ~RGE_COL(RGE_FMT_INDEX))
+
 // --+ internal +---------------------------------------------------------------
 /** Maximum beta allowed to assign PID 2212 (neutron). */
 static const double NEUTRON_MAXBETA     = .9;
@@ -78,6 +91,16 @@ static const int    LTCC_NPHE_CUT       = 2;
 static const double MIN_PCAL_ENERGY     = .060;
 /** Maximum ECAL sampling fraction sigma to assign PID 11 or -11 (electron). */
 static const double E_SF_NSIGMA         = 5.0;
+
+/** Variables computed together by rge_fill_ntuples_arr(). */
+static const luint DIS_VARS =
+        RGE_VARBIT(RGE_Q2.addr) | RGE_VARBIT(RGE_NU.addr) |
+        RGE_VARBIT(RGE_XB.addr) | RGE_VARBIT(RGE_YB.addr) |
+        RGE_VARBIT(RGE_W2.addr);
+static const luint SIDIS_VARS =
+        RGE_VARBIT(RGE_ZH.addr)    | RGE_VARBIT(RGE_PT2.addr) |
+        RGE_VARBIT(RGE_PL2.addr)   | RGE_VARBIT(RGE_PHIPQ.addr) |
+        RGE_VARBIT(RGE_THETAPQ.addr);
 /** Momentum (GeV) required to consider particle crossing HTCC to be a pion. */
 static const double HTCC_PION_THRESHOLD = 4.9 ;
 
@@ -234,13 +257,15 @@ int rge_set_pid(
 
 /**
  * Fill array to be stored in ntuples_%06d.root file. Array is of constant size
- *     RGE_VARS_SIZE, and the order of variables can be seen in constants.h.
+ *     RGE_VARS_SIZE, and the order and type of variables can be seen in
+ *     constants.h. Derived variables outside of varmask are not computed, and
+ *     their value in arr is left untouched.
  */
 int rge_fill_ntuples_arr(
-        Float_t *arr, rge_particle p, rge_particle e, int run_no, int evn,
-        int status, double beam_E, float chi2, float ndf, double pcal_energy,
+        rge_varval *arr, rge_particle p, rge_particle e, int run_no, lint evn,
+        int status, double beam_E, float chi2, int ndf, double pcal_energy,
         double ecin_E, double ecou_E, double tof, double tre_tof, int nphe_ltcc,
-        int nphe_htcc
+        int nphe_htcc, luint varmask
 );
 
 #endif
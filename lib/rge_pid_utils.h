@@ -57,10 +57,11 @@ typedef struct {
  */
 static rge_pidconstants pid_constants_init(int q, double m, const char *n);
 
-/** PID_MAP global iterator. */
-static std::map<int, rge_pidconstants>::const_iterator pid_it;
-
-/** Counters for negative, neutral, and positive PIDs in list. */
+/**
+ * Counters for negative, neutral, and positive PIDs in list. Only written while
+ *     PID_MAP is statically initialized, so they're safe to read from any
+ *     thread.
+ */
 static uint negative_size = 0;
 static uint neutral_size  = 0;
 static uint positive_size = 0;
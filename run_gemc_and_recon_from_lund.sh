@@ -67,7 +67,6 @@ recon-util -i $sim_file -o $reco_file -y $RECON_YAML >> $log_file 2>> $err_file
 tmpdir=/work/clas12/spaul/rge-sim/tmp_${i}_${A}
 mkdir -p $tmpdir
 cd /home/spaul/clas12-rge-analysis/
-bin/hipo2root -w $tmpdir $reco_file >> $log_file 2>> $err_file
-bin/make_ntuples -w $tmpdir $tmpdir/banks_000000.root >> $log_file 2>> $err_file
+bin/make_ntuples -w $tmpdir $reco_file >> $log_file 2>> $err_file
 #cp $tmpdir/banks_000000.root /work/clas12/spaul/rge-sim/rge-sim_${A}_tuples_${i}.root
 
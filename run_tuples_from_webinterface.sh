@@ -45,11 +45,9 @@ module load clas12
 tmpdir=$workdir/tmp/${i}
 mkdir -p $tmpdir
 cd /home/spaul/clas12-rge-analysis/
-echo hipo2root
 ls $reco_file
-bin/hipo2root -w $tmpdir $reco_file >> $log_file 2>> $err_file
 echo make_tuples
-bin/make_ntuples -w $tmpdir $tmpdir/banks_*.root >> $log_file 2>> $err_file
+bin/make_ntuples -w $tmpdir $reco_file >> $log_file 2>> $err_file
 echo move output
 cp $tmpdir/ntuples_dc_*.root $workdir/tuples/rge-sim_tuples_${i}.root
 
@@ -17,19 +17,31 @@
 #include <libgen.h>
 #include <limits.h>
 
+// C++.
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <vector>
+
 // ROOT.
 #include <TFile.h>
 #include <TNtuple.h>
+#include <TROOT.h>
 
 // rge-analysis.
+#include "../lib/rge_bin_store.h"
+#include "../lib/rge_binning.h"
 #include "../lib/rge_constants.h"
 #include "../lib/rge_err_handler.h"
+#include "../lib/rge_file_handler.h"
 #include "../lib/rge_io_handler.h"
 #include "../lib/rge_filename_handler.h"
 #include "../lib/rge_math_utils.h"
+#include "../lib/rge_ntuple.h"
 
 static const char *USAGE_MESSAGE =
-"Usage: acc_corr [-hq:n:z:p:f:g:s:d:FD]\n"
+"Usage: acc_corr [-hq:n:z:p:f:g:s:d:j:o:mFDt] [infile ...]\n"
 " * -h         : show this message and exit.\n"
 " * -q ...     : Q2 bins.\n"
 " * -n ...     : nu bins.\n"
@@ -40,8 +52,21 @@ static const char *USAGE_MESSAGE =
 " * -s simfile : simulated events ROOT file.\n"
 " * -d datadir : location where sampling fraction files are found. Default is\n"
 "                data.\n"
+" * -j nthreads: number of threads used to count events, or to merge files\n"
+"                with -m. The output is the same for any number of threads.\n"
+"                Default is 1.\n"
+" * -o outfile : write the output to outfile instead of datadir. Meant to\n"
+"                write partial files, each from a chunk of the generated and\n"
+"                simulated events, to be merged with -m.\n"
+" * -m         : merge mode. Add up the counts of the files given as infiles\n"
+"                instead of counting events. All files must have the same\n"
+"                binnings and PIDs, and binnings aren't needed.\n"
 " * -D         : flag to tell program that generated events are in degrees\n"
-"                instead of radians.\n\n"
+"                instead of radians.\n"
+" * -t         : write the output in text format, to acc_corr.txt, instead\n"
+"                of the binary acc_corr.bin. draw_plots reads both.\n"
+" * infile     : with -m, acceptance correction files written by acc_corr,\n"
+"                in either format.\n\n"
 "    Get the 5-dimensional acceptance correction factors for Q2, nu, z_h,\n"
 "    Pt2, and phi_PQ. For each optional argument, an array of doubles is\n"
 "    expected. The first double will be the lower limit of the leftmost bin,\n"
@@ -73,101 +98,273 @@ static int BADPIDS[BADPIDS_SIZE] = {
 #define THROWN_W     "W"
 #define THROWN_YB    "y"
 
+/** Variables read from the simulated events file. */
+static const luint SIMUL_VARS =
+        RGE_VARBIT(RGE_PID.addr) | RGE_VARBIT(RGE_W2.addr)  |
+        RGE_VARBIT(RGE_YB.addr)  | RGE_VARBIT(RGE_Q2.addr)  |
+        RGE_VARBIT(RGE_NU.addr)  | RGE_VARBIT(RGE_ZH.addr)  |
+        RGE_VARBIT(RGE_PT2.addr) | RGE_VARBIT(RGE_PHIPQ.addr);
+
 /** Available entry count types. */
 #define THROWN_ELECTRON -2
 #define THROWN_HADRON   -1
-#define SIMUL_HADRON     1
-#define SIMUL_ELECTRON   2
+#define SIMUL            1
 
 /**
-* Return position of value v inside a doubles array b of size s. If v is not
-*     inside b, return -1.
-*/
-static int find_pos(double v, double *b, int size) {
-    for (int i = 0; i < size; ++i) if (b[i] < v && v < b[i+1]) return i;
-    return -1;
-}
+ * Maximum number of PIDs in the thrown file. We assume that we'll deal with at
+ *     most 256 PIDs. Extend this list if that stops being the case.
+ */
+#define MAXPIDS 256
+
+/** Number of entries of a tree counted at a time by each thread. */
+#define ACC_CHUNK_NENTRIES 100000
 
 /**
- * Count number of events in a tree for each bin, for a given pid. The number of
- *     bins is equal to the multiplication of the size-1 of each binning.
+ * Input files of acc_corr.
  *
- * @param file:   file where we'll write the output data.
- * @param tree:   TTree containing the data we're to process.
- * @param pid:    pid of the particle for which we're counting events.
- * @param nbins:  array containing number of bins.
- * @param edges:  2-dimensional array of edges.
- * @param in_deg: boolean telling us if thrown events are in degrees -- default
- *                is radians.
- * @param type:   int describing type of processing to be done.
- *                  * -2: thrown electron.
- *                  * -1: thrown hadron.
- *                  *  1: simulated hadron.
- *                  *  2: simulated electron.
- * @return:       success code (0).
+ * @param thrown_file : generated events file.
+ * @param thrown      : thrown hadrons tree.
+ * @param thrown_el   : thrown electrons tree.
+ * @param simul_file  : simulated events file.
+ * @param simul       : reader of the simulated events tree.
  */
-static int count_entries(
-        FILE *file, TTree *tree, int pid, luint *nbins, double **edges,
-        bool in_deg, int type
+typedef struct {
+    TFile *thrown_file;
+    TNtuple *thrown;
+    TNtuple *thrown_el;
+    TFile *simul_file;
+    rge_ntuplereader simul;
+} acc_input;
+
+/**
+ * Event counters of one thread, or their total over all threads.
+ *
+ * @param thrown_el   : thrown electrons, over Q2 and nu.
+ * @param simul_el    : simulated electrons, over Q2 and nu.
+ * @param thrown      : thrown hadrons by PID, over the 5 binning variables.
+ * @param simul       : simulated hadrons by PID, over the 5 binning
+ *                      variables.
+ * @param first_entry : first entry of the thrown hadrons tree where each PID
+ *                      was found. The list of PIDs is sorted by it, so it
+ *                      doesn't depend on how the tree was split.
+ */
+typedef struct {
+    rge_binstore thrown_el;
+    rge_binstore simul_el;
+    std::map<int, rge_binstore> thrown;
+    std::map<int, rge_binstore> simul;
+    std::map<int, Long64_t> first_entry;
+} acc_counts;
+
+/** Range of entries [first, last) of one of the trees, of a given type. */
+typedef struct {
+    int type;
+    Long64_t first;
+    Long64_t last;
+} acc_task;
+
+/**
+ * State shared between the worker threads. Workers take the next range of
+ *     entries to count from next_task, and stop early if stop is set.
+ */
+typedef struct {
+    const char *thrown_filename;
+    const char *simul_filename;
+    luint *nbins;
+    rge_binning *binnings;
+    bool in_deg;
+    std::vector<acc_task> tasks;
+    std::atomic<luint> next_task;
+    std::atomic<bool> stop;
+} acc_state;
+
+/**
+ * Return the position of an event in the flattened counters of the first nvars
+ *     binning variables, in the order [Q2][nu][z_h][Pt2][phi_PQ]. If a
+ *     variable falls outside of its binning, return -1.
+ */
+static lint find_bin(Float_t *s_bin, luint nvars, rge_binning *binnings) {
+    double values[5];
+    for (luint bi = 0; bi < nvars; ++bi) values[bi] = s_bin[bi];
+    return rge_binning_find_nd(binnings, nvars, values);
+}
+
+/**
+ * Open the generated and simulated events files and load their trees. Each
+ *     worker thread opens its own input.
+ */
+static int open_input(
+        acc_input *in, const char *thrown_filename, const char *simul_filename
 ) {
-    if (
-            type != THROWN_ELECTRON && type != SIMUL_ELECTRON &&
-            type != THROWN_HADRON   && type != SIMUL_HADRON
-    ) {
-        rge_errno = RGEERR_WRONGENTRYTYPE;
+    in->thrown_file = TFile::Open(thrown_filename, "READ");
+    if (!in->thrown_file || in->thrown_file->IsZombie()) {
+        rge_errno = RGEERR_WRONGGENFILE;
+        return 1;
+    }
+    in->thrown    = in->thrown_file->Get<TNtuple>(RGE_TREENAMETHRN);
+    in->thrown_el = in->thrown_file->Get<TNtuple>(RGE_TREENAMETHRNELECTRONS);
+    if (in->thrown == NULL || in->thrown_el == NULL) {
+        rge_errno = RGEERR_BADGENFILE;
         return 1;
     }
 
-    // Store total number of bins for simplicity.
-    luint total_nbins = 1;
-    for (int i = 0; i < 5; ++i) total_nbins *= nbins[i];
+    in->simul_file = TFile::Open(simul_filename, "READ");
+    if (!in->simul_file || in->simul_file->IsZombie()) {
+        rge_errno = RGEERR_WRONGSIMFILE;
+        return 1;
+    }
+    if (rge_ntuplereader_open(&(in->simul), in->simul_file)) {
+        if (rge_errno == RGEERR_BADROOTFILE) rge_errno = RGEERR_BADSIMFILE;
+        return 1;
+    }
+    if (rge_ntuple_check(in->simul.tree, SIMUL_VARS)) return 1;
+
+    return 0;
+}
+
+/** Close the files opened by open_input(). */
+static int close_input(acc_input *in) {
+    in->thrown_file->Close();
+    in->simul_file->Close();
+    delete in->thrown_file;
+    delete in->simul_file;
+    rge_ntuplereader_free(&(in->simul));
+    return 0;
+}
 
-    // Create and initialize evn_cnt.
-    // NOTE. Variable-length arrays (vla) are technically not permitted in C++
-    //       (-Werror=vla from -pedantic), but *we know* that the array won't be
-    //       rambunctiously large, and I'd rather have my memory contiguous than
-    //       keeping a 5D array of non-contiguous pointers or -- even worse --
-    //       C++ vectors.
-    //          -Bruno
-    int evn_cnt[nbins[0]][nbins[1]][nbins[2]][nbins[3]][nbins[4]];
-    int *iterator = &evn_cnt[0][0][0][0][0]; // Auxiliary iterator for evn_cnt.
+/** Initialize empty electron counters. Hadron counters are added by PID. */
+static int init_counts(acc_counts *cnt, luint *nbins) {
+    rge_binstore_init(&(cnt->thrown_el), 2, nbins);
+    rge_binstore_init(&(cnt->simul_el),  2, nbins);
+    return 0;
+}
 
-    // Set everything in evn_cnt to 0.
-    for (luint bin_i = 0; bin_i < total_nbins; ++bin_i) {
-        *iterator = 0;
-        ++iterator;
+/** Free all counters. */
+static int free_counts(acc_counts *cnt) {
+    rge_binstore_free(&(cnt->thrown_el));
+    rge_binstore_free(&(cnt->simul_el));
+    for (std::pair<const int, rge_binstore> &pc : cnt->thrown) {
+        rge_binstore_free(&(pc.second));
+    }
+    for (std::pair<const int, rge_binstore> &pc : cnt->simul) {
+        rge_binstore_free(&(pc.second));
     }
+    cnt->thrown.clear();
+    cnt->simul.clear();
+    cnt->first_entry.clear();
+    return 0;
+}
 
-    // Get PID.
-    Float_t s_pid;
-    if (type == THROWN_ELECTRON || type == SIMUL_ELECTRON) {
-        s_pid = 11;
+/**
+ * Add the counters of src to dst. Counters of PIDs that dst doesn't have are
+ *     moved instead of copied, and src is left empty.
+ */
+static int merge_counts(acc_counts *dst, acc_counts *src) {
+    rge_binstore_merge(&(dst->thrown_el), &(src->thrown_el));
+    rge_binstore_merge(&(dst->simul_el),  &(src->simul_el));
+
+    std::map<int, rge_binstore> *maps[2][2] = {
+            {&(dst->thrown), &(src->thrown)}, {&(dst->simul), &(src->simul)}
+    };
+    for (int map_i = 0; map_i < 2; ++map_i) {
+        for (std::pair<const int, rge_binstore> &pc : *maps[map_i][1]) {
+            std::map<int, rge_binstore>::iterator it =
+                    maps[map_i][0]->find(pc.first);
+            if (it == maps[map_i][0]->end()) {
+                maps[map_i][0]->emplace(pc.first, pc.second);
+                continue;
+            }
+            rge_binstore_merge(&(it->second), &(pc.second));
+            rge_binstore_free(&(pc.second));
+        }
+        maps[map_i][1]->clear();
     }
-    else {
-        tree->SetBranchAddress(RGE_PID.name, &s_pid);
+
+    for (const std::pair<const int, Long64_t> &pe : src->first_entry) {
+        std::map<int, Long64_t>::iterator it = dst->first_entry.find(pe.first);
+        if (it == dst->first_entry.end()) dst->first_entry.emplace(pe);
+        else if (pe.second < it->second)  it->second = pe.second;
     }
+    src->first_entry.clear();
 
-    // Get W2.
-    Float_t s_W, s_W2;
-    if (type == THROWN_ELECTRON || type == THROWN_HADRON) {
-        tree->SetBranchAddress(THROWN_W, &s_W);
+    return 0;
+}
+
+/** Return the hadron counter of pid in counters, creating it if needed. */
+static rge_binstore *get_store(
+        std::map<int, rge_binstore> *counters, int pid, luint *nbins
+) {
+    std::map<int, rge_binstore>::iterator it = counters->find(pid);
+    if (it != counters->end()) return &(it->second);
+
+    rge_binstore *store = &((*counters)[pid]);
+    rge_binstore_init(store, 5, nbins);
+    return store;
+}
+
+/** Return true if pid is in BADPIDS. */
+static bool is_bad_pid(int pid) {
+    for (int pid_i = 0; pid_i < BADPIDS_SIZE; ++pid_i) {
+        if (BADPIDS[pid_i] == pid) return true;
     }
-    else {
-        tree->SetBranchAddress(RGE_W2.name, &s_W2);
+    return false;
+}
+
+/**
+ * Count number of events in a range of entries of a tree for each bin and PID.
+ *     The number of bins is equal to the multiplication of the size-1 of each
+ *     binning.
+ *
+ * @param in:       input files, opened by the calling thread.
+ * @param type:     int describing type of processing to be done.
+ *                    * -2: thrown electron.
+ *                    * -1: thrown hadron.
+ *                    *  1: simulated electron and hadrons.
+ * @param first:    first entry to count.
+ * @param last:     entry after the last one to count.
+ * @param nbins:    array containing number of bins.
+ * @param binnings: array of binnings.
+ * @param in_deg:   boolean telling us if thrown events are in degrees --
+ *                  default is radians.
+ * @param cnt:      counters of the calling thread. Hadron counters are
+ *                  created for each PID found. Thrown hadrons with PIDs not
+ *                  useful for SIDIS analysis are skipped, and simulated
+ *                  particles are counted for every other PID, since the
+ *                  final list of PIDs is only known after all thrown hadrons
+ *                  are counted.
+ * @return:         error code. 0 if successful, 1 otherwise.
+ */
+static int count_entries(
+        acc_input *in, int type, Long64_t first, Long64_t last, luint *nbins,
+        rge_binning *binnings, bool in_deg, acc_counts *cnt
+) {
+    if (type != THROWN_ELECTRON && type != THROWN_HADRON && type != SIMUL) {
+        rge_errno = RGEERR_WRONGENTRYTYPE;
+        return 1;
+    }
+    bool is_thrown = type == THROWN_ELECTRON || type == THROWN_HADRON;
+    TTree *tree = type == THROWN_ELECTRON ? in->thrown_el : in->thrown;
+
+    // Get PID. Thrown ntuples store it as a float, while make_ntuples stores
+    //     it as an int.
+    Int_t s_pid          = 11;
+    Float_t s_thrown_pid = 11;
+    if (type == THROWN_HADRON) {
+        tree->SetBranchAddress(RGE_PID.name, &s_thrown_pid);
     }
 
+    // Get W2.
+    Float_t s_W, s_W2;
+    if (is_thrown) tree->SetBranchAddress(THROWN_W, &s_W);
+
     // Get Yb.
     Float_t s_Yb;
-    if (type == THROWN_ELECTRON || type == THROWN_HADRON) {
-        tree->SetBranchAddress(THROWN_YB, &s_Yb);
-    }
-    else {
-        tree->SetBranchAddress(RGE_YB.name, &s_Yb);
-    }
+    if (is_thrown) tree->SetBranchAddress(THROWN_YB, &s_Yb);
 
-    // Get binning variables: Q2, nu, zh, Pt2, phiPQ.
+    // Get binning variables: Q2, nu, zh, Pt2, phiPQ. Simulated variables are
+    //     copied from the rge_ntuplereader for each particle.
     Float_t s_bin[5] = {0, 0, 0, 0, 0};
-    if (type == THROWN_ELECTRON || type == THROWN_HADRON) {
+    if (is_thrown) {
         tree->SetBranchAddress(THROWN_Q2, &(s_bin[0]));
         tree->SetBranchAddress(THROWN_NU, &(s_bin[1]));
     }
@@ -176,221 +373,386 @@ static int count_entries(
         tree->SetBranchAddress(THROWN_PT2,   &(s_bin[3]));
         tree->SetBranchAddress(THROWN_PHIPQ, &(s_bin[4]));
     }
-    if (type == SIMUL_ELECTRON || type == SIMUL_HADRON) {
-        tree->SetBranchAddress(RGE_Q2.name, &(s_bin[0]));
-        tree->SetBranchAddress(RGE_NU.name, &(s_bin[1]));
-    }
-    if (type == SIMUL_HADRON) {
-        tree->SetBranchAddress(RGE_ZH.name,    &(s_bin[2]));
-        tree->SetBranchAddress(RGE_PT2.name,   &(s_bin[3]));
-        tree->SetBranchAddress(RGE_PHIPQ.name, &(s_bin[4]));
-    }
 
-    for (int evn = 0; evn < tree->GetEntries(); ++evn) {
-        tree->GetEntry(evn);
+    rge_ntuplereader *simul = &(in->simul);
+    for (Long64_t entry = first; entry < last; ++entry) {
+        // Thrown entries have one particle each, simulated entries have one
+        //     or many depending on the layout written by make_ntuples.
+        luint npart = 1;
+        if (is_thrown) tree->GetEntry(entry);
+        else           npart = rge_ntuplereader_get_entry(simul, entry);
+
+        for (luint part_i = 0; part_i < npart; ++part_i) {
+            if (!is_thrown) {
+                rge_ntuplereader_get_particle(simul, part_i);
+                const rge_varval *vars = simul->vals;
+                s_pid    = vars[RGE_PID.addr].i;
+                s_W2     = vars[RGE_W2.addr].f;
+                s_Yb     = vars[RGE_YB.addr].f;
+                s_bin[0] = vars[RGE_Q2.addr].f;
+                s_bin[1] = vars[RGE_NU.addr].f;
+                s_bin[2] = vars[RGE_ZH.addr].f;
+                s_bin[3] = vars[RGE_PT2.addr].f;
+                s_bin[4] = vars[RGE_PHIPQ.addr].f;
+            }
 
-        // Only count the selected PID.
-        if (pid - 0.5 >= s_pid || s_pid > pid + 0.5) continue;
+            // Get the hadron counter of the PID. Electrons are counted from
+            //     their own tree, and PIDs not useful for SIDIS analysis are
+            //     skipped. The first entry of each thrown PID is kept to sort
+            //     the list of PIDs.
+            rge_binstore *hadron_cnt = NULL;
+            if (type == THROWN_HADRON) {
+                s_pid = static_cast<Int_t>(lround(s_thrown_pid));
+                if (s_pid == 11 || is_bad_pid(s_pid)) continue;
+
+                hadron_cnt = get_store(&(cnt->thrown), s_pid, nbins);
+                std::map<int, Long64_t>::iterator it =
+                        cnt->first_entry.find(s_pid);
+                if (it == cnt->first_entry.end()) {
+                    cnt->first_entry.emplace(s_pid, entry);
+                }
+                else if (entry < it->second) {
+                    it->second = entry;
+                }
+            }
 
-        // Apply Q2 cut.
-        if (s_bin[0] < RGE_Q2CUT) continue; // Q2 > 1.
+            // Apply Q2 cut.
+            if (s_bin[0] < RGE_Q2CUT) continue; // Q2 > 1.
+
+            // Apply W2 cut.
+            if (is_thrown) s_W2 = s_W * s_W;
+            if (s_W2 < RGE_W2CUT) continue; // W2 > 4.
+
+            // Apply Yb cut.
+            if (s_Yb > RGE_YBCUT) continue; // Yb < 0.85.
+
+            // Remove kinematic variables == 0.
+            if (s_bin[1] == 0) continue;
+
+            // Every simulated particle carries the kinematics of its trigger
+            //     electron, so all of them are counted as electrons.
+            lint bin = -1;
+            if (type == THROWN_ELECTRON || type == SIMUL) {
+                // Electrons can only use 2 kinematic variables.
+                bin = find_bin(s_bin, 2, binnings);
+                if (bin >= 0) {
+                    rge_binstore_add(
+                            is_thrown ? &(cnt->thrown_el) : &(cnt->simul_el),
+                            static_cast<luint>(bin), 1
+                    );
+                }
+            }
+            if (type == THROWN_ELECTRON) continue;
+            if (type == SIMUL && (s_pid == 11 || is_bad_pid(s_pid))) continue;
+
+            // Hadrons use 5 kinematic variables.
+            if (s_bin[2] == 0 || s_bin[3] == 0 || s_bin[4] == 0) continue;
+
+            // Convert phiPQ to radians if necessary.
+            if (is_thrown && in_deg) {
+                // s_bin[4] is Float_t, so we need this conversion step.
+                double tmp;
+                if (rge_to_rad(s_bin[4], &tmp)) return 1;
+                s_bin[4] = tmp;
+            }
 
-        // Apply W2 cut.
-        if (type == THROWN_ELECTRON || type == THROWN_HADRON) {
-            s_W2 = s_W * s_W;
-        }
-        if (s_W2 < RGE_W2CUT) continue; // W2 > 4.
-
-        // Apply Yb cut.
-        if (s_Yb > RGE_YBCUT) continue; // Yb < 0.85.
-
-        // Remove kinematic variables == 0.
-        if (s_bin[1] == 0) continue;
-        if (
-                (type == THROWN_HADRON || type == SIMUL_HADRON) &&
-                (s_bin[2] == 0 || s_bin[3] == 0 || s_bin[4] == 0)
-        ) {
-            continue;
+            // Increase counter.
+            bin = find_bin(s_bin, 5, binnings);
+            if (bin < 0) continue;
+            if (type == SIMUL) {
+                hadron_cnt = get_store(&(cnt->simul), s_pid, nbins);
+            }
+            rge_binstore_add(hadron_cnt, static_cast<luint>(bin), 1);
         }
+    }
 
-        // Convert phiPQ to radians if necessary.
-        if (in_deg) {
-            double tmp; // s_bin[4] is Float_t, so we need this conversion step.
-            if (rge_to_rad(s_bin[4], &tmp)) return 1;
-            s_bin[4] = tmp;
-        }
+    return 0;
+}
 
-        // Find position of event.
-        int idx[5] = {0, 0, 0, 0, 0};
-        bool kill = false; // If kill is true, var falls outside of bin range.
-        // Hadrons use 5 kinematic variables, electrons can only use 2.
-        int nvars = (type == THROWN_HADRON || type == SIMUL_HADRON) ? 5 : 2;
-        for (int bi = 0; bi < nvars && !kill; ++bi) {
-            idx[bi] = find_pos(s_bin[bi], edges[bi], nbins[bi]);
-            if (idx[bi] < 0) kill = true;
+/**
+ * Worker thread of acc_corr. Open the input files, and count the next range
+ *     of entries in st->tasks until there are none left or a thread fails.
+ *
+ * @param st  : state shared between workers.
+ * @param cnt : counters of this thread, already initialized.
+ * @param err : error code of this thread, RGEERR_NOERR if successful.
+ */
+static void acc_worker(acc_state *st, acc_counts *cnt, uint *err) {
+    *err = RGEERR_NOERR;
+    acc_input in;
+    if (open_input(&in, st->thrown_filename, st->simul_filename)) {
+        *err     = rge_errno;
+        st->stop = true;
+        return;
+    }
+
+    while (!st->stop) {
+        luint task_i = st->next_task++;
+        if (task_i >= st->tasks.size()) break;
+
+        const acc_task *task = &(st->tasks[task_i]);
+        if (count_entries(
+                &in, task->type, task->first, task->last, st->nbins,
+                st->binnings, st->in_deg, cnt
+        )) {
+            *err     = rge_errno;
+            st->stop = true;
+            break;
         }
-        if (kill) continue;
-
-        // Increase counter.
-        ++evn_cnt[idx[0]][idx[1]][idx[2]][idx[3]][idx[4]];
     }
 
-    // Write evn_cnt to file.
-    iterator = &evn_cnt[0][0][0][0][0];
-    for (luint bin_i = 0; bin_i < total_nbins; ++bin_i) {
-        fprintf(file, "%d ", *iterator);
-        ++iterator;
-    }
-    fprintf(file, "\n");
-
-    return 0;
+    close_input(&in);
 }
 
 /** run() function of the program. Check USAGE_MESSAGE for details. */
 static int run(
-        char *thrown_filename, char *simul_filename, char *data_dir,
-        luint *nedges, double **edges, bool in_deg
+        char *thrown_filename, char *simul_filename, char *out_filename,
+        luint *nedges, double **edges, bool in_deg, lint nthreads, bool text
 ) {
-    // Open input files and load TTrees.
-    printf("\nOpening generated events file...\n");
-    TFile *thrown_file = TFile::Open(thrown_filename, "READ");
-    if (!thrown_file || thrown_file->IsZombie()) {
-        rge_errno = RGEERR_WRONGGENFILE;
-        return 1;
-    }
-    TNtuple *thrown    = thrown_file->Get<TNtuple>(RGE_TREENAMETHRN);
-    TNtuple *thrown_el = thrown_file->Get<TNtuple>(RGE_TREENAMETHRNELECTRONS);
-    if (thrown == NULL || thrown_el == NULL) {
-        rge_errno = RGEERR_BADGENFILE;
+    // Check input files and get the number of entries of each tree.
+    printf("\nOpening generated and simulated events files...\n");
+    acc_input in;
+    if (open_input(&in, thrown_filename, simul_filename)) return 1;
+    Long64_t nentries[3] = {
+            in.thrown_el->GetEntries(), in.thrown->GetEntries(),
+            in.simul.tree->GetEntries()
+    };
+    close_input(&in);
+
+    // Check that the output file doesn't exist before counting.
+    if (!access(out_filename, F_OK)) {
+        rge_errno = RGEERR_OUTFILEEXISTS;
         return 1;
     }
 
-    printf("Opening simulated events file...\n");
-    TFile *simul_file = TFile::Open(simul_filename, "READ");
-    if (!simul_file || simul_file->IsZombie()) {
-        rge_errno = RGEERR_WRONGSIMFILE;
-        return 1;
+    // Get number of bins and binnings.
+    luint nbins[5];
+    rge_binning binnings[5];
+    for (int bin_dim_i = 0; bin_dim_i < 5; ++bin_dim_i) {
+        nbins[bin_dim_i] = static_cast<luint>(nedges[bin_dim_i]-1);
+        rge_binning_init(
+                &binnings[bin_dim_i], nedges[bin_dim_i], edges[bin_dim_i]
+        );
+    }
+
+    // Split the three trees in ranges of entries. Ranges of different trees
+    //     are interleaved so that the thrown and simulated trees are read at
+    //     the same time.
+    acc_state st;
+    st.thrown_filename = thrown_filename;
+    st.simul_filename  = simul_filename;
+    st.nbins           = nbins;
+    st.binnings        = binnings;
+    st.in_deg          = in_deg;
+    st.next_task       = 0;
+    st.stop            = false;
+
+    int types[3] = {THROWN_ELECTRON, THROWN_HADRON, SIMUL};
+    for (Long64_t first = 0; ; first += ACC_CHUNK_NENTRIES) {
+        bool found = false;
+        for (int tree_i = 0; tree_i < 3; ++tree_i) {
+            if (first >= nentries[tree_i]) continue;
+            Long64_t last =
+                    std::min(first + ACC_CHUNK_NENTRIES, nentries[tree_i]);
+            st.tasks.push_back({types[tree_i], first, last});
+            found = true;
+        }
+        if (!found) break;
+    }
+
+    // Count thrown and simulated events in each bin, for every PID at once.
+    //     Each thread keeps its own counters, and they're added together
+    //     after all threads finish.
+    printf(
+            "Counting %lld thrown electrons, %lld thrown hadrons, and %lld "
+            "simulated entries with %ld threads...\n",
+            static_cast<long long>(nentries[0]),
+            static_cast<long long>(nentries[1]),
+            static_cast<long long>(nentries[2]), nthreads
+    );
+    std::vector<acc_counts> cnts(static_cast<luint>(nthreads));
+    std::vector<uint> errs(static_cast<luint>(nthreads), RGEERR_NOERR);
+    for (acc_counts &cnt : cnts) init_counts(&cnt, nbins);
+
+    if (nthreads == 1) {
+        acc_worker(&st, &cnts[0], &errs[0]);
     }
-    TTree *simul = simul_file->Get<TTree>(RGE_TREENAMEDATA);
-    if (simul == NULL) {
-        rge_errno = RGEERR_BADSIMFILE;
-        return 1;
+    else {
+        ROOT::EnableThreadSafety();
+        std::vector<std::thread> workers;
+        for (luint t = 0; t < static_cast<luint>(nthreads); ++t) {
+            workers.emplace_back(acc_worker, &st, &cnts[t], &errs[t]);
+        }
+        for (std::thread &worker : workers) worker.join();
     }
 
-    // Create output file.
-    char out_filename[PATH_MAX];
-    sprintf(out_filename, "%s/acc_corr.txt", data_dir);
-    if (!access(out_filename, F_OK)) {
-        rge_errno = RGEERR_OUTFILEEXISTS;
-        return 1;
+    for (uint err : errs) {
+        if (err != RGEERR_NOERR) {
+            rge_errno = err;
+            return 1;
+        }
     }
-    FILE *out_file = fopen(out_filename, "w");
-
-    // Write binning nedges to output file.
-    for (int bi = 0; bi < 5; ++bi) fprintf(out_file, "%lu ", nedges[bi]);
-    fprintf(out_file, "\n");
+    for (luint t = 1; t < cnts.size(); ++t) {
+        merge_counts(&cnts[0], &cnts[t]);
+        free_counts(&cnts[t]);
+    }
+    acc_counts *total = &cnts[0];
 
-    // Write edges to output file.
-    for (int bi = 0; bi < 5; ++bi) {
-        for (luint bii = 0; bii < nedges[bi]; ++bii) {
-            fprintf(out_file, "%12.9f ", edges[bi][bii]);
-        }
-        fprintf(out_file, "\n");
+    // Build the list of PIDs. The electron is always first, and hadrons
+    //     follow in the order in which they appear in the thrown tree.
+    std::vector<std::pair<Long64_t, int>> hadrons;
+    for (const std::pair<const int, Long64_t> &pe : total->first_entry) {
+        hadrons.push_back({pe.second, pe.first});
     }
+    std::sort(hadrons.begin(), hadrons.end());
+    if (hadrons.size() > MAXPIDS - 1) hadrons.resize(MAXPIDS - 1);
 
-    // Get list of PIDs.
-    // We assume that we'll deal with at most 256 PIDs. Extend this list if that
-    //     stops being the case.
-    printf("Getting list of PIDs from generated file...\n");
-    Float_t s_pid;
-    double pidlist[256];
+    int pidlist[MAXPIDS];
     int pidlist_size = 0;
-    thrown->SetBranchAddress(RGE_PID.name, &s_pid);
+    rge_binstore thrown_cnt[MAXPIDS];
+    rge_binstore simul_cnt[MAXPIDS];
+    pidlist[pidlist_size] = 11;
+    thrown_cnt[pidlist_size] = total->thrown_el;
+    simul_cnt[pidlist_size]  = total->simul_el;
+    ++pidlist_size;
+    for (const std::pair<Long64_t, int> &hadron : hadrons) {
+        pidlist[pidlist_size] = hadron.second;
+        thrown_cnt[pidlist_size] = total->thrown[hadron.second];
+        simul_cnt[pidlist_size]  =
+                *get_store(&(total->simul), hadron.second, nbins);
+        ++pidlist_size;
+    }
+
+    // Write output file.
+    printf("Writing %s for %d PIDs...\n", out_filename, pidlist_size);
+    if (rge_write_acc_corr_file(
+            out_filename, nedges, edges, static_cast<luint>(pidlist_size),
+            pidlist, thrown_cnt, simul_cnt, text
+    )) return 1;
+
+    free_counts(total);
+    for (int bi = 0; bi < 5; ++bi) rge_binning_free(&binnings[bi]);
+    printf("Done!\n");
 
-    // Add electron to PID list.
-    pidlist[pidlist_size++] = 11;
+    // Clean up after ourselves.
+    for (int bi = 0; bi < 5; ++bi) free(edges[bi]);
+    free(edges);
 
-    for (int evn = 0; evn < thrown->GetEntries(); ++evn) {
-        thrown->GetEntry(evn);
-        bool skip = false;
+    rge_errno = RGEERR_NOERR;
+    return 0;
+}
 
-        // Check that PID is useful for SIDIS analysis.
-        for (int pid_i = 0; pid_i < BADPIDS_SIZE; ++pid_i) {
-            if (BADPIDS[pid_i] - .5 <= s_pid && s_pid <= BADPIDS[pid_i] + .5) {
-                skip = true;
-                break;
-            }
-        }
-        if (skip) continue;
+/**
+ * Read the acceptance correction files from first to last-1 and add up their
+ *     counts in acc.
+ *
+ * @param in_filenames : acceptance correction files.
+ * @param first        : first file to read.
+ * @param last         : file after the last one to read.
+ * @param acc          : acceptance correction data where counts are added.
+ *                       It holds the data of the first file.
+ * @param err          : error code of this thread, RGEERR_NOERR if
+ *                       successful.
+ */
+static void merge_range(
+        char **in_filenames, int first, int last, rge_accdata *acc, uint *err
+) {
+    *err = RGEERR_NOERR;
+    if (rge_read_acc_corr_file(in_filenames[first], acc)) {
+        *err = rge_errno;
+        return;
+    }
 
-        // Check if we have already found this PID.
-        for (int pid_i = 0; pid_i < pidlist_size; ++pid_i) {
-            if (pidlist[pid_i] - .5 <= s_pid && s_pid <= pidlist[pid_i] + .5) {
-                skip = true;
-                break;
-            }
+    for (int file_i = first + 1; file_i < last; ++file_i) {
+        rge_accdata in;
+        if (rge_read_acc_corr_file(in_filenames[file_i], &in)) {
+            *err = rge_errno;
+            return;
+        }
+        int merge_err = rge_merge_acc_data(acc, &in);
+        rge_acc_corr_free(&in);
+        if (merge_err) {
+            *err = rge_errno;
+            return;
         }
-        if (skip) continue;
-
-        // Add PID to list.
-        pidlist[pidlist_size++] = s_pid;
     }
+}
 
-    // Write list of PIDs to output file.
-    fprintf(out_file, "%d\n", pidlist_size);
-    for (int pid_i = 0; pid_i < pidlist_size; ++pid_i) {
-        fprintf(out_file, "%d ", static_cast<int>(pidlist[pid_i]));
+/** Add the counts of src to dst and free src. */
+static void merge_pair(rge_accdata *dst, rge_accdata *src, uint *err) {
+    *err = RGEERR_NOERR;
+    if (rge_merge_acc_data(dst, src)) *err = rge_errno;
+    rge_acc_corr_free(src);
+}
+
+/** Return 1 and set rge_errno if any thread failed. */
+static int check_errs(std::vector<uint> *errs) {
+    for (uint err : *errs) {
+        if (err != RGEERR_NOERR) {
+            rge_errno = err;
+            return 1;
+        }
     }
-    fprintf(out_file, "\n");
+    return 0;
+}
 
-    // Get number of bins.
-    luint nbins[5];
-    for (int bin_dim_i = 0; bin_dim_i < 5; ++bin_dim_i) {
-        nbins[bin_dim_i] = static_cast<luint>(nedges[bin_dim_i]-1);
+/**
+ * run() function of the program in merge mode (-m). Add up the counts of
+ *     acceptance correction files by tree reduction. Each thread adds up a
+ *     range of files, and then the sums of each thread are added in pairs,
+ *     halving their number in each round.
+ */
+static int merge(
+        char **in_filenames, int n_in, char *out_filename, lint nthreads,
+        bool text
+) {
+    if (!access(out_filename, F_OK)) {
+        rge_errno = RGEERR_OUTFILEEXISTS;
+        return 1;
     }
 
-    // Count and write number of thrown and simulated events in each bin.
-    for (int pid_i = 0; pid_i < pidlist_size; ++pid_i) {
-        int pid = static_cast<int>(pidlist[pid_i]);
-        printf("Working on PID %5d (%2d/%2d)...\n", pid, pid_i+1, pidlist_size);
+    luint nparts = std::min(
+            static_cast<luint>(nthreads), static_cast<luint>(n_in)
+    );
+    std::vector<rge_accdata> parts(nparts);
+    std::vector<uint> errs(nparts, RGEERR_NOERR);
 
-        printf("  Counting thrown events...\n");
-        int err = 0;
-        if (pid_i == 0) { // electron.
-            err = count_entries(
-                    out_file, thrown_el, pid, nbins, edges, in_deg,
-                    THROWN_ELECTRON
-            );
-        }
-        else {
-            err = count_entries(
-                    out_file, thrown, pid, nbins, edges, in_deg, THROWN_HADRON
+    printf("\nAdding up %d files with %lu threads...\n", n_in, nparts);
+    if (nparts == 1) {
+        merge_range(in_filenames, 0, n_in, &parts[0], &errs[0]);
+    }
+    else {
+        luint nfiles = static_cast<luint>(n_in);
+        std::vector<std::thread> workers;
+        for (luint part_i = 0; part_i < nparts; ++part_i) {
+            int first = static_cast<int>(part_i       * nfiles / nparts);
+            int last  = static_cast<int>((part_i + 1) * nfiles / nparts);
+            workers.emplace_back(
+                    merge_range, in_filenames, first, last, &parts[part_i],
+                    &errs[part_i]
             );
         }
-        if (err != 0) return 1;
+        for (std::thread &worker : workers) worker.join();
+    }
+    if (check_errs(&errs)) return 1;
 
-        printf("  Counting simulated events...\n");
-        if (pid_i == 0) {
-            err = count_entries(
-                    out_file, simul, pid, nbins, edges, false, SIMUL_ELECTRON
+    for (luint stride = 1; stride < nparts; stride *= 2) {
+        std::vector<std::thread> workers;
+        for (luint part_i = 0; part_i + stride < nparts; part_i += 2*stride) {
+            workers.emplace_back(
+                    merge_pair, &parts[part_i], &parts[part_i + stride],
+                    &errs[part_i]
             );
         }
-        else {
-            err = count_entries(
-                    out_file, simul, pid, nbins, edges, false, SIMUL_HADRON
-            );
-        }
-        if (err != 0) return 1;
-
-        printf("  Done!\n");
+        for (std::thread &worker : workers) worker.join();
+        if (check_errs(&errs)) return 1;
     }
 
-    // Clean up after ourselves.
-    thrown_file->Close();
-    simul_file->Close();
-    fclose(out_file);
-    for (int bi = 0; bi < 5; ++bi) free(edges[bi]);
-    free(edges);
+    // Write output file.
+    printf("Writing %s for %lu PIDs...\n", out_filename, parts[0].npids);
+    if (rge_write_acc_data(out_filename, &parts[0], text)) return 1;
+    rge_acc_corr_free(&parts[0]);
+    printf("Done!\n");
 
     rge_errno = RGEERR_NOERR;
     return 0;
@@ -399,11 +761,13 @@ static int run(
 /** Handle arguments for make_ntuples using optarg. */
 static int handle_args(
         int argc, char **argv, char **thrown_filename, char **simul_filename,
-        char **data_dir, luint *nedges, double **edges, bool *in_deg
+        char **data_dir, luint *nedges, double **edges, bool *in_deg,
+        lint *nthreads, bool *text, char **out_filename, bool *merge_mode,
+        char ***in_filenames, int *n_in
 ) {
     // Handle arguments.
     int opt;
-    while ((opt = getopt(argc, argv, "hq:n:z:p:f:g:s:d:D")) != -1) {
+    while ((opt = getopt(argc, argv, "-hq:n:z:p:f:g:s:d:j:o:mDt")) != -1) {
         switch (opt) {
         case 'h':
             rge_errno = RGEERR_USAGE;
@@ -433,14 +797,65 @@ static int handle_args(
             *data_dir = static_cast<char *>(malloc(strlen(optarg) + 1));
             strcpy(*data_dir, optarg);
             break;
+        case 'j':
+            if (rge_process_nthreads(nthreads, optarg)) return 1;
+            break;
+        case 'o':
+            *out_filename = static_cast<char *>(malloc(strlen(optarg) + 1));
+            strcpy(*out_filename, optarg);
+            break;
+        case 'm':
+            *merge_mode = true;
+            break;
         case 'D':
             *in_deg = true;
             break;
+        case 't':
+            *text = true;
+            break;
+        case 1:
+            *in_filenames = static_cast<char **>(realloc(
+                    *in_filenames,
+                    static_cast<luint>(*n_in + 1) * sizeof(**in_filenames)
+            ));
+            (*in_filenames)[*n_in] =
+                    static_cast<char *>(malloc(strlen(optarg) + 1));
+            strcpy((*in_filenames)[*n_in], optarg);
+            ++(*n_in);
+            break;
         default:
             break;
         }
     }
 
+    // Define datadir if undefined.
+    if (*data_dir == NULL) {
+        *data_dir = static_cast<char *>(malloc(PATH_MAX));
+        sprintf(*data_dir, "%s/../data", dirname(argv[0]));
+    }
+
+    // Define output file if undefined.
+    if (*out_filename == NULL) {
+        *out_filename = static_cast<char *>(malloc(PATH_MAX));
+        sprintf(
+                *out_filename, "%s/acc_corr.%s", *data_dir,
+                *text ? "txt" : "bin"
+        );
+    }
+
+    // In merge mode, binnings are read from the input files.
+    if (*merge_mode) {
+        if (*n_in == 0) {
+            rge_errno = RGEERR_NOINPUTFILE;
+            return 1;
+        }
+        return 0;
+    }
+    if (*n_in > 0) {
+        rge_errno = RGEERR_BADOPTARGS;
+        return 1;
+    }
+
     // Check that all arrays were defined.
     for (int bi = 0; bi < 5; ++bi) {
         if (nedges[bi] == 0) {
@@ -464,12 +879,6 @@ static int handle_args(
         edges[4][bbi] = tmp;
     }
 
-    // Define datadir if undefined.
-    if (*data_dir == NULL) {
-        *data_dir = static_cast<char *>(malloc(PATH_MAX));
-        sprintf(*data_dir, "%s/../data", dirname(argv[0]));
-    }
-
     // Check genfile.
     if (*thrown_filename == NULL) {
         rge_errno = RGEERR_NOGENFILE;
@@ -494,24 +903,43 @@ int main(int argc, char **argv) {
     char *simul_filename  = NULL;
     char *data_dir        = NULL;
     bool in_deg           = false;
+    lint nthreads         = 1;
+    bool text             = false;
+    char *out_filename    = NULL;
+    bool merge_mode       = false;
+    char **in_filenames   = NULL;
+    int n_in              = 0;
     luint nedges[5] = {0, 0, 0, 0, 0};
     double **edges;
 
     edges = static_cast<double **>(malloc(5 * sizeof(*edges)));
     int err = handle_args(
             argc, argv, &thrown_filename, &simul_filename, &data_dir, nedges,
-            edges, &in_deg
+            edges, &in_deg, &nthreads, &text, &out_filename, &merge_mode,
+            &in_filenames, &n_in
     );
 
     // Run.
     if (rge_errno == RGEERR_UNDEFINED && err == 0) {
-        run(thrown_filename, simul_filename, data_dir, nedges, edges, in_deg);
+        if (merge_mode) {
+            merge(in_filenames, n_in, out_filename, nthreads, text);
+            free(edges);
+        }
+        else {
+            run(
+                    thrown_filename, simul_filename, out_filename, nedges,
+                    edges, in_deg, nthreads, text
+            );
+        }
     }
 
     // Free up memory.
     if (thrown_filename != NULL) free(thrown_filename);
     if (simul_filename  != NULL) free(simul_filename);
     if (data_dir        != NULL) free(data_dir);
+    if (out_filename    != NULL) free(out_filename);
+    for (int file_i = 0; file_i < n_in; ++file_i) free(in_filenames[file_i]);
+    if (in_filenames    != NULL) free(in_filenames);
 
     // Return errcode.
     return rge_print_usage(USAGE_MESSAGE);
@@ -0,0 +1,274 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022-2023 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+// details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+// C++.
+#include <chrono>
+#include <map>
+#include <vector>
+
+// rge-analysis.
+#include "../lib/rge_err_handler.h"
+#include "../lib/rge_event_loader.h"
+#include "../lib/rge_hipo_bank.h"
+#include "../lib/rge_io_handler.h"
+
+static const char *USAGE_MESSAGE =
+"Usage: bench_banks [-hn:] infile\n"
+" * -h         : show this message and exit.\n"
+" * -n nevents : number of events. Default is all.\n"
+" * infile     : input ROOT file written by hipo2root, or HIPO file.\n\n"
+"    Time the access to every column of the REC::Particle, REC::Track, and\n"
+"    REC::Calorimeter banks, as done by make_ntuples. Columns are read once\n"
+"    through rge_get_double() by column index, and once through a copy of\n"
+"    the accessor used before columns were indexed by enums: every column is\n"
+"    converted to a std::vector<double> when the event is loaded, and read\n"
+"    with std::map::at() and std::vector::at() inside a try block. Loading\n"
+"    the events is timed separately.\n";
+
+/** Number of banks read. */
+#define NBANKS 3
+
+/**
+ * Bank in the layout used before columns were indexed by enums: a map from
+ *     column name to a vector with the column converted to doubles.
+ */
+typedef std::map<const char *, std::vector<double> *, cmp_str> bench_oldbank;
+
+/** Create the columns of old for the columns of b. */
+static int oldbank_init(bench_oldbank *old, rge_hipobank *b) {
+    for (uint col = 0; col < b->ncols; ++col) {
+        (*old)[b->entries[col].name] = new std::vector<double>();
+    }
+    return 0;
+}
+
+/** Free the columns of old. */
+static int oldbank_free(bench_oldbank *old) {
+    for (std::pair<const char *const, std::vector<double> *> &e : *old) {
+        delete e.second;
+    }
+    old->clear();
+    return 0;
+}
+
+/**
+ * Copy the event loaded in b to old, resizing each column and converting every
+ *     entry to double, as the old rge_fill() did.
+ */
+static int oldbank_fill(bench_oldbank *old, rge_hipobank *b) {
+    for (uint col = 0; col < b->ncols; ++col) {
+        std::vector<double> *data = old->at(b->entries[col].name);
+        data->resize(b->nrows);
+        for (luint row = 0; row < b->nrows; ++row) {
+            data->at(row) = rge_get_double(b, col, row);
+        }
+    }
+    return 0;
+}
+
+/** Get entry number idx of column var of old, as the old get_entry() did. */
+static double oldbank_get(bench_oldbank *old, const char *var, luint idx) {
+    double entry;
+    try {
+        entry = old->at(var)->at(idx);
+    }
+    catch (...) {
+        entry = 0;
+        rge_errno = RGEERR_INVALIDENTRY;
+    }
+    return entry;
+}
+
+/**
+ * Read all columns of all rows of bank b by column index.
+ *
+ * @return : sum of the values read, so that the reads aren't optimized away.
+ */
+static double read_by_index(rge_hipobank *b) {
+    double sum = 0;
+    for (luint row = 0; row < b->nrows; ++row) {
+        for (uint col = 0; col < b->ncols; ++col) {
+            sum += rge_get_double(b, col, row);
+        }
+    }
+    return sum;
+}
+
+/**
+ * Read all columns of all rows of bank b through its copy old, looking up each
+ *     column by name.
+ *
+ * @return : sum of the values read, so that the reads aren't optimized away.
+ */
+static double read_by_name(rge_hipobank *b, bench_oldbank *old) {
+    double sum = 0;
+    for (luint row = 0; row < b->nrows; ++row) {
+        for (uint col = 0; col < b->ncols; ++col) {
+            sum += oldbank_get(old, b->entries[col].name, row);
+        }
+    }
+    return sum;
+}
+
+/** Return the seconds elapsed since start. */
+static double elapsed(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    return d.count();
+}
+
+/** run() function of the program. Check USAGE_MESSAGE for details. */
+static int run(char *in_filename, lint nevents) {
+    // Open input and add banks.
+    const char *bank_names[NBANKS] = {
+            RGE_RECPARTICLE, RGE_RECTRACK, RGE_RECCALORIMETER
+    };
+    rge_hipobank banks[NBANKS];
+    bench_oldbank oldbanks[NBANKS];
+    rge_eventloader loader;
+    if (rge_loader_open(&loader, in_filename)) return 1;
+    for (int bank_i = 0; bank_i < NBANKS; ++bank_i) {
+        banks[bank_i] = rge_hipobank_init(bank_names[bank_i]);
+        if (rge_loader_add_bank(&loader, &banks[bank_i], RGE_ALLCOLS)) {
+            return 1;
+        }
+        oldbank_init(&oldbanks[bank_i], &banks[bank_i]);
+    }
+    if (nevents == -1 || nevents > loader.nevents) nevents = loader.nevents;
+
+    // Time each access path separately on the same loaded event.
+    double t_load  = 0;
+    double t_index = 0;
+    double t_copy  = 0;
+    double t_name  = 0;
+    double sum_index = 0;
+    double sum_name  = 0;
+    luint naccess    = 0;
+    for (lint event = 0; event < nevents; ++event) {
+        std::chrono::steady_clock::time_point start =
+                std::chrono::steady_clock::now();
+        if (rge_loader_get_event(&loader, event)) return 1;
+        t_load += elapsed(start);
+
+        start = std::chrono::steady_clock::now();
+        for (int bank_i = 0; bank_i < NBANKS; ++bank_i) {
+            sum_index += read_by_index(&banks[bank_i]);
+        }
+        t_index += elapsed(start);
+
+        start = std::chrono::steady_clock::now();
+        for (int bank_i = 0; bank_i < NBANKS; ++bank_i) {
+            oldbank_fill(&oldbanks[bank_i], &banks[bank_i]);
+        }
+        t_copy += elapsed(start);
+
+        start = std::chrono::steady_clock::now();
+        for (int bank_i = 0; bank_i < NBANKS; ++bank_i) {
+            sum_name += read_by_name(&banks[bank_i], &oldbanks[bank_i]);
+        }
+        t_name += elapsed(start);
+        if (rge_errno != RGEERR_UNDEFINED) return 1;
+
+        for (int bank_i = 0; bank_i < NBANKS; ++bank_i) {
+            naccess += banks[bank_i].nrows * banks[bank_i].ncols;
+        }
+    }
+
+    // Print results.
+    double ns_event  = nevents > 0 ? 1e9 / static_cast<double>(nevents) : 0;
+    double ns_access = naccess > 0 ? 1e9 / static_cast<double>(naccess) : 0;
+    printf("Events read:       %ld\n", nevents);
+    printf("Column accesses:   %lu\n", naccess);
+    printf("Event loading:     %10.1f ns/event\n", t_load * ns_event);
+    printf(
+            "Access by index:   %10.1f ns/event, %6.2f ns/access\n",
+            t_index * ns_event, t_index * ns_access
+    );
+    printf(
+            "Old conversion:    %10.1f ns/event, %6.2f ns/access\n",
+            t_copy * ns_event, t_copy * ns_access
+    );
+    printf(
+            "Old access:        %10.1f ns/event, %6.2f ns/access\n",
+            t_name * ns_event, t_name * ns_access
+    );
+    if (t_index > 0) {
+        printf(
+                "Speedup:           %10.2fx\n", (t_copy + t_name) / t_index
+        );
+    }
+    if (sum_index != sum_name) {
+        printf("WARNING: both access paths read different values.\n");
+    }
+
+    // Clean up after ourselves.
+    rge_loader_close(&loader);
+    for (int bank_i = 0; bank_i < NBANKS; ++bank_i) {
+        oldbank_free(&oldbanks[bank_i]);
+        rge_hipobank_free(&banks[bank_i]);
+    }
+
+    rge_errno = RGEERR_NOERR;
+    return 0;
+}
+
+/** Handle arguments for bench_banks using optarg. */
+static int handle_args(
+        int argc, char **argv, char **in_filename, lint *nevents
+) {
+    int opt;
+    while ((opt = getopt(argc, argv, "-hn:")) != -1) {
+        switch (opt) {
+            case 'h':
+                rge_errno = RGEERR_USAGE;
+                return 1;
+            case 'n':
+                if (rge_process_nentries(nevents, optarg)) return 1;
+                break;
+            case 1:
+                *in_filename = static_cast<char *>(malloc(strlen(optarg) + 1));
+                strcpy(*in_filename, optarg);
+                break;
+            default:
+                rge_errno = RGEERR_BADOPTARGS;
+                return 1;
+        }
+    }
+
+    // Check that a positional argument was given.
+    if (*in_filename == NULL) {
+        rge_errno = RGEERR_NOINPUTFILE;
+        return 1;
+    }
+
+    return 0;
+}
+
+/** Entry point of bench_banks. Check USAGE_MESSAGE for details. */
+int main(int argc, char **argv) {
+    // Handle arguments.
+    char *in_filename = NULL;
+    lint nevents      = -1;
+
+    handle_args(argc, argv, &in_filename, &nevents);
+
+    // Run.
+    if (rge_errno == RGEERR_UNDEFINED) run(in_filename, nevents);
+
+    // Free up memory.
+    if (in_filename != NULL) free(in_filename);
+
+    // Return errcode.
+    return rge_print_usage(USAGE_MESSAGE);
+}
@@ -20,19 +20,22 @@
 // ROOT.
 #include <TFile.h>
 #include <TH2.h>
-#include <TNtuple.h>
+#include <TTree.h>
 
 // rge-analysis.
+#include "../lib/rge_binning.h"
 #include "../lib/rge_constants.h"
 #include "../lib/rge_err_handler.h"
+#include "../lib/rge_file_handler.h"
 #include "../lib/rge_io_handler.h"
 #include "../lib/rge_progress.h"
 #include "../lib/rge_pid_utils.h"
 #include "../lib/rge_filename_handler.h"
 #include "../lib/rge_math_utils.h"
+#include "../lib/rge_ntuple.h"
 
 static const char *USAGE_MESSAGE =
-"Usage: draw_plots [-hp:cb:n:o:a:w:] infile\n"
+"Usage: draw_plots [-hp:cb:e:n:o:a:Aw:] infile\n"
 " * -h          : show this message and exit.\n"
 " * -p pid      : skip particle selection and draw plots for pid.\n"
 " * -c          : apply all cuts (general, geometry, and DIS) instead of\n"
@@ -41,6 +44,9 @@ static const char *USAGE_MESSAGE =
 "                 binning variable (following program convention), lower\n"
 "                 limit, upper limit, and number of bins. Set all variables\n"
 "                 to 0 to not do binning.\n"
+" * -e # ...    : apply 1D binning with variable bin sizes. The first number\n"
+"                 is the index of the binning variable, followed by the bin\n"
+"                 edges in increasing order. Overrides -b.\n"
 " * -n nentries : number of entries to process.\n"
 " * -o outfile  : output file name. Default is plots_<run_no>.root.\n"
 " * -a accfile  : apply acceptance correction using acc_filename.\n"
@@ -129,12 +135,8 @@ static const int ACC_VX[ACCPLT_LIST_SIZE][2] = {
  *                     for each plot.
  *
  *     BINNING PARAMETERS.
- * @param bin_vars:    Array of variables for binning for each plot.
- * @param bin_nbins:   Array with number of dimensions for binning for each
- *                     binning.
- * @param bin_range:   2-dimensional array with lower and upper limits for each
- *                     binning variable.
- * @param bin_binsize: Array with size of each bin for each binning.
+ * @param bin_vars:     Array of variables for binning for each plot.
+ * @param bin_binnings: Array with the binning of each binning variable.
  *
  * @return:            Error code. Currently, can only return 0 (success).
  */
@@ -142,8 +144,7 @@ static int create_plots(
         TH1 *plot_arr[], luint dim_bins, int *idx, luint depth,
         TString *plot_title, const char *x_var, const char *y_var,
         int plot_type, luint plot_nbins[], double plot_range[][2],
-        int bin_vars[], luint bin_nbins[], double bin_range[][2],
-        double bin_binsize[]
+        int bin_vars[], rge_binning bin_binnings[]
 ) {
     if (depth == dim_bins) {
         // Create plot and increase index.
@@ -165,10 +166,10 @@ static int create_plots(
         return 0;
     }
 
-    for (luint bin_i = 0; bin_i < bin_nbins[depth]; ++bin_i) {
+    for (luint bin_i = 0; bin_i < bin_binnings[depth].nbins; ++bin_i) {
         // Find limits.
-        double b_low  = bin_range[depth][0] + bin_binsize[depth]* bin_i;
-        double b_high = bin_range[depth][0] + bin_binsize[depth]*(bin_i+1);
+        double b_low  = bin_binnings[depth].edges[bin_i];
+        double b_high = bin_binnings[depth].edges[bin_i+1];
 
         // Append bin limits to title.
         TString name_cpy = plot_title->Copy();
@@ -178,8 +179,7 @@ static int create_plots(
         // Continue down the recursive line...
         create_plots(
                 plot_arr, dim_bins, idx, depth+1, &name_cpy, x_var, y_var,
-                plot_type, plot_nbins, plot_range, bin_vars, bin_nbins,
-                bin_range, bin_binsize
+                plot_type, plot_nbins, plot_range, bin_vars, bin_binnings
         );
     }
 
@@ -191,7 +191,7 @@ static int create_acc_corr_plots(
         TH1 *plot_arr[], luint dim_bins, int *idx, luint depth,
         TString *plot_title, const char *x_var, const char *y_var,
         int plot_type, luint plot_nbins, double plot_edges[], int bin_vars[],
-        luint bin_nbins[], double bin_range[][2], double bin_binsize[]
+        rge_binning bin_binnings[]
 ) {
     if (depth == dim_bins) {
         // Create plot and increase index.
@@ -209,10 +209,10 @@ static int create_acc_corr_plots(
         return 0;
     }
 
-    for (luint bin_i = 0; bin_i < bin_nbins[depth]; ++bin_i) {
+    for (luint bin_i = 0; bin_i < bin_binnings[depth].nbins; ++bin_i) {
         // Find limits.
-        double b_low  = bin_range[depth][0] + bin_binsize[depth]* bin_i;
-        double b_high = bin_range[depth][0] + bin_binsize[depth]*(bin_i+1);
+        double b_low  = bin_binnings[depth].edges[bin_i];
+        double b_high = bin_binnings[depth].edges[bin_i+1];
 
         // Append bin limits to title.
         TString name_cpy = plot_title->Copy();
@@ -222,8 +222,7 @@ static int create_acc_corr_plots(
         // Continue down the recursive line...
         if (create_acc_corr_plots(
                 plot_arr, dim_bins, idx, depth+1, &name_cpy, x_var, y_var,
-                plot_type, plot_nbins, plot_edges, bin_vars, bin_nbins,
-                bin_range, bin_binsize
+                plot_type, plot_nbins, plot_edges, bin_vars, bin_binnings
         )) return 1;
     }
 
@@ -251,31 +250,26 @@ static int create_acc_corr_plots(
  * @param nplots:          Number of TH1F and TH2F plots, depends on number of
  *                         bins.
  * @param vars:            Array of variables for binning for each plot.
- * @param nbins:           Array with number of dimensions for binning for each
- *                         binning.
- * @param range:           2-dimensional array with lower and upper limits for
- *                         each binning variable.
- * @param binsize:         Array with size of each bin for each binning.
+ * @param binnings:        Array with the binning of each binning variable.
  *
  * @return:                Error code. Currently, can only return 0 (success).
  */
 static int find_bin(
         TString *plot_title, luint dim_bins, luint idx, luint depth,
-        luint prev_dim_factor, int nplots, int vars[], luint nbins[],
-        double range[][2], double binsize[]
+        luint prev_dim_factor, int nplots, int vars[], rge_binning binnings[]
 ) {
     if (depth == dim_bins) return 0;
 
     // Find index in array (for this dimension).
     luint dim_factor = 1;
     for (luint depth_i = depth+1; depth_i < dim_bins; ++depth_i) {
-        dim_factor *= nbins[depth_i];
+        dim_factor *= binnings[depth_i].nbins;
     }
     luint bi = (idx%prev_dim_factor)/dim_factor;
 
     // Get limits.
-    double low  = range[depth][0] + binsize[depth]* bi;
-    double high = range[depth][0] + binsize[depth]*(bi+1);
+    double low  = binnings[depth].edges[bi];
+    double high = binnings[depth].edges[bi+1];
 
     // Append dir to title.
     plot_title->Append(Form(
@@ -284,63 +278,39 @@ static int find_bin(
 
     return find_bin(
             plot_title, dim_bins, idx, depth+1, dim_factor,
-            nplots, vars, nbins, range, binsize
+            nplots, vars, binnings
     );
 }
 
 /**
- * Find index of plot in array, recursively going through binnings.
+ * Check if an entry of an event layout ntuple passes the DIS cuts, which are
+ *     applied on the trigger electron.
  *
- *     INTERNAL PARAMETERS.
- * @param dim_bins: Binning dimension. Needed to compute how deep the recursion
- *                  should go before stopping.
- * @param depth:    How deep along the number of bins we are. When calling the
- *                  function, this should always be 0.
- *
- *     BINNINGS PAREMETERS.
- * @param var:      Binning variables.
- * @param nbins:    Array with number of dimensions for binning for each
- *                  binning.
- * @param range:    2-dimensional array with lower and upper limits for each
- *                  binning variable.
- * @param binsize:  Array with size of each bin for each binning.
- *
- * @return:         Index of the bin we're looking for. Returns -1 if variable
- *                  is not within binning range.
+ * @param reader : rge_ntuplereader with the entry loaded.
+ * @param npart  : number of particles in the entry.
+ * @return       : true if the event passes the DIS cuts.
  */
-static lint find_idx(
-        luint dim_bins, luint depth, Float_t var[], luint nbins[],
-        double range[][2], double binsize[]
-) {
-    if (depth == dim_bins) return 0;
-    for (luint bi = 0; bi < nbins[depth]; ++bi) {
-        // Define bin limits.
-        double low  = range[depth][0] + binsize[depth]* bi;
-        double high = range[depth][0] + binsize[depth]*(bi+1);
-
-        // Find bin for var.
-        if (low < var[depth] && var[depth] < high) {
-            luint dim_factor = 1;
-            for (luint depth_i = depth + 1; depth_i < dim_bins; ++depth_i) {
-                dim_factor *= nbins[depth_i];
-            }
-            lint idx =
-                    find_idx(dim_bins, depth+1, var, nbins, range, binsize);
-            if (idx < 0) return idx;
-            else return static_cast<lint>(
-                    bi*dim_factor + static_cast<luint>(idx)
-            );
+static bool event_passes_dis(rge_ntuplereader *reader, luint npart) {
+    rge_varval *vars = reader->vals;
+    bool valid = false;
+    for (luint part_i = 0; part_i < npart; ++part_i) {
+        rge_ntuplereader_get_particle(reader, part_i);
+        if (vars[RGE_PID.addr].i != 11 || vars[RGE_STATUS.addr].i > 0) {
+            continue;
         }
+        valid = vars[RGE_Q2.addr].f >= RGE_Q2CUT &&
+                vars[RGE_W2.addr].f >= RGE_W2CUT &&
+                vars[RGE_YB.addr].f <= RGE_YBCUT;
     }
-
-    return -1; // Variable is not within binning range.
+    return valid;
 }
 
 /** run() function of the program. Check USAGE_MESSAGE for details. */
 static int run(
         char *in_filename, char *out_filename, char *acc_filename,
         char *work_dir, int run_no, lint nentries, lint sel_pid,
-        bool apply_all_cuts, bool apply_acc_corr, lint *binning_setup
+        bool apply_all_cuts, bool apply_acc_corr, lint *binning_setup,
+        luint bin_nedges, double *bin_edges
 ) {
     // Open input file.
     TFile *f_in  = TFile::Open(in_filename, "READ");
@@ -351,19 +321,10 @@ static int run(
 
     // Get acceptance correction
     bool acc_plot = false;
-    luint acc_nedges[5];
-    luint acc_nbins;
-    luint acc_npids;
-    double **acc_edges;
-    lint *acc_pids;
-    int **acc_n_thrown;
-    int **acc_n_simul;
+    rge_accdata acc;
     if (acc_filename != NULL) {
         acc_plot = true;
-        if (rge_read_acc_corr_file(
-                acc_filename, acc_nedges, &acc_edges, &acc_npids, &acc_nbins,
-                &acc_pids, &acc_n_thrown, &acc_n_simul
-        )) return 1;
+        if (rge_read_acc_corr_file(acc_filename, &acc)) return 1;
     }
 
     // === PARTICLE SELECTION ==================================================
@@ -397,9 +358,9 @@ static int run(
     //     return an error.
     uint acc_pid_idx = UINT_MAX;
     if (acc_plot) {
-        // Find index of plot_pid in acc_pids.
-        for (uint pid_i = 0; pid_i < acc_npids; ++pid_i) {
-            if (acc_pids[pid_i] == plot_pid) acc_pid_idx = pid_i;
+        // Find index of plot_pid in acc.pids.
+        for (uint pid_i = 0; pid_i < acc.npids; ++pid_i) {
+            if (acc.pids[pid_i] == plot_pid) acc_pid_idx = pid_i;
         }
         if (acc_pid_idx == UINT_MAX) {
             rge_errno = RGEERR_NOACCDATA;
@@ -433,7 +394,10 @@ static int run(
 
     // === SETUP BINNING =======================================================
     luint dim_bins;
-    if (binning_setup[0] == -1) {
+    if (bin_nedges > 0) {
+        dim_bins = 1;
+    }
+    else if (binning_setup[0] == -1) {
         printf("\nNumber of dimensions for binning?\n");
         dim_bins = static_cast<luint>(rge_catch_long());
     }
@@ -446,14 +410,21 @@ static int run(
     else {
         dim_bins = 1;
     }
-    int    bin_vars[dim_bins];
-    double bin_range[dim_bins][2];
-    luint  bin_nbins[dim_bins];
-    if (binning_setup[0] != -1) {
-        bin_vars[0]     = binning_setup[0];
-        bin_range[0][0] = binning_setup[1];
-        bin_range[0][1] = binning_setup[2];
-        bin_nbins[0]    = static_cast<luint>(binning_setup[3]);
+    int bin_vars[dim_bins];
+    rge_binning bin_binnings[dim_bins];
+    if (bin_nedges > 0) {
+        // First number is the binning variable, the rest are its edges.
+        bin_vars[0] = static_cast<int>(bin_edges[0]);
+        rge_binning_init(&bin_binnings[0], bin_nedges-1, &bin_edges[1]);
+    }
+    else if (binning_setup[0] != -1) {
+        if (dim_bins == 1) {
+            bin_vars[0] = binning_setup[0];
+            rge_binning_init_uniform(
+                    &bin_binnings[0], binning_setup[1], binning_setup[2],
+                    static_cast<luint>(binning_setup[3])
+            );
+        }
     }
     else {
         for (luint bin_dim_i = 0; bin_dim_i < dim_bins; ++bin_dim_i) {
@@ -467,11 +438,18 @@ static int run(
             }
             bin_vars[bin_dim_i] = rge_catch_var(RGE_VARS, RGE_VARS_SIZE);
 
+            printf(
+                    "\nUse variable bin sizes for bin in dimension %ld? "
+                    "[y/n]\n", bin_dim_i
+            );
+            bool variable = rge_catch_yn();
+
             // range.
-            for (int range_i = 0; range_i < 2; ++range_i) {
+            double range[2];
+            for (int range_i = 0; range_i < 2 && !variable; ++range_i) {
                 printf("\nDefine %s limit for bin in dimension %ld:\n",
                         RAN_LIST[range_i], bin_dim_i);
-                bin_range[bin_dim_i][range_i] = rge_catch_double();
+                range[range_i] = rge_catch_double();
             }
 
             // nbins.
@@ -479,16 +457,41 @@ static int run(
                     "\nDefine number of bins for bin in dimension %ld:\n",
                     bin_dim_i
             );
-            bin_nbins[bin_dim_i] = static_cast<luint>(rge_catch_long());
-        }
-    }
+            lint nbins = rge_catch_long();
+            if (!variable) {
+                rge_binning_init_uniform(
+                        &bin_binnings[bin_dim_i], range[0], range[1],
+                        static_cast<luint>(nbins)
+                );
+                continue;
+            }
 
-    // binning bin size.
-    double bin_binsize[dim_bins];
-    for (luint bin_dim_i = 0; bin_dim_i < dim_bins; ++bin_dim_i) {
-        bin_binsize[bin_dim_i] =
-                (bin_range[bin_dim_i][1] - bin_range[bin_dim_i][0]) /
-                bin_nbins[bin_dim_i];
+            // edges.
+            if (nbins < 1) {
+                for (luint dim_i = 0; dim_i < bin_dim_i; ++dim_i) {
+                    rge_binning_free(&bin_binnings[dim_i]);
+                }
+                rge_errno = RGEERR_BADBINEDGES;
+                return 1;
+            }
+            double edges[nbins+1];
+            for (lint edge_i = 0; edge_i <= nbins; ++edge_i) {
+                printf("\nDefine edge %ld for bin in dimension %ld:\n",
+                        edge_i, bin_dim_i);
+                edges[edge_i] = rge_catch_double();
+                if (edge_i == 0 || edges[edge_i] > edges[edge_i-1]) continue;
+
+                for (luint dim_i = 0; dim_i < bin_dim_i; ++dim_i) {
+                    rge_binning_free(&bin_binnings[dim_i]);
+                }
+                rge_errno = RGEERR_BADBINEDGES;
+                return 1;
+            }
+            rge_binning_init(
+                    &bin_binnings[bin_dim_i], static_cast<luint>(nbins+1),
+                    edges
+            );
+        }
     }
 
     // === SETUP PLOT ==========================================================
@@ -564,15 +567,43 @@ static int run(
     }
 
     // === SETUP NTUPLES =======================================================
-    TNtuple *ntuple = static_cast<TNtuple *>(f_in->Get(RGE_TREENAMEDATA));
-    if (ntuple == NULL) {
-        rge_errno = RGEERR_BADROOTFILE;
-        return 1;
+    // The input may have one entry per particle or one entry per event.
+    rge_ntuplereader reader;
+    if (rge_ntuplereader_open(&reader, f_in)) return 1;
+    TTree *ntuple      = reader.tree;
+    rge_varval *vars   = reader.vals;
+    luint present_vars = reader.varmask;
+
+    // Check that the ntuple has every variable used by the selected cuts,
+    //     binning, and plots.
+    luint used_vars =
+            RGE_VARBIT(RGE_EVENTNO.addr) | RGE_VARBIT(RGE_PID.addr) |
+            RGE_VARBIT(RGE_Q2.addr)      | RGE_VARBIT(RGE_NU.addr)  |
+            RGE_VARBIT(RGE_ZH.addr)      | RGE_VARBIT(RGE_PT2.addr) |
+            RGE_VARBIT(RGE_PHIPQ.addr);
+    if (plot_charge != INT_MAX) used_vars |= RGE_VARBIT(RGE_CHARGE.addr);
+    if (geometry_cuts) {
+        used_vars |= RGE_VARBIT(RGE_VX.addr) | RGE_VARBIT(RGE_VY.addr) |
+                RGE_VARBIT(RGE_VZ.addr);
     }
-
-    Float_t vars[RGE_VARS_SIZE];
-    for (int var_i = 0; var_i < RGE_VARS_SIZE; ++var_i) {
-        ntuple->SetBranchAddress(RGE_VARS[var_i], &vars[var_i]);
+    if (general_cuts) {
+        used_vars |= RGE_VARBIT(RGE_CHI2.addr) | RGE_VARBIT(RGE_NDF.addr);
+    }
+    if (dis_cuts) {
+        used_vars |= RGE_VARBIT(RGE_STATUS.addr) | RGE_VARBIT(RGE_W2.addr) |
+                RGE_VARBIT(RGE_YB.addr);
+    }
+    for (luint bin_dim_i = 0; bin_dim_i < dim_bins; ++bin_dim_i) {
+        used_vars |= RGE_VARBIT(bin_vars[bin_dim_i]);
+    }
+    for (luint plot_i = 0; plot_i < plot_arr_size; ++plot_i) {
+        for (int dim_i = 0; dim_i < plot_type[plot_i]+1; ++dim_i) {
+            used_vars |= RGE_VARBIT(plot_vars[plot_i][dim_i]);
+        }
+    }
+    if (used_vars & ~present_vars) {
+        rge_errno = RGEERR_MISSINGNTUPLEVAR;
+        return 1;
     }
 
     // === APPLY CUTS ==========================================================
@@ -583,30 +614,31 @@ static int run(
         nentries = ntuple->GetEntries();
     }
 
-    // Apply SIDIS cuts, checking which event numbers should be skipped.
+    // Apply SIDIS cuts, checking which event numbers should be skipped. This
+    //     is only needed in the particle layout.
+    bool dis_prepass = dis_cuts && !reader.is_event;
     luint nevents = 0;
 
     // Prepare progress bar.
     rge_pbar_set_nentries(nentries);
 
     // Count number of events.
-    for (lint entry = 0; entry < nentries; ++entry) {
+    for (lint entry = 0; entry < nentries && dis_prepass; ++entry) {
         rge_pbar_update(entry);
         ntuple->GetEntry(entry);
-        if (vars[RGE_EVENTNO.addr] > nevents) {
-            nevents = static_cast<luint>(vars[RGE_EVENTNO.addr]+0.5);
-        }
+        luint evn = static_cast<luint>(vars[RGE_EVENTNO.addr].l);
+        if (evn >= nevents) nevents = evn + 1;
     }
 
     // Apply previously setup cuts.
-    if (dis_cuts) printf("Applying cuts...\n");
+    if (dis_prepass) printf("Applying cuts...\n");
     bool *valid_event = static_cast<bool *>(malloc(nevents * sizeof(bool)));
-    Float_t current_evn = -1;
+    Long64_t current_evn = -1;
     bool no_tre_pass, Q2_pass, W2_pass, Yb_pass;
 
     // Fill valid_event array with false bools in case the next for loop doesn't
     //     fill every entry in it.
-    for (luint event = 0; event < nevents && dis_cuts; ++event) {
+    for (luint event = 0; event < nevents && dis_prepass; ++event) {
         valid_event[event] = false;
     }
 
@@ -615,31 +647,28 @@ static int run(
     //     so that we can skip those when plotting. It is only necessary to do
     //     this if we're applying DIS cuts.
     rge_pbar_reset();
-    for (lint entry = 0; entry < nentries && dis_cuts; ++entry) {
+    for (lint entry = 0; entry < nentries && dis_prepass; ++entry) {
         rge_pbar_update(entry);
 
         ntuple->GetEntry(entry);
-        if (vars[RGE_EVENTNO.addr] != current_evn) {
-            current_evn = vars[RGE_EVENTNO.addr];
-            valid_event[static_cast<luint>(vars[RGE_EVENTNO.addr]+0.5)] = false;
+        if (vars[RGE_EVENTNO.addr].l != current_evn) {
+            current_evn = vars[RGE_EVENTNO.addr].l;
+            valid_event[current_evn] = false;
             no_tre_pass = false;
             Q2_pass     = true;
             W2_pass     = true;
             Yb_pass     = true;
         }
 
-        if (
-                (10.5 >= vars[RGE_PID.addr] || vars[RGE_PID.addr] > 11.5) ||
-                vars[RGE_STATUS.addr] > 0
-        ) {
+        if (vars[RGE_PID.addr].i != 11 || vars[RGE_STATUS.addr].i > 0) {
             continue;
         }
         no_tre_pass = true;
-        Q2_pass = vars[RGE_Q2.addr] >= RGE_Q2CUT;
-        W2_pass = vars[RGE_W2.addr] >= RGE_W2CUT;
-        Yb_pass = vars[RGE_YB.addr] <= RGE_YBCUT;
+        Q2_pass = vars[RGE_Q2.addr].f >= RGE_Q2CUT;
+        W2_pass = vars[RGE_W2.addr].f >= RGE_W2CUT;
+        Yb_pass = vars[RGE_YB.addr].f <= RGE_YBCUT;
 
-        valid_event[static_cast<luint>(vars[RGE_EVENTNO.addr]+0.5)] =
+        valid_event[current_evn] =
                 no_tre_pass && Q2_pass && W2_pass && Yb_pass;
     }
 
@@ -647,7 +676,7 @@ static int run(
     // Create plots, separated by n-dimensional binning.
     luint bin_arr_size = 1;
     for (luint bin_dim_i = 0; bin_dim_i < dim_bins; ++bin_dim_i) {
-        bin_arr_size *= bin_nbins[bin_dim_i];
+        bin_arr_size *= bin_binnings[bin_dim_i].nbins;
     }
 
     TH1 *plot_arr[plot_arr_size][bin_arr_size];
@@ -659,8 +688,8 @@ static int run(
             create_acc_corr_plots(
                     plot_arr[plot_i], dim_bins, &idx, 0, &plot_title,
                     RGE_VARS[plot_vars[plot_i][0]], "",
-                    plot_type[plot_i], acc_nedges[plot_i], acc_edges[plot_i],
-                    bin_vars, bin_nbins, bin_range, bin_binsize
+                    plot_type[plot_i], acc.nedges[plot_i], acc.edges[plot_i],
+                    bin_vars, bin_binnings
             );
             continue;
         }
@@ -670,7 +699,7 @@ static int run(
                     plot_arr[plot_i], dim_bins, &idx, 0, &plot_title,
                     RGE_VARS[plot_vars[plot_i][0]], "",
                     plot_type[plot_i], plot_nbins[plot_i], plot_range[plot_i],
-                    bin_vars, bin_nbins, bin_range, bin_binsize
+                    bin_vars, bin_binnings
             );
         }
         if (plot_type[plot_i] == 1) { // 2D plot.
@@ -681,7 +710,7 @@ static int run(
                     RGE_VARS[plot_vars[plot_i][0]],
                     RGE_VARS[plot_vars[plot_i][1]],
                     plot_type[plot_i], plot_nbins[plot_i], plot_range[plot_i],
-                    bin_vars, bin_nbins, bin_range, bin_binsize
+                    bin_vars, bin_binnings
             );
         }
     }
@@ -691,114 +720,124 @@ static int run(
     rge_pbar_reset();
     for (lint entry = 0; entry < nentries; ++entry) {
         rge_pbar_update(entry);
-        ntuple->GetEntry(entry);
+        luint npart = rge_ntuplereader_get_entry(&reader, entry);
 
-        // Apply particle cuts.
-        if (plot_charge != INT_MAX) {
-            if (plot_charge ==  1 && !(vars[RGE_CHARGE.addr] >  0)) continue;
-            if (plot_charge ==  0 && !(vars[RGE_CHARGE.addr] == 0)) continue;
-            if (plot_charge == -1 && !(vars[RGE_CHARGE.addr] <  0)) continue;
-        }
-        if (
-                plot_pid != INT_MAX &&
-                (
-                        vars[RGE_PID.addr] - 0.5 >= plot_pid ||
-                        plot_pid > vars[RGE_PID.addr] + 0.5
-                )
-        ) {
-            continue;
+        // In the event layout, DIS cuts are checked once per entry.
+        bool entry_valid = true;
+        if (reader.is_event && dis_cuts) {
+            entry_valid = event_passes_dis(&reader, npart);
         }
 
-        // Apply geometry cuts.
-        if (geometry_cuts) {
-            if (
-                    rge_calc_magnitude(vars[RGE_VX.addr], vars[RGE_VY.addr]) >
-                    RGE_VXVYCUT
-            ) {
+        for (luint part_i = 0; part_i < npart && entry_valid; ++part_i) {
+            rge_ntuplereader_get_particle(&reader, part_i);
+
+            // Apply particle cuts.
+            if (plot_charge != INT_MAX) {
+                int charge = vars[RGE_CHARGE.addr].i;
+                if (plot_charge ==  1 && !(charge >  0)) continue;
+                if (plot_charge ==  0 && !(charge == 0)) continue;
+                if (plot_charge == -1 && !(charge <  0)) continue;
+            }
+            if (plot_pid != INT_MAX && vars[RGE_PID.addr].i != plot_pid) {
                 continue;
             }
+
+            // Apply geometry cuts.
+            if (geometry_cuts) {
+                if (
+                        rge_calc_magnitude(
+                                vars[RGE_VX.addr].f, vars[RGE_VY.addr].f
+                        ) > RGE_VXVYCUT
+                ) {
+                    continue;
+                }
+                if (
+                        RGE_VZLOWCUT > vars[RGE_VZ.addr].f ||
+                        vars[RGE_VZ.addr].f > RGE_VZHIGHCUT
+                ) {
+                    continue;
+                }
+            }
+
+            // Apply miscellaneous cuts.
+            if (general_cuts) {
+                // Non-identified particle.
+                if (vars[RGE_PID.addr].i ==  0) continue;
+                // Non-identified particle.
+                if (vars[RGE_PID.addr].i == 45) continue;
+                // Ignore tracks with high chi2.
+                if (
+                        vars[RGE_CHI2.addr].f/vars[RGE_NDF.addr].i >=
+                        RGE_CHI2NDFCUT
+                ) {
+                    continue;
+                }
+            }
+
+            // Apply DIS cuts.
             if (
-                    RGE_VZLOWCUT > vars[RGE_VZ.addr] ||
-                    vars[RGE_VZ.addr] > RGE_VZHIGHCUT
+                    dis_cuts && !reader.is_event &&
+                    !valid_event[vars[RGE_EVENTNO.addr].l]
             ) {
                 continue;
             }
-        }
 
-        // Apply miscellaneous cuts.
-        if (general_cuts) {
-            // Non-identified particle.
-            if (-0.5 <= vars[RGE_PID.addr] && vars[RGE_PID.addr] <  0.5)
-                continue;
-            // Non-identified particle.
-            if (44.5 <= vars[RGE_PID.addr] && vars[RGE_PID.addr] < 45.5)
+            // Remove DIS vars = 0.
+            if (vars[RGE_Q2.addr].f == 0 || vars[RGE_NU.addr].f == 0) {
                 continue;
-            // Ignore tracks with high chi2.
-            if (vars[RGE_CHI2.addr]/vars[RGE_NDF.addr] >= RGE_CHI2NDFCUT)
+            }
+            // Remove SIDIS vars = 0 (for all but electrons!).
+            if (
+                    vars[RGE_PID.addr].i != 11 &&
+                    (
+                            vars[RGE_ZH.addr].f    == 0 ||
+                            vars[RGE_PT2.addr].f   == 0 ||
+                            vars[RGE_PHIPQ.addr].f == 0
+                    )
+            ) {
                 continue;
-        }
-
-        // Apply DIS cuts.
-        if (
-                dis_cuts &&
-                !valid_event[static_cast<int>(vars[RGE_EVENTNO.addr]+0.5)]
-        ) {
-            continue;
-        }
-
-        // Remove DIS vars = 0.
-        if (vars[RGE_Q2.addr] == 0 || vars[RGE_NU.addr] == 0) {
-            continue;
-        }
-        // Remove SIDIS vars = 0 (for all but electrons!).
-        if (
-                (10.5 >= vars[RGE_PID.addr] || vars[RGE_PID.addr] > 11.5) &&
-                (
-                        vars[RGE_ZH.addr]    == 0 ||
-                        vars[RGE_PT2.addr]   == 0 ||
-                        vars[RGE_PHIPQ.addr] == 0
-                )
-        ) {
-            continue;
-        }
+            }
 
-        // Prepare binning vars.
-        Float_t bin_vars_idx[dim_bins];
-        for (luint bin_dim_i = 0; bin_dim_i < dim_bins; ++bin_dim_i) {
-            bin_vars_idx[bin_dim_i] = vars[bin_vars[bin_dim_i]];
-        }
+            // Find corresponding bin. It's the same for every plot.
+            double bin_vars_idx[dim_bins];
+            for (luint bin_dim_i = 0; bin_dim_i < dim_bins; ++bin_dim_i) {
+                bin_vars_idx[bin_dim_i] =
+                        rge_varval_get(vars, bin_vars[bin_dim_i]);
+            }
+            lint idx =
+                    rge_binning_find_nd(bin_binnings, dim_bins, bin_vars_idx);
+            if (idx == -1) continue;
 
-        // Fill plots.
-        for (luint plot_i = 0; plot_i < plot_arr_size; ++plot_i) {
-            // SIDIS variables only make sense for some particles.
-            bool sidis_pass = true;
-            for (int dim_i = 0; dim_i < plot_type[plot_i]+1; ++dim_i) {
-                const char **plot_var = &RGE_VARS[plot_vars[plot_i][dim_i]];
-                for (int list_i = 0; list_i < DIS_LIST_SIZE; ++list_i) {
-                    if (
-                            !strcmp(*plot_var, DIS_LIST[list_i]) &&
-                            vars[plot_vars[plot_i][dim_i]] < 1e-9
-                    ) {
-                        sidis_pass = false;
+            // Fill plots.
+            for (luint plot_i = 0; plot_i < plot_arr_size; ++plot_i) {
+                // SIDIS variables only make sense for some particles.
+                bool sidis_pass = true;
+                for (int dim_i = 0; dim_i < plot_type[plot_i]+1; ++dim_i) {
+                    const char **plot_var = &RGE_VARS[plot_vars[plot_i][dim_i]];
+                    for (int list_i = 0; list_i < DIS_LIST_SIZE; ++list_i) {
+                        if (
+                                !strcmp(*plot_var, DIS_LIST[list_i]) &&
+                                rge_varval_get(vars, plot_vars[plot_i][dim_i]) <
+                                        1e-9
+                        ) {
+                            sidis_pass = false;
+                        }
                     }
                 }
-            }
-            if (!sidis_pass) continue;
-
-            // Find corresponding bin.
-            lint idx = find_idx(
-                    dim_bins, 0, bin_vars_idx, bin_nbins, bin_range, bin_binsize
-            );
-            if (idx == -1) continue;
+                if (!sidis_pass) continue;
 
-            // Fill histogram.
-            if (plot_type[plot_i] == 0) {
-                plot_arr[plot_i][idx]->Fill(vars[plot_vars[plot_i][0]]);
-            }
-            if (plot_type[plot_i] == 1) {
-                plot_arr[plot_i][idx]->Fill(
-                        vars[plot_vars[plot_i][0]], vars[plot_vars[plot_i][1]]
-                );
+                // Fill histogram.
+                if (plot_type[plot_i] == 0) {
+                    plot_arr[plot_i][idx]->Fill(
+                            rge_varval_get(vars, plot_vars[plot_i][0])
+                    );
+                }
+                if (plot_type[plot_i] == 1) {
+                    plot_arr[plot_i][idx]->Fill(
+                            rge_varval_get(vars, plot_vars[plot_i][0]),
+                            rge_varval_get(vars, plot_vars[plot_i][1])
+                    );
+                }
             }
         }
     }
@@ -806,8 +845,8 @@ static int run(
     // === APPLY ACCEPTANCE CORRECTION =========================================
     // Array for storing number of bins (for simplicity).
     luint bn[5] = {
-            acc_nedges[0]-1, acc_nedges[1]-1, acc_nedges[2]-1,
-            acc_nedges[3]-1, acc_nedges[4]-1
+            acc.nedges[0]-1, acc.nedges[1]-1, acc.nedges[2]-1,
+            acc.nedges[3]-1, acc.nedges[4]-1
     };
 
     // Interate through plot variables and bins.
@@ -818,8 +857,8 @@ static int run(
     ) {
         for (luint bin_i = 0; bin_i < bin_arr_size; ++bin_i) {
             // Integrate through other variables.
-            int y_thrown[bn[plot_i]];
-            int y_simul [bn[plot_i]];
+            luint y_thrown[bn[plot_i]];
+            luint y_simul [bn[plot_i]];
             for (
                     luint acc_bin_i = 0;
                     acc_bin_i < bn[plot_i];
@@ -830,11 +869,11 @@ static int run(
             }
 
             // Go through each of the five acceptance correction bins.
-            for (luint i0 = 0; i0 < acc_nedges[0]-1; ++i0) {
-                for (luint i1 = 0; i1 < acc_nedges[1]-1; ++i1) {
-                    for (luint i2 = 0; i2 < acc_nedges[2]-1; ++i2) {
-                        for (luint i3 = 0; i3 < acc_nedges[3]-1; ++i3) {
-                            for (luint i4 = 0; i4 < acc_nedges[4]-1; ++i4) {
+            for (luint i0 = 0; i0 < acc.nedges[0]-1; ++i0) {
+                for (luint i1 = 0; i1 < acc.nedges[1]-1; ++i1) {
+                    for (luint i2 = 0; i2 < acc.nedges[2]-1; ++i2) {
+                        for (luint i3 = 0; i3 < acc.nedges[3]-1; ++i3) {
+                            for (luint i4 = 0; i4 < acc.nedges[4]-1; ++i4) {
                                 // Find 1D bin position from 5 indices.
                                 luint bin_pos =
                                         i0 * (bn[1]*bn[2]*bn[3]*bn[4]) +
@@ -862,9 +901,9 @@ static int run(
 
                                 // Increment appropriate counters.
                                 y_thrown[sel_idx] +=
-                                        acc_n_thrown[acc_pid_idx][bin_pos];
+                                        acc.n_thrown[acc_pid_idx][bin_pos];
                                 y_simul[sel_idx] +=
-                                        acc_n_simul[acc_pid_idx][bin_pos];
+                                        acc.n_simul[acc_pid_idx][bin_pos];
                             }
                         }
                     }
@@ -902,7 +941,7 @@ static int run(
         // Find dir.
         TString dir;
         find_bin(&dir, dim_bins, bin_i, 0, INT_MAX, bin_arr_size, bin_vars,
-                bin_nbins, bin_range, bin_binsize);
+                bin_binnings);
 
         f_out->mkdir(dir);
         f_out->cd(dir);
@@ -920,21 +959,13 @@ static int run(
     f_out->Close();
 
     free(valid_event);
-
-    if (acc_plot) {
-        for (luint bin_i = 0; bin_i < 5; ++bin_i) {
-            free(acc_edges[bin_i]);
-        }
-        free(acc_edges);
-        free(acc_pids);
-        for (luint plot_i = 0; plot_i < acc_npids; ++plot_i) {
-            free(acc_n_thrown[plot_i]);
-            free(acc_n_simul[plot_i]);
-        }
-        free(acc_n_thrown);
-        free(acc_n_simul);
+    rge_ntuplereader_free(&reader);
+    for (luint bin_dim_i = 0; bin_dim_i < dim_bins; ++bin_dim_i) {
+        rge_binning_free(&bin_binnings[bin_dim_i]);
     }
 
+    if (acc_plot) rge_acc_corr_free(&acc);
+
     rge_errno = RGEERR_NOERR;
     return 0;
 }
@@ -945,14 +976,14 @@ static int run(
  */
 static int handle_args(
         int argc, char **argv, lint *sel_pid, bool *apply_all_cuts,
-        lint *binning_setup, lint *nentries, char **out_filename,
-        char **acc_filename, bool *apply_acc_corr, char **work_dir,
-        char **in_filename, int *run_no
+        lint *binning_setup, luint *bin_nedges, double **bin_edges,
+        lint *nentries, char **out_filename, char **acc_filename,
+        bool *apply_acc_corr, char **work_dir, char **in_filename, int *run_no
 ) {
     // Handle arguments.
     int opt;
     char *tmp_out_filename = NULL;
-    while ((opt = getopt(argc, argv, "-hp:cb:n:o:a:Aw:")) != -1) {
+    while ((opt = getopt(argc, argv, "-hp:cb:e:n:o:a:Aw:")) != -1) {
         switch (opt) {
             case 'h':
                 rge_errno = RGEERR_USAGE;
@@ -967,6 +998,10 @@ static int handle_args(
                 if (rge_grab_multiarg(argc, argv, &optind, &binning_setup))
                     return 1;
                 break;
+            case 'e':
+                if (*bin_edges != NULL) free(*bin_edges);
+                rge_grab_multiarg(argc, argv, &optind, bin_nedges, bin_edges);
+                break;
             case 'n':
                 if (rge_process_nentries(nentries, optarg)) return 1;
                 break;
@@ -1019,6 +1054,23 @@ static int handle_args(
         return 1;
     }
 
+    // Check that -e makes sense.
+    if (*bin_edges != NULL) {
+        double *e = *bin_edges;
+        if (
+                *bin_nedges < 3 || e[0] < 0 || e[0] >= RGE_VARS_SIZE ||
+                e[0] != static_cast<int>(e[0])
+        ) {
+            rge_errno = RGEERR_BADBINEDGES;
+            return 1;
+        }
+        for (luint edge_i = 2; edge_i < *bin_nedges; ++edge_i) {
+            if (e[edge_i] > e[edge_i-1]) continue;
+            rge_errno = RGEERR_BADBINEDGES;
+            return 1;
+        }
+    }
+
     // Check positional argument.
     if (*in_filename == NULL) {
         rge_errno = RGEERR_NOINPUTFILE;
@@ -1048,6 +1100,8 @@ int main(int argc, char **argv) {
     lint sel_pid          = 0;
     bool apply_all_cuts   = false;
     lint binning_setup[4] = {-1, -1, -1, -1};
+    luint bin_nedges      = 0;
+    double *bin_edges     = NULL;
     lint nentries         = -1;
     char *out_filename    = NULL;
     char *acc_filename    = NULL;
@@ -1057,16 +1111,17 @@ int main(int argc, char **argv) {
     int  run_no           = -1;
 
     int err = handle_args(
-            argc, argv, &sel_pid, &apply_all_cuts, binning_setup, &nentries,
-            &out_filename, &acc_filename, &apply_acc_corr, &work_dir,
-            &in_filename, &run_no
+            argc, argv, &sel_pid, &apply_all_cuts, binning_setup, &bin_nedges,
+            &bin_edges, &nentries, &out_filename, &acc_filename,
+            &apply_acc_corr, &work_dir, &in_filename, &run_no
     );
 
     // Run.
     if (rge_errno == RGEERR_UNDEFINED && err == 0) {
         run(
                 in_filename, out_filename, acc_filename, work_dir, run_no,
-                nentries, sel_pid, apply_all_cuts, apply_acc_corr, binning_setup
+                nentries, sel_pid, apply_all_cuts, apply_acc_corr,
+                binning_setup, bin_nedges, bin_edges
         );
     }
 
@@ -1075,6 +1130,7 @@ int main(int argc, char **argv) {
     if (out_filename != NULL) free(out_filename);
     if (acc_filename != NULL) free(acc_filename);
     if (work_dir     != NULL) free(work_dir);
+    if (bin_edges    != NULL) free(bin_edges);
 
     // Return errcode.
     return rge_print_usage(USAGE_MESSAGE);
@@ -24,14 +24,29 @@
 #include "../lib/rge_io_handler.h"
 
 static const char *USAGE_MESSAGE =
-"Usage: extract_sf [-hn:w:d:] infile\n"
+"Usage: extract_sf [-hn:w:d:psj:o:m] infile [infile ...]\n"
 " * -h         : show this message and exit.\n"
 " * -n nevents : number of events\n"
 " * -w workdir : location where output root files are to be stored. Default\n"
 "                is root_io.\n"
 " * -d datadir : location where sampling fraction files are stored. Default\n"
 "                is data.\n"
-" * infile     : input ROOT file. Expected file format: <text>run_no.root.\n\n"
+" * -p         : project the E/p histogram of each momentum bin from the p\n"
+"                vs E/p histogram instead of filling it separately.\n"
+" * -s         : start every E/p fit from fixed parameters instead of\n"
+"                estimating them from the histogram moments. Slower, meant to\n"
+"                compare the fit statistics printed at the end.\n"
+" * -j nthreads: number of threads used to fit the sampling fraction. The\n"
+"                output is the same for any number of threads. Default is 1.\n"
+" * -o outfile : write the filled histograms to a partial file instead of\n"
+"                fitting them. Partial files of the same run are merged and\n"
+"                fitted with -m.\n"
+" * -m         : merge mode. Add up the histograms of the partial files given\n"
+"                as infiles and fit them. If -o is set, the merged histograms\n"
+"                are written to a new partial file instead.\n"
+" * infile     : input ROOT or HIPO file. Expected file format:\n"
+"                <text>run_no.root or <text>run_no.hipo. With -m, one or more\n"
+"                partial files.\n\n"
 "    Obtain the EC sampling fraction from an input file.\n";
 
 /**
@@ -39,12 +54,14 @@ static const char *USAGE_MESSAGE =
  *     explained in the handle_err() function.
  */
 static int handle_args(
-        int argc, char **argv, char **in_filename, char **work_dir,
-        char **data_dir, int *run_no, lint *nevn
+        int argc, char **argv, char ***in_filenames, int *n_in,
+        char **work_dir, char **data_dir, int *run_no, lint *nevn,
+        bool *project, bool *fixed_seeds, lint *nthreads,
+        char **partial_filename, bool *merge
 ) {
     // Handle optional arguments.
     int opt;
-    while ((opt = getopt(argc, argv, "-hn:w:d:")) != -1) {
+    while ((opt = getopt(argc, argv, "-hn:w:d:psj:o:m")) != -1) {
         switch (opt) {
             case 'h':
                 rge_errno = RGEERR_USAGE;
@@ -60,9 +77,32 @@ static int handle_args(
                 *data_dir = static_cast<char *>(malloc(strlen(optarg) + 1));
                 strcpy(*data_dir, optarg);
                 break;
+            case 'p':
+                *project = true;
+                break;
+            case 's':
+                *fixed_seeds = true;
+                break;
+            case 'j':
+                if (rge_process_nthreads(nthreads, optarg)) return 1;
+                break;
+            case 'o':
+                *partial_filename =
+                        static_cast<char *>(malloc(strlen(optarg) + 1));
+                strcpy(*partial_filename, optarg);
+                break;
+            case 'm':
+                *merge = true;
+                break;
             case 1:
-                *in_filename = static_cast<char *>(malloc(strlen(optarg) + 1));
-                strcpy(*in_filename, optarg);
+                *in_filenames = static_cast<char **>(realloc(
+                        *in_filenames,
+                        static_cast<luint>(*n_in + 1) * sizeof(**in_filenames)
+                ));
+                (*in_filenames)[*n_in] =
+                        static_cast<char *>(malloc(strlen(optarg) + 1));
+                strcpy((*in_filenames)[*n_in], optarg);
+                ++(*n_in);
                 break;
             default:
                 rge_errno = RGEERR_BADOPTARGS;
@@ -84,14 +124,26 @@ static int handle_args(
         sprintf(*data_dir, "%s/../data", dirname(tmpfile));
     }
 
-    // Check positional argument.
-    if (*in_filename == NULL) {
+    // Check positional arguments.
+    if (*n_in == 0) {
         rge_errno = RGEERR_NOINPUTFILE;
         return 1;
     }
 
+    // In merge mode, the run number is stored in the partial files.
+    if (*merge) {
+        for (int file_i = 0; file_i < *n_in; ++file_i) {
+            if (rge_check_root_filename((*in_filenames)[file_i])) return 1;
+        }
+        return 0;
+    }
+
     // Handle input filename.
-    if (rge_handle_root_filename(*in_filename, run_no)) return 1;
+    if (*n_in > 1) {
+        rge_errno = RGEERR_BADOPTARGS;
+        return 1;
+    }
+    if (rge_handle_input_filename((*in_filenames)[0], run_no)) return 1;
 
     return 0;
 }
@@ -99,25 +151,47 @@ static int handle_args(
 /** Entry point of the program. */
 int main(int argc, char **argv) {
     // Handle arguments.
-    char *in_filename = NULL;
-    char *work_dir    = NULL;
-    char *data_dir    = NULL;
-    lint nevn         = -1;
-    int run_no        = -1;
+    char **in_filenames    = NULL;
+    int n_in               = 0;
+    char *work_dir         = NULL;
+    char *data_dir         = NULL;
+    lint nevn              = -1;
+    int run_no             = -1;
+    bool project           = false;
+    bool fixed_seeds       = false;
+    lint nthreads          = 1;
+    char *partial_filename = NULL;
+    bool merge             = false;
 
     int err = handle_args(
-            argc, argv, &in_filename, &work_dir, &data_dir, &run_no, &nevn
+            argc, argv, &in_filenames, &n_in, &work_dir, &data_dir, &run_no,
+            &nevn, &project, &fixed_seeds, &nthreads, &partial_filename,
+            &merge
     );
 
     // Run.
     if (rge_errno == RGEERR_UNDEFINED && err == 0) {
-        rge_extract_sf(in_filename, work_dir, data_dir, nevn, run_no);
+        if (merge) {
+            rge_merge_sf(
+                    in_filenames, n_in, work_dir, data_dir, fixed_seeds,
+                    static_cast<int>(nthreads), partial_filename
+            );
+        }
+        else {
+            rge_extract_sf(
+                    in_filenames[0], work_dir, data_dir, nevn, run_no,
+                    project, fixed_seeds, static_cast<int>(nthreads),
+                    partial_filename
+            );
+        }
     }
 
     // Free up memory.
-    if (in_filename != NULL) free(in_filename);
-    if (work_dir    != NULL) free(work_dir);
-    if (data_dir    != NULL) free(data_dir);
+    for (int file_i = 0; file_i < n_in; ++file_i) free(in_filenames[file_i]);
+    if (in_filenames     != NULL) free(in_filenames);
+    if (work_dir         != NULL) free(work_dir);
+    if (data_dir         != NULL) free(data_dir);
+    if (partial_filename != NULL) free(partial_filename);
 
     // Return errcode.
     return rge_print_usage(USAGE_MESSAGE);
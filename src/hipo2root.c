@@ -16,8 +16,17 @@
 // C.
 #include <libgen.h>
 
+// C++.
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 // ROOT.
 #include "TFile.h"
+#include "TROOT.h"
 #include "TTree.h"
 
 // HIPO.
@@ -25,6 +34,7 @@
 #include "dictionary.h"
 #include "event.h"
 #include "reader.h"
+#include "record.h"
 
 // rge-analysis.
 #include "../lib/rge_constants.h"
@@ -35,7 +45,7 @@
 #include "../lib/rge_progress.h"
 
 static const char *USAGE_MESSAGE =
-"Usage: hipo2root [-hfn:w:] infile\n"
+"Usage: hipo2root [-hfn:w:j:o] infile\n"
 " * -h         : show this message and exit.\n"
 " * -f         : set this to true to process FMT::Tracks bank. If this is set\n"
 "                and FMT::Tracks bank is not present in the HIPO file, the\n"
@@ -43,6 +53,9 @@ static const char *USAGE_MESSAGE =
 " * -n nevents : number of events.\n"
 " * -w workdir : location where output root files are to be stored. Default\n"
 "                is root_io.\n"
+" * -j nthreads: number of threads used to decode HIPO records. Default is 1.\n"
+" * -o         : preserve the event order of the input file when using -j.\n"
+"                Order is always preserved if -n is set.\n"
 " * infile     : input HIPO file. Expected format is <text>run_no.hipo.\n\n"
 "    Convert a file from hipo to root format. This program only conserves the\n"
 "    banks that are useful for RG-E analysis, as specified in the\n"
@@ -58,10 +71,211 @@ static const char *BANKLIST[NBANKS] = {
     RGE_RECSCINTILLATOR, RGE_FMTTRACKS
 };
 
+/** Number of decoded records allowed to wait for the writer, per thread. */
+static const int RECORD_WINDOW = 4;
+
+/**
+ * Events of one HIPO record, decoded and packed by a worker thread.
+ *
+ * @param nevents : number of events in the record.
+ * @param buf     : rows of every bank for every event, written by rge_pack().
+ * @param err     : rge_errno of the worker if the record couldn't be decoded,
+ *                  RGEERR_NOERR otherwise.
+ */
+typedef struct {
+    int nevents;
+    std::vector<char> buf;
+    uint err;
+} record_chunk;
+
+/**
+ * State shared between the writer and the worker threads. Workers take the
+ *     next record from next_record and leave the decoded chunk in ready,
+ *     keyed by record number. If ordered is set, the writer takes chunks in
+ *     record order. Otherwise, it takes whichever chunk is ready first.
+ */
+typedef struct {
+    const char *in_filename;
+    uint nbanks;
+    int nrecords;
+    int window;
+    bool ordered;
+    std::atomic<int> next_record;
+    std::mutex mtx;
+    std::condition_variable cv_ready;
+    std::condition_variable cv_space;
+    std::map<int, record_chunk> ready;
+    int next_write;
+    bool stop;
+} convert_state;
+
+/**
+ * Worker thread. Open its own HIPO reader and decode records into chunks
+ *     until there are no records left or the writer asks to stop.
+ */
+static void convert_records(convert_state *st) {
+    hipo::reader reader;
+    hipo::dictionary factory;
+    hipo::record record;
+    hipo::event event;
+
+    reader.open(st->in_filename);
+    reader.readDictionary(factory);
+
+    hipo::bank   hbanks[NBANKS];
+    rge_hipobank rbanks[NBANKS];
+    uint setup_err = RGEERR_NOERR;
+    for (uint i = 0; i < st->nbanks; ++i) {
+        hbanks[i] = hipo::bank(factory.getSchema(BANKLIST[i]));
+        rbanks[i] = rge_hipobank_init(BANKLIST[i]);
+        if (rge_link_schema(&(rbanks[i]), &(hbanks[i].getSchema()))) {
+            setup_err = rge_errno;
+        }
+    }
+
+    while (true) {
+        int r = st->next_record++;
+        if (r >= st->nrecords) break;
+
+        // Wait until the writer has room for this record.
+        {
+            std::unique_lock<std::mutex> lock(st->mtx);
+            st->cv_space.wait(lock, [st, r] {
+                if (st->stop) return true;
+                if (st->ordered) return r < st->next_write + st->window;
+                return static_cast<int>(st->ready.size()) < st->window;
+            });
+            if (st->stop) break;
+        }
+
+        // Decode record.
+        record_chunk chunk;
+        chunk.nevents = 0;
+        chunk.err     = setup_err;
+        if (chunk.err == RGEERR_NOERR) {
+            reader.loadRecord(record, r);
+            chunk.nevents = record.getEventCount();
+        }
+        for (int ev = 0; ev < chunk.nevents; ++ev) {
+            if (chunk.err != RGEERR_NOERR) break;
+            record.readHipoEvent(event, ev);
+            for (uint i = 0; i < st->nbanks; ++i) {
+                event.getStructure(hbanks[i]);
+                if (rge_fill(&(rbanks[i]), &(hbanks[i]))) {
+                    chunk.err = rge_errno;
+                    break;
+                }
+                rge_pack(&(rbanks[i]), &(chunk.buf));
+            }
+        }
+
+        // Hand chunk to the writer.
+        {
+            std::lock_guard<std::mutex> lock(st->mtx);
+            st->ready[r] = std::move(chunk);
+        }
+        st->cv_ready.notify_one();
+    }
+
+    for (uint i = 0; i < st->nbanks; ++i) rge_hipobank_free(&(rbanks[i]));
+}
+
+/**
+ * Convert events using nthreads worker threads to decode HIPO records, while
+ *     the calling thread fills out_tree.
+ *
+ * @param in_filename : input HIPO file.
+ * @param nbanks      : number of banks from BANKLIST to convert.
+ * @param rbanks      : rge_hipobanks linked to out_tree.
+ * @param out_tree    : output TTree.
+ * @param nthreads    : number of worker threads.
+ * @param ordered     : if true, fill out_tree in the input file's order.
+ * @param nrecords    : number of records in the input file.
+ * @param nevents     : number of events to convert.
+ * @return            : error code. 0 if successful, 1 otherwise.
+ */
+static int convert_parallel(
+        const char *in_filename, uint nbanks, rge_hipobank *rbanks,
+        TTree *out_tree, lint nthreads, bool ordered, int nrecords,
+        lint nevents
+) {
+    convert_state st;
+    st.in_filename = in_filename;
+    st.nbanks      = nbanks;
+    st.nrecords    = nrecords;
+    st.window      = RECORD_WINDOW * static_cast<int>(nthreads);
+    st.ordered     = ordered;
+    st.next_record = 0;
+    st.next_write  = 0;
+    st.stop        = false;
+
+    std::vector<std::thread> workers;
+    for (lint t = 0; t < nthreads; ++t) {
+        workers.emplace_back(convert_records, &st);
+    }
+
+    uint err = RGEERR_NOERR;
+    lint event_no = 0;
+    for (int r = 0; r < nrecords && event_no < nevents; ++r) {
+        // Get next chunk.
+        record_chunk chunk;
+        {
+            std::unique_lock<std::mutex> lock(st.mtx);
+            st.cv_ready.wait(lock, [&st] {
+                if (st.ordered) return st.ready.count(st.next_write) > 0;
+                return !st.ready.empty();
+            });
+            std::map<int, record_chunk>::iterator it = st.ordered ?
+                    st.ready.find(st.next_write) : st.ready.begin();
+            chunk = std::move(it->second);
+            st.ready.erase(it);
+            ++st.next_write;
+        }
+        st.cv_space.notify_all();
+
+        if (chunk.err != RGEERR_NOERR) {
+            err = chunk.err;
+            break;
+        }
+
+        // Write events to tree *if* they're not empty.
+        luint pos = 0;
+        for (int ev = 0; ev < chunk.nevents && event_no < nevents; ++ev) {
+            rge_pbar_update(event_no);
+            ++event_no;
+
+            luint total_nrows = 0;
+            for (uint i = 0; i < nbanks && err == RGEERR_NOERR; ++i) {
+                if (rge_unpack(&(rbanks[i]), &(chunk.buf), &pos)) {
+                    err = rge_errno;
+                }
+                total_nrows += rbanks[i].nrows;
+            }
+            if (err != RGEERR_NOERR) break;
+            if (total_nrows > 0) out_tree->Fill();
+        }
+        if (err != RGEERR_NOERR) break;
+    }
+
+    // Stop workers and wait for them to finish.
+    {
+        std::lock_guard<std::mutex> lock(st.mtx);
+        st.stop = true;
+    }
+    st.cv_space.notify_all();
+    for (std::thread &worker : workers) worker.join();
+
+    if (err != RGEERR_NOERR) {
+        rge_errno = err;
+        return 1;
+    }
+    return 0;
+}
+
 /** run() function of the program. Check USAGE_MESSAGE for details. */
 static int run(
         char *in_filename, char *work_dir, bool use_fmt, int run_no,
-        lint nevents
+        lint nevents, lint nthreads, bool keep_order
 ) {
     // Number of banks to read/write depends on type of analysis.
     uint nbanks = use_fmt ? NBANKS : NBANKS_NOFMT;
@@ -74,13 +288,14 @@ static int run(
     reader.open(in_filename);
     reader.readDictionary(factory);
 
-    // Create output tree and file.
-    TTree *out_tree = new TTree(RGE_TREENAMEDATA, RGE_TREENAMEDATA);
-
+    // Create output file and tree. The tree is created after the file so
+    //     that its baskets are flushed to disk as they fill.
     char out_filename[PATH_MAX];
     sprintf(out_filename, "%s/banks_%06d.root", work_dir, run_no);
     TFile *out_file = TFile::Open(out_filename, "RECREATE");
 
+    TTree *out_tree = new TTree(RGE_TREENAMEDATA, RGE_TREENAMEDATA);
+
     // Open input file and get hipo schemas.
     hipo::bank   hbanks[nbanks];
     rge_hipobank rbanks[nbanks];
@@ -92,17 +307,34 @@ static int run(
         // Initialize rge banks.
         rbanks[i] = rge_hipobank_init(BANKLIST[i]);
         if (rge_errno != RGEERR_UNDEFINED) return 1;
+        if (rge_link_schema(&(rbanks[i]), &(hbanks[i].getSchema()))) return 1;
         rge_link_branches(&(rbanks[i]), out_tree);
     }
 
-    // Get event count.
+    // Get event count. Limiting the number of events requires keeping their
+    //     order.
     if (nevents == -1 || nevents > reader.getEntries())
         nevents = reader.getEntries();
+    else
+        keep_order = true;
     printf("Reading %ld events from %s.\n", nevents, in_filename);
 
     // Prepare fancy progress bar.
     rge_pbar_set_nentries(nevents);
 
+    if (nthreads > 1) {
+        // Compress output baskets in parallel too.
+        ROOT::EnableImplicitMT(static_cast<UInt_t>(nthreads));
+
+        if (convert_parallel(
+                in_filename, nbanks, rbanks, out_tree, nthreads, keep_order,
+                reader.getNRecords(), nevents
+        )) return 1;
+
+        // Skip the sequential loop below.
+        nevents = 0;
+    }
+
     for (int event_no = 0; event_no < nevents; ++event_no) {
         // Print fancy progress bar.
         rge_pbar_update(event_no);
@@ -115,7 +347,7 @@ static int run(
         luint total_nrows = 0;
         for (uint i = 0; i < nbanks; ++i) {
             event.getStructure(hbanks[i]);
-            if (rge_fill(&(rbanks[i]), hbanks[i])) return 1;
+            if (rge_fill(&(rbanks[i]), &(hbanks[i]))) return 1;
             total_nrows += rbanks[i].nrows;
         }
 
@@ -126,6 +358,7 @@ static int run(
     // Write to root tree and clean up after ourselves.
     out_tree->Write();
     out_file->Close();
+    for (uint i = 0; i < nbanks; ++i) rge_hipobank_free(&(rbanks[i]));
 
     rge_errno = RGEERR_NOERR;
     return 0;
@@ -137,11 +370,12 @@ static int run(
  */
 static int handle_args(
         int argc, char **argv, char **in_filename, char **work_dir,
-        bool *use_fmt, int *run_no, lint *nevents
+        bool *use_fmt, int *run_no, lint *nevents, lint *nthreads,
+        bool *keep_order
 ) {
     // Handle arguments.
     int opt;
-    while ((opt = getopt(argc, argv, "-hfn:w:")) != -1) {
+    while ((opt = getopt(argc, argv, "-hfn:w:j:o")) != -1) {
         switch (opt) {
             case 'h':
                 rge_errno = RGEERR_USAGE;
@@ -156,6 +390,12 @@ static int handle_args(
                 *work_dir = static_cast<char *>(malloc(strlen(optarg) + 1));
                 strcpy(*work_dir, optarg);
                 break;
+            case 'j':
+                if (rge_process_nthreads(nthreads, optarg)) return 1;
+                break;
+            case 'o':
+                *keep_order = true;
+                break;
             case 1:
                 *in_filename = static_cast<char *>(malloc(strlen(optarg) + 1));
                 strcpy(*in_filename, optarg);
@@ -191,14 +431,20 @@ int main(int argc, char **argv) {
     bool use_fmt       = false;
     int  run_no        = -1;
     lint nevents       = -1;
+    lint nthreads      = 1;
+    bool keep_order    = false;
 
     handle_args(
-            argc, argv, &in_filename, &work_dir, &use_fmt, &run_no, &nevents
+            argc, argv, &in_filename, &work_dir, &use_fmt, &run_no, &nevents,
+            &nthreads, &keep_order
     );
 
     // Run.
     if (rge_errno == RGEERR_UNDEFINED) {
-        run(in_filename, work_dir, use_fmt, run_no, nevents);
+        run(
+                in_filename, work_dir, use_fmt, run_no, nevents, nthreads,
+                keep_order
+        );
     }
 
     // Free up memory.
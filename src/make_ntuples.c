@@ -17,24 +17,37 @@
 #include <libgen.h>
 #include <limits.h>
 
+// C++.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 // ROOT.
 #include <TFile.h>
-#include <TNtuple.h>
 #include <TROOT.h>
+#include <TTree.h>
 
 // rge-analysis.
 #include "../lib/rge_constants.h"
+#include "../lib/rge_detector.h"
 #include "../lib/rge_err_handler.h"
+#include "../lib/rge_event_loader.h"
 #include "../lib/rge_extract_sf.h"
 #include "../lib/rge_file_handler.h"
 #include "../lib/rge_filename_handler.h"
 #include "../lib/rge_hipo_bank.h"
 #include "../lib/rge_io_handler.h"
+#include "../lib/rge_ntuple.h"
 #include "../lib/rge_particle.h"
 #include "../lib/rge_progress.h"
 
 static const char *USAGE_MESSAGE =
-"Usage: make_ntuples [-hDf:cn:w:d:] infile\n"
+"Usage: make_ntuples [-hDf:cn:w:d:j:v:e] infile\n"
 " * -h         : show this message and exit.\n"
 " * -D         : activate debug mode.\n"
 " * -f fmtlyrs : define how many FMT layers should the track have hit.\n"
@@ -46,19 +59,25 @@ static const char *USAGE_MESSAGE =
 " * -w workdir : location where output root files are to be stored. Default\n"
 "                is root_io.\n"
 " * -d datadir : location where sampling fraction files are. Default is data.\n"
-" * infile     : input ROOT file. Expected file format: <text>run_no.root`.\n\n"
+" * -j nthreads: number of threads used to process events. The output is the\n"
+"                same for any number of threads. Default is 1.\n"
+" * -v vars    : comma-separated list of variables to write. Profiles can be\n"
+"                used too: all, electron (trigger electron kinematics and\n"
+"                vertex), and sidis (electron plus hadron variables).\n"
+"                Example: -v electron,z_h. Default is all.\n"
+" * -e         : write one entry per event instead of one per particle. Event\n"
+"                variables (run_num, event_num, E_beam, and DIS variables)\n"
+"                are stored once, and the rest as arrays of size npart.\n"
+" * infile     : input ROOT or HIPO file. Expected file format:\n"
+"                <text>run_no.root or <text>run_no.hipo.\n\n"
 "    Generate ntuples relevant to SIDIS analysis based on the reconstructed\n"
 "    variables from CLAS12 data.\n";
 
-/** Detector IDs from CLAS12 reconstruction. */
-static const uint FTOF_ID = 12;
-static const uint HTCC_ID = 15;
-static const uint LTCC_ID = 16;
-
-/** FTOF layer IDs from CLAS12 reconstruction. */
-static const uint FTOF1A_LYR = 1;
-static const uint FTOF1B_LYR = 2;
-static const uint FTOF2_LYR  = 3;
+/** Bank columns read by make_ntuples, on top of the ones read by modules. */
+static const uint PART_COLS = RGE_PARTICLE_PARTCOLS |
+        RGE_COL(RGE_PART_PID) | RGE_COL(RGE_PART_STATUS);
+static const uint TRK_COLS  = RGE_PARTICLE_TRKCOLS |
+        RGE_COL(RGE_TRK_NDF) | RGE_COL(RGE_TRK_CHI2);
 
 /** FMT geometry cut constants. */
 static const double FMTCUT_RMIN  =  4.2575;
@@ -67,206 +86,654 @@ static const double FMTCUT_Z0    = 26.1197;
 static const double FMTCUT_ANGLE = 57.29;
 
 /**
- * Find and return the most precise time of flight (TOF). Both the Forward Time
- *     Of Flight (FTOF) detectors and the Electronic Calorimeter (EC) can
- *     measure TOF, but they have different precisions. So, in order to get the
- *     most accurate measurement possible, this function returns the TOF
- *     measured by the most accurate detector for a given particle.
+ * Apply FMT geometry cut on a particle. This cut is defined by the particle's
+ *     vz and its theta angle. theta_min and theta_max are given by:
+ *     theta_min = 57.29 * atan(FMTCUT_RMIN / (FMTCUT_Z0 - vz)),
+ *     theta_max = 57.29 * atan(FMTCUT_RMAX / (FMTCUT_Z0 - vz)),
+ *     where FMTCUT_RMIN and FMTCUT_RMAX are the radii of the inner and outer
+ *     circles of FMT, and FMTCUT_Z0 is the z position of the first FMT layer.
  *
- * In order of decreasing precision, the list of detectors are:
- *     FTOF1B > FTOF1A > FTOF2 > PCAL > ECIN > ECOU.
+ * @param p : particle for which we're applying the cut.
+ * @return  : 0 if particle passes the cut, 1 otherwise, 2 if there's an angle
+ *            conversion error.
+ */
+static int apply_fmtgeomtry_cut(rge_particle *p) {
+    // Get minimum theta allowed for particle.
+    double theta_min;
+    if (rge_to_rad(
+            FMTCUT_ANGLE * atan(FMTCUT_RMIN / (FMTCUT_Z0 - p->vz)),
+            &theta_min
+    )) return 2;
+
+    // Get maximum theta allowed for particle.
+    double theta_max;
+    if (rge_to_rad(
+            FMTCUT_ANGLE * atan(FMTCUT_RMAX / (FMTCUT_Z0 - p->vz)),
+            &theta_max
+    )) return 2;
+
+    // Get particle's theta.
+    double theta = atan2(sqrt(p->px*p->px + p->py*p->py), p->pz);
+
+    // Return 1 if particle fails.
+    if (theta_min > theta || theta > theta_max) return 1;
+
+    // Return 0 otherwise.
+    return 0;
+}
+
+/** Number of events in each unit of work of the event loop. */
+static const lint CHUNK_NEVENTS = 10000;
+
+/** Number of processed chunks allowed to wait for the writer, per thread. */
+static const lint CHUNK_WINDOW = 4;
+
+/**
+ * Output tree buffering, in bytes. Baskets are flushed to the output file
+ *     every OUT_AUTOFLUSH bytes, and the tree header is saved every
+ *     OUT_AUTOSAVE bytes so that a crash doesn't lose what was written.
+ *     Negative values are interpreted as bytes by ROOT.
+ */
+static const Long64_t OUT_AUTOFLUSH = -30000000;
+static const Long64_t OUT_AUTOSAVE  = -300000000;
+
+/**
+ * Maximum size of the track buffer kept while extracting the sampling fraction,
+ *     in bytes. Above it, the input is read a second time instead.
+ */
+static const luint FUSED_MAXBYTES = 2lu << 30;
+
+/**
+ * Seconds between touches of the sampling fraction lock while fitting, which
+ *     can take longer than the time after which a lock is taken as stale.
+ */
+static const int SFLOCK_TOUCH = 60;
+
+/**
+ * Keeper of the sampling fraction lock. Touches the lock every SFLOCK_TOUCH
+ *     seconds from its own thread until stop is set.
+ */
+typedef struct {
+    const char *sf_filename;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stop;
+} sflock_keeper;
+
+/** Settings of the event loop, shared by all threads. */
+typedef struct {
+    const char *filename_in;
+    lint fmt_nlayers;
+    bool fmt_cut;
+    int run_no;
+    double energy_beam;
+    luint varmask;
+    double (*sf_params)[RGE_NSFPARAMS][2];
+} ntuples_opts;
+
+/**
+ * Data of a valid track needed to assign its PID and fill its ntuple row. Kept
+ *     apart from the banks so that events can be buffered and processed after
+ *     reading them.
+ */
+typedef struct {
+    rge_particle part;
+    int recon_pid, status, ndf, nphe_HTCC, nphe_LTCC;
+    uint sector;
+    float chi2;
+    double energy_PCAL, energy_ECIN, energy_ECOU, tof;
+} ntuples_track;
+
+/**
+ * Input of one event loop: an event loader and the banks it fills. Must not be
+ *     moved after open_input(), since the loader points to the banks.
+ */
+typedef struct {
+    rge_eventloader loader;
+    rge_hipobank bpart, btrk, bcal, bchkv, bsci, bfmt;
+    std::vector<rge_detsummary> detsummaries;
+    std::vector<ntuples_track> tracks;
+} ntuples_input;
+
+/**
+ * Valid tracks of the events read while extracting the sampling fraction, so
+ *     that the ntuples can be filled without reading the input again.
  *
- * @param scintillator : pointer to rge_hipobank containing scintillator data.
- * @param calorimeter  : pointer to rge_hipobank containing calorimeter data.
- * @param pindex       : particle index of the particle we're studying.
- * @return             : the most accurate TOF available in the scintillator and
- *                       calorimeter banks.
+ * @param tracks   : tracks of all buffered events, in event order.
+ * @param offsets  : index in tracks of the first track of each event, plus the
+ *                   total number of tracks at the end.
+ * @param events   : event number of each buffered event.
+ * @param complete : false if the buffer was dropped for going over
+ *                   FUSED_MAXBYTES.
  */
-static double get_tof(
-        rge_hipobank *scintillator, rge_hipobank *calorimeter, uint pindex
-) {
-    int    most_precise_lyr = 0;
-    double tof              = INFINITY;
+typedef struct {
+    std::vector<ntuples_track> tracks;
+    std::vector<luint> offsets;
+    std::vector<lint> events;
+    bool complete;
+} ntuples_buffer;
 
-    // Find TOF from scintillator.
-    for (uint i = 0; i < scintillator->nrows; ++i) {
-        // Filter out incorrect pindex and hits not from FTOF.
-        if (
-                rge_get_uint(scintillator, "pindex", i)   != pindex ||
-                rge_get_uint(scintillator, "detector", i) != FTOF_ID
-        ) {
-            continue;
-        }
+/**
+ * Output of the event loop over one range of events.
+ *
+ * @param rows            : ntuple rows, RGE_VARS_SIZE values each, in event
+ *                          order.
+ * @param trigger_counter : number of trigger electrons found.
+ * @param pionp_counter   : number of positive pions found.
+ * @param pionm_counter   : number of negative pions found.
+ * @param err             : rge_errno of the thread that processed the range if
+ *                          it failed, RGEERR_NOERR otherwise.
+ */
+typedef struct {
+    std::vector<rge_varval> rows;
+    int trigger_counter;
+    int pionp_counter;
+    int pionm_counter;
+    uint err;
+} ntuples_chunk;
 
-        uint layer  = rge_get_uint(scintillator, "layer", i);
-        double time = rge_get_double(scintillator, "time", i);
+/**
+ * State shared between the writer and the worker threads. Workers take the
+ *     next chunk of events from next_chunk and leave their output in ready,
+ *     keyed by chunk number. The writer takes chunks in order. If buf isn't
+ *     NULL, chunks are taken from the buffered events instead of the input,
+ *     and n_events is the number of buffered events.
+ */
+typedef struct {
+    const ntuples_opts *opts;
+    const ntuples_buffer *buf;
+    lint n_events;
+    lint nchunks;
+    lint window;
+    std::atomic<lint> next_chunk;
+    std::atomic<lint> bytes_read;
+    std::mutex mtx;
+    std::condition_variable cv_ready;
+    std::condition_variable cv_space;
+    std::map<lint, ntuples_chunk> ready;
+    lint next_write;
+    bool stop;
+} ntuples_state;
 
-        // Check FTOF 1B (most precise FTOF layer).
-        if (layer == FTOF1B_LYR) {
-            most_precise_lyr = FTOF1B_LYR;
-            tof = time;
-            break; // Things won't get better than this.
-        }
+/**
+ * Output tree of make_ntuples and its branch addresses.
+ *
+ * @param tree     : output tree.
+ * @param is_event : true if writing one entry per event instead of one entry
+ *                   per particle.
+ * @param row      : branch addresses in the particle layout.
+ * @param ev       : branch addresses in the event layout.
+ */
+typedef struct {
+    TTree *tree;
+    bool is_event;
+    rge_varval row[RGE_VARS_SIZE];
+    rge_eventrow ev;
+} ntuples_output;
 
-        // Check FTOF 1A.
-        else if (layer == FTOF1A_LYR) {
-            if (most_precise_lyr == FTOF1A_LYR) continue;
-            most_precise_lyr = FTOF1A_LYR;
-            tof = time;
-        }
+/**
+ * Open the input file and link the banks used by the event loop. If sf_study
+ *     is true, also link the columns read by rge_sfstudy_fill().
+ */
+static int open_input(
+        ntuples_input *in, const ntuples_opts *opts, bool sf_study
+) {
+    in->bpart = rge_hipobank_init(RGE_RECPARTICLE);
+    in->btrk  = rge_hipobank_init(RGE_RECTRACK);
+    in->bcal  = rge_hipobank_init(RGE_RECCALORIMETER);
+    in->bchkv = rge_hipobank_init(RGE_RECCHERENKOV);
+    in->bsci  = rge_hipobank_init(RGE_RECSCINTILLATOR);
+    in->bfmt  = rge_hipobank_init(RGE_FMTTRACKS);
 
-        // Check FTOF 2.
-        else if (layer == FTOF2_LYR) {
-            // We already have a similar or better hit.
-            if (most_precise_lyr != 0) continue;
-            most_precise_lyr = FTOF2_LYR;
-            tof = time;
-        }
+    // Access input file, either a hipo2root output or a HIPO file.
+    rge_eventloader *l = &(in->loader);
+    if (rge_loader_open(l, opts->filename_in)) return 1;
+
+    // If fmt_nlayers != 0, check that FMT::Tracks bank exists.
+    if (opts->fmt_nlayers != 0 && !rge_loader_has_bank(l, RGE_FMTTRACKS)) {
+        rge_errno = RGEERR_NOFMTBANK;
+        return 1;
     }
-    if (most_precise_lyr != 0) return tof;
 
-    // If no hits from FTOF were found, try to find TOF from calorimeters.
-    for (uint i = 0; i < calorimeter->nrows; ++i) {
-        // Filter out incorrect pindex.
-        if (rge_get_uint(calorimeter, "pindex", i) != pindex) continue;
+    // Associate banks to input file.
+    uint part_cols = PART_COLS;
+    uint trk_cols  = TRK_COLS;
+    uint cal_cols  = RGE_DETSUMMARY_CALCOLS;
+    if (sf_study) {
+        part_cols |= RGE_SFSTUDY_PARTCOLS;
+        trk_cols  |= RGE_SFSTUDY_TRKCOLS;
+        cal_cols  |= RGE_SFSTUDY_CALCOLS;
+    }
+    if (
+            rge_loader_add_bank(l, &(in->bpart), part_cols)               ||
+            rge_loader_add_bank(l, &(in->btrk),  trk_cols)                ||
+            rge_loader_add_bank(l, &(in->bcal),  cal_cols)                ||
+            rge_loader_add_bank(l, &(in->bchkv), RGE_DETSUMMARY_CHKVCOLS) ||
+            rge_loader_add_bank(l, &(in->bsci),  RGE_DETSUMMARY_SCICOLS)
+    ) return 1;
+    if (
+            opts->fmt_nlayers != 0 &&
+            rge_loader_add_bank(l, &(in->bfmt), RGE_PARTICLE_FMTCOLS)
+    ) return 1;
 
-        // Check PCAL (Calorimeter with the most precise TOF).
-        uint layer  = rge_get_uint(calorimeter, "layer", i);
-        double time = rge_get_double(calorimeter, "time", i);
+    return 0;
+}
 
-        if (layer == PCAL_LYR) {
-            most_precise_lyr = 10 + PCAL_LYR;
-            tof = time;
-            break; // Things won't get better than this.
-        }
+/** Close the input file and free the banks used by the event loop. */
+static int close_input(ntuples_input *in) {
+    rge_loader_close(&(in->loader));
+    rge_hipobank_free(&(in->bpart));
+    rge_hipobank_free(&(in->btrk));
+    rge_hipobank_free(&(in->bcal));
+    rge_hipobank_free(&(in->bchkv));
+    rge_hipobank_free(&(in->bsci));
+    rge_hipobank_free(&(in->bfmt));
 
-        // Check ECIN.
-        else if (layer == ECIN_LYR) {
-            if (most_precise_lyr == 10 + ECIN_LYR) continue;
-            most_precise_lyr = 10 + ECIN_LYR;
-            tof = time;
-        }
+    return 0;
+}
 
-        // Check ECOU.
-        else if (layer == ECOU_LYR) {
-            if (most_precise_lyr != 0) continue;
-            most_precise_lyr = 10 + ECOU_LYR;
-            tof = time;
+/**
+ * Append the valid tracks of the event currently loaded in the input to
+ *     tracks, along with their detector data. Tracks cut by the FMT geometry
+ *     cut are skipped.
+ */
+static int read_tracks(
+        ntuples_input *in, const ntuples_opts *opts,
+        std::vector<ntuples_track> *tracks
+) {
+    rge_hipobank *bpart = &(in->bpart);
+    rge_hipobank *btrk  = &(in->btrk);
+    rge_hipobank *bfmt  = &(in->bfmt);
+
+    // Gather detector data for all particles in one pass over each bank.
+    if (rge_detsummary_fill(
+            &(in->bcal), &(in->bchkv), &(in->bsci), bpart->nrows,
+            &(in->detsummaries)
+    )) return 1;
+
+    for (uint pos = 0; pos < btrk->nrows; ++pos) {
+        uint pindex = rge_get_uint(btrk, RGE_TRK_PINDEX, pos);
+        if (pindex >= bpart->nrows) continue;
+
+        // Get reconstructed particle from DC and from FMT.
+        rge_particle part = rge_particle_init(
+            bpart, btrk, bfmt, pos, opts->fmt_nlayers
+        );
+
+        // Skip particle if it doesn't fit requirements.
+        if (!part.is_valid) continue;
+
+        // Cut particles outside of FMT's active region.
+        if (opts->fmt_cut) {
+            int result = apply_fmtgeomtry_cut(&part);
+            if (result == 1) continue;
+            if (result == 2) return 1;
         }
+
+        // Get calorimeter, Cherenkov, and time-of-flight data.
+        rge_detsummary *ds = &(in->detsummaries[pindex]);
+
+        ntuples_track t;
+        t.part        = part;
+        t.energy_PCAL = ds->energy_PCAL;
+        t.energy_ECIN = ds->energy_ECIN;
+        t.energy_ECOU = ds->energy_ECOU;
+        t.nphe_HTCC   = ds->nphe_HTCC;
+        t.nphe_LTCC   = ds->nphe_LTCC;
+        t.tof         = ds->tof;
+
+        // Get miscellaneous data.
+        t.recon_pid = rge_get_int   (bpart, RGE_PART_PID,    pindex);
+        t.status    = rge_get_double(bpart, RGE_PART_STATUS, pindex);
+        t.chi2      = rge_get_double(btrk,  RGE_TRK_CHI2,    pos);
+        t.ndf       = rge_get_int   (btrk,  RGE_TRK_NDF,     pos);
+        t.sector    = rge_get_uint  (btrk,  RGE_TRK_SECTOR,  pos);
+
+        tracks->push_back(t);
     }
 
-    return tof;
+    return 0;
+}
+
+/** Assign PID to the particle of track t. */
+static int set_track_pid(
+        rge_particle *p, const ntuples_track *t, const ntuples_opts *opts
+) {
+    return rge_set_pid(
+            p, t->recon_pid, t->status,
+            t->energy_PCAL + t->energy_ECIN + t->energy_ECOU, t->energy_PCAL,
+            t->nphe_HTCC, t->nphe_LTCC, opts->sf_params[t->sector]
+    );
+}
+
+/** Append the ntuple row of particle p from track t to chunk. */
+static int fill_track_row(
+        ntuples_chunk *chunk, rge_particle p, rge_particle e,
+        const ntuples_track *t, double trigger_tof, lint event,
+        const ntuples_opts *opts
+) {
+    // If adding new variables, check their order in RGE_VARS and their type in
+    //     RGE_VARTYPES.
+    rge_varval arr[RGE_VARS_SIZE];
+    if (rge_fill_ntuples_arr(
+            arr, p, e, opts->run_no, event, t->status, opts->energy_beam,
+            t->chi2, t->ndf, t->energy_PCAL, t->energy_ECIN, t->energy_ECOU,
+            t->tof, trigger_tof, t->nphe_LTCC, t->nphe_HTCC, opts->varmask
+    )) return 1;
+
+    chunk->rows.insert(chunk->rows.end(), arr, arr + RGE_VARS_SIZE);
+    return 0;
 }
 
 /**
- * Get deposited energy for particle with pindex from PCAL, ECIN, and ECOU.
+ * Assign PIDs to the tracks of one event and append their ntuple rows and
+ *     particle counts to chunk. Nothing is written if the event has no trigger
+ *     electron.
  *
- * @param calorimeter : pointer to the calorimeter rge_hipobank.
- * @param pindex      : particle index of the particle we're studying
- * @param energy_PCAL : pointer to double to which we'll write the PCAL energy.
- * @param energy_ECIN : pointer to double to which we'll write the ECIN energy.
- * @param energy_ECOU : pointer to double to which we'll write the ECOU energy.
- * @return            : error code. 0 if successful, 1 otherwise. The function
- *                      only returns 1 if there's an invalid layer in the
- *                      calorimeter bank, suggesting corruption or a change in
- *                      the REC::Calorimeter bank structure.
+ * @param opts    : event loop settings.
+ * @param event   : event number.
+ * @param tracks  : tracks of the event, as read by read_tracks().
+ * @param ntracks : number of tracks in the event.
+ * @param chunk   : output of the event loop.
+ * @return        : error code. 0 if successful, 1 otherwise.
  */
-static int get_deposited_energy(
-        rge_hipobank *calorimeter, uint pindex, double *energy_PCAL,
-        double *energy_ECIN, double *energy_ECOU
+static int process_tracks(
+        const ntuples_opts *opts, lint event, const ntuples_track *tracks,
+        luint ntracks, ntuples_chunk *chunk
 ) {
-    *energy_PCAL = 0;
-    *energy_ECIN = 0;
-    *energy_ECOU = 0;
+    // Check existence of trigger electron.
+    rge_particle part_trigger;
+    luint trigger_i = ntracks;
+    for (luint i = 0; i < ntracks; ++i) {
+        part_trigger = tracks[i].part;
+        if (set_track_pid(&part_trigger, &(tracks[i]), opts)) return 1;
+
+        // Skip particle if its not the trigger electron.
+        if (!part_trigger.is_trigger) continue;
+
+        // Fill ntuple with trigger electron information.
+        if (fill_track_row(
+                chunk, part_trigger, part_trigger, &(tracks[i]),
+                tracks[i].tof, event, opts
+        )) return 1;
+
+        trigger_i = i;
+        break;
+    }
 
-    for (uint i = 0; i < calorimeter->nrows; ++i) {
-        if (rge_get_uint(calorimeter,"pindex",i) != pindex) continue;
+    // Skip events without a trigger electron.
+    if (trigger_i == ntracks) return 0;
+    ++chunk->trigger_counter;
 
-        int layer     = rge_get_int   (calorimeter, "layer",  i);
-        double energy = rge_get_double(calorimeter, "energy", i);
+    // Processing particles, avoiding double-counting the trigger electron.
+    for (luint i = 0; i < ntracks; ++i) {
+        if (i == trigger_i) continue;
 
-        if      (layer == PCAL_LYR) *energy_PCAL += energy;
-        else if (layer == ECIN_LYR) *energy_ECIN += energy;
-        else if (layer == ECOU_LYR) *energy_ECOU += energy;
-        else {
-            rge_errno = RGEERR_INVALIDCALLAYER;
-            return 1;
-        }
+        rge_particle part = tracks[i].part;
+        if (set_track_pid(&part, &(tracks[i]), opts)) return 1;
+        if (fill_track_row(
+                chunk, part, part_trigger, &(tracks[i]),
+                tracks[trigger_i].tof, event, opts
+        )) return 1;
+
+        if (part.pid ==  211) ++chunk->pionp_counter;
+        if (part.pid == -211) ++chunk->pionm_counter;
     }
 
     return 0;
 }
 
 /**
- * Count number of photoelectrons deposited on HTCC and LTCC detectors.
+ * Run the event loop over events [first, last) of the input, appending the
+ *     ntuple rows and particle counts to chunk.
  *
- * @param cherenkov : pointer to rge_hipobank struct with Cherenkov's data.
- * @param pindex    :    particle index of the particle we're studying.
- * @param nphe_HTCC : pointer to int where we'll write the number of
- *                    photoelectrons deposited on HTCC.
- * @param nphe_LTCC : pointer to int where we'll write the number of
- *                    photoelectrons deposited on LTCC.
- * @return          : error code. 0 if successful, 1 otherwise. The function
- *                    only returns 1 if there's an invalid detector ID in the
- *                    cherenkov bank, suggesting data corruption or a change
- *                    in the REC::Cherenkov bank structure.
+ * @param in    : input opened with open_input().
+ * @param opts  : event loop settings.
+ * @param first : first event to process.
+ * @param last  : event after the last one to process.
+ * @param chunk : output of the event loop.
+ * @return      : error code. 0 if successful, 1 otherwise.
+ */
+static int process_events(
+        ntuples_input *in, const ntuples_opts *opts, lint first, lint last,
+        ntuples_chunk *chunk
+) {
+    for (lint event = first; event < last; ++event) {
+        // Get entries from input file.
+        if (rge_loader_get_event(&(in->loader), event)) return 1;
+
+        // Filter events without the necessary banks.
+        if (in->bpart.nrows == 0 || in->btrk.nrows == 0) continue;
+
+        in->tracks.clear();
+        if (read_tracks(in, opts, &(in->tracks))) return 1;
+        if (process_tracks(
+                opts, event, in->tracks.data(), in->tracks.size(), chunk
+        )) return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Read events [0, n_events) of the input once, filling the sampling fraction
+ *     histograms of sf and buffering the valid tracks of each event in buf.
+ *     If the buffer goes over FUSED_MAXBYTES, it is dropped and only the
+ *     histograms are filled for the remaining events. The lock of sf_filename
+ *     is touched as events are read.
  */
-static int count_photoelectrons(
-        rge_hipobank *cherenkov, uint pindex, int *nphe_HTCC, int *nphe_LTCC
+static int read_fused(
+        ntuples_input *in, const ntuples_opts *opts, rge_sfstudy *sf,
+        const char *sf_filename, lint n_events, bool debug, ntuples_buffer *buf
 ) {
-    *nphe_HTCC = 0;
-    *nphe_LTCC = 0;
-
-    for (uint i = 0; i < cherenkov->nrows; ++i) {
-        if (rge_get_uint(cherenkov, "pindex", i) != pindex) continue;
-
-        int detector = rge_get_int(cherenkov, "detector", i);
-        int nphe     = rge_get_int(cherenkov, "nphe",     i);
-        if      (detector == HTCC_ID) *nphe_HTCC += nphe;
-        else if (detector == LTCC_ID) *nphe_LTCC += nphe;
-        else {
-            rge_errno = RGEERR_INVALIDCHERENKOVID;
+    buf->complete = true;
+    buf->offsets.push_back(0);
+
+    for (lint event = 0; event < n_events; ++event) {
+        if (!debug) rge_pbar_update(event);
+        if (event % CHUNK_NEVENTS == 0) rge_sflock_touch(sf_filename);
+
+        // Get entries from input file and write them to sf histograms.
+        if (rge_loader_get_event(&(in->loader), event)) return 1;
+        if (rge_sfstudy_fill(sf, &(in->bpart), &(in->btrk), &(in->bcal))) {
             return 1;
         }
+        if (!buf->complete) continue;
+
+        // Filter events without the necessary banks.
+        if (in->bpart.nrows == 0 || in->btrk.nrows == 0) continue;
+
+        // Buffer tracks. Events without a track with negative status can't
+        //     have a trigger electron, so they are dropped.
+        luint first_track = buf->tracks.size();
+        if (read_tracks(in, opts, &(buf->tracks))) return 1;
+        bool trigger_candidate = false;
+        for (luint i = first_track; i < buf->tracks.size(); ++i) {
+            if (buf->tracks[i].status < 0) trigger_candidate = true;
+        }
+        if (!trigger_candidate) {
+            buf->tracks.resize(first_track);
+            continue;
+        }
+        buf->events.push_back(event);
+        buf->offsets.push_back(buf->tracks.size());
+
+        // Drop buffer if it gets too large.
+        luint nbytes = buf->tracks.size() * sizeof(ntuples_track) +
+                buf->events.size() * (sizeof(lint) + sizeof(luint));
+        if (nbytes > FUSED_MAXBYTES) {
+            std::vector<ntuples_track>().swap(buf->tracks);
+            std::vector<luint>().swap(buf->offsets);
+            std::vector<lint>().swap(buf->events);
+            buf->complete = false;
+        }
     }
 
     return 0;
 }
 
 /**
- * Apply FMT geometry cut on a particle. This cut is defined by the particle's
- *     vz and its theta angle. theta_min and theta_max are given by:
- *     theta_min = 57.29 * atan(FMTCUT_RMIN / (FMTCUT_Z0 - vz)),
- *     theta_max = 57.29 * atan(FMTCUT_RMAX / (FMTCUT_Z0 - vz)),
- *     where FMTCUT_RMIN and FMTCUT_RMAX are the radii of the inner and outer
- *     circles of FMT, and FMTCUT_Z0 is the z position of the first FMT layer.
- *
- * @param p : particle for which we're applying the cut.
- * @return  : 0 if particle passes the cut, 1 otherwise, 2 if there's an angle
- *            conversion error.
+ * Run the event loop over buffered events [first, last) of buf, appending the
+ *     ntuple rows and particle counts to chunk.
  */
-static int apply_fmtgeomtry_cut(rge_particle *p) {
-    // Get minimum theta allowed for particle.
-    double theta_min;
-    if (rge_to_rad(
-            FMTCUT_ANGLE * atan(FMTCUT_RMIN / (FMTCUT_Z0 - p->vz)),
-            &theta_min
-    )) return 2;
+static int process_buffer(
+        const ntuples_opts *opts, const ntuples_buffer *buf, luint first,
+        luint last, ntuples_chunk *chunk
+) {
+    for (luint i = first; i < last; ++i) {
+        if (process_tracks(
+                opts, buf->events[i], &(buf->tracks[buf->offsets[i]]),
+                buf->offsets[i + 1] - buf->offsets[i], chunk
+        )) return 1;
+    }
 
-    // Get maximum theta allowed for particle.
-    double theta_max;
-    if (rge_to_rad(
-            FMTCUT_ANGLE * atan(FMTCUT_RMAX / (FMTCUT_Z0 - p->vz)),
-            &theta_max
-    )) return 2;
+    return 0;
+}
 
-    // Get particle's theta.
-    double theta = atan2(sqrt(p->px*p->px + p->py*p->py), p->pz);
+/**
+ * Run the event loop over buffered events [first, last) of buf, or over events
+ *     [first, last) of the input if buf is NULL.
+ */
+static int process_chunk(
+        ntuples_input *in, const ntuples_opts *opts, const ntuples_buffer *buf,
+        lint first, lint last, ntuples_chunk *chunk
+) {
+    if (buf == NULL) return process_events(in, opts, first, last, chunk);
+    return process_buffer(
+            opts, buf, static_cast<luint>(first), static_cast<luint>(last),
+            chunk
+    );
+}
 
-    // Return 1 if particle fails.
-    if (theta_min > theta || theta > theta_max) return 1;
+/** Reset chunk to hold the output of a new range of events. */
+static int reset_chunk(ntuples_chunk *chunk) {
+    chunk->rows.clear();
+    chunk->trigger_counter = 0;
+    chunk->pionp_counter   = 0;
+    chunk->pionm_counter   = 0;
+    chunk->err             = RGEERR_NOERR;
 
-    // Return 0 otherwise.
+    return 0;
+}
+
+/**
+ * Worker thread. Open its own input, unless events are buffered, and process
+ *     chunks of events until there are none left or the writer asks to stop.
+ */
+static void ntuples_worker(ntuples_state *st) {
+    ntuples_input in;
+    uint setup_err = RGEERR_NOERR;
+    if (st->buf == NULL && open_input(&in, st->opts, false)) {
+        setup_err = rge_errno;
+    }
+
+    while (true) {
+        lint c = st->next_chunk++;
+        if (c >= st->nchunks) break;
+
+        // Wait until the writer has room for this chunk.
+        {
+            std::unique_lock<std::mutex> lock(st->mtx);
+            st->cv_space.wait(lock, [st, c] {
+                return st->stop || c < st->next_write + st->window;
+            });
+            if (st->stop) break;
+        }
+
+        // Process chunk.
+        ntuples_chunk chunk;
+        reset_chunk(&chunk);
+        chunk.err = setup_err;
+        lint first = c * CHUNK_NEVENTS;
+        lint last  = std::min(first + CHUNK_NEVENTS, st->n_events);
+        if (
+                chunk.err == RGEERR_NOERR &&
+                process_chunk(&in, st->opts, st->buf, first, last, &chunk)
+        ) {
+            chunk.err = rge_errno;
+        }
+
+        // Hand chunk to the writer.
+        {
+            std::lock_guard<std::mutex> lock(st->mtx);
+            st->ready[c] = std::move(chunk);
+        }
+        st->cv_ready.notify_one();
+    }
+
+    if (st->buf != NULL) return;
+    if (setup_err == RGEERR_NOERR) {
+        st->bytes_read += rge_loader_bytes_read(&(in.loader));
+    }
+    close_input(&in);
+}
+
+/**
+ * Write the output of a chunk of events to the output tree and add its
+ *     particle counts to the totals. In the event layout, consecutive rows
+ *     with the same event number are written as one entry. Events never span
+ *     two chunks.
+ */
+static int write_chunk(
+        ntuples_output *out, ntuples_chunk *chunk, int *trigger_counter,
+        int *pionp_counter, int *pionm_counter
+) {
+    for (luint i = 0; i < chunk->rows.size(); i += RGE_VARS_SIZE) {
+        const rge_varval *row = &(chunk->rows[i]);
+        if (!out->is_event) {
+            memcpy(out->row, row, RGE_VARS_SIZE * sizeof(*row));
+            out->tree->Fill();
+            continue;
+        }
+        if (
+                out->ev.npart > 0 &&
+                out->ev.scalars[RGE_EVENTNO.addr].l != row[RGE_EVENTNO.addr].l
+        ) {
+            out->tree->Fill();
+            out->ev.npart = 0;
+        }
+        if (rge_eventrow_add(&(out->ev), row)) return 1;
+    }
+    if (out->is_event && out->ev.npart > 0) {
+        out->tree->Fill();
+        out->ev.npart = 0;
+    }
+    *trigger_counter += chunk->trigger_counter;
+    *pionp_counter   += chunk->pionp_counter;
+    *pionm_counter   += chunk->pionm_counter;
+
+    return 0;
+}
+
+/** Touch the lock of keeper->sf_filename until keeper->stop is set. */
+static void keep_sflock(sflock_keeper *keeper) {
+    std::unique_lock<std::mutex> lock(keeper->mtx);
+    while (!keeper->cv.wait_for(
+            lock, std::chrono::seconds(SFLOCK_TOUCH),
+            [keeper] { return keeper->stop; }
+    )) {
+        rge_sflock_touch(keeper->sf_filename);
+    }
+}
+
+/** Update the progress bar for events [first, last). */
+static int update_pbar(bool debug, lint first, lint last) {
+    if (debug) return 0;
+    for (lint event = first; event < last; ++event) rge_pbar_update(event);
+    return 0;
+}
+
+/**
+ * Close and remove the output file after a failed run, so that no partial
+ *     ntuples file is left behind.
+ */
+static int discard_output(
+        ntuples_output *out, TFile *file_out, const char *filename_out
+) {
+    file_out->Close();
+    delete file_out;
+    remove(filename_out);
+    rge_eventrow_free(&(out->ev));
     return 0;
 }
 
@@ -274,8 +741,11 @@ static int apply_fmtgeomtry_cut(rge_particle *p) {
 static int run(
         char *filename_in, char *work_dir, char *data_dir, bool debug,
         lint fmt_nlayers, bool fmt_cut, lint n_events, int run_no,
-        double energy_beam
+        double energy_beam, lint nthreads, luint varmask, bool event_layout
 ) {
+    // Make ROOT thread-safe before any of its objects are created.
+    if (nthreads > 1) ROOT::EnableThreadSafety();
+
     // Get sampling fraction.
     char sampling_fraction_file[PATH_MAX];
     if (run_no / 1000 != 999) {
@@ -290,263 +760,293 @@ static int run(
         sprintf(sampling_fraction_file, "%s/sf_params_mc.txt", data_dir);
     }
     double sampling_fraction_params[RGE_NSECTORS][RGE_NSFPARAMS][2];
-    if (access(sampling_fraction_file, F_OK) != 0) {
-        // No sampling fraction file for this run, we need to extract it.
+
+    // Settings shared by every event loop.
+    ntuples_opts opts;
+    opts.filename_in = filename_in;
+    opts.fmt_nlayers = fmt_nlayers;
+    opts.fmt_cut     = fmt_cut;
+    opts.run_no      = run_no;
+    opts.energy_beam = energy_beam;
+    opts.varmask     = varmask;
+    opts.sf_params   = sampling_fraction_params;
+
+    // If there's no sampling fraction file for this run, get the lock to
+    //     extract it. If another process has it, wait for it to write the file.
+    bool sf_study = false;
+    if (
+            access(sampling_fraction_file, F_OK) != 0 &&
+            rge_sflock_acquire(sampling_fraction_file, &sf_study)
+    ) return 1;
+
+    // Access input file.
+    ntuples_input in;
+    if (open_input(&in, &opts, sf_study)) {
+        close_input(&in);
+        if (sf_study) rge_sflock_release(sampling_fraction_file);
+        return 1;
+    }
+
+    // Change n_events to number of entries if it is equal to -1 or invalid.
+    if (n_events == -1 || n_events > in.loader.nevents) {
+        n_events = in.loader.nevents;
+    }
+
+    // No sampling fraction file for this run, we need to extract it. The
+    //     tracks are buffered during the same read, so that PID can be assigned
+    //     after the fit without reading the input again.
+    ntuples_buffer buf;
+    buf.complete    = false;
+    lint bytes_read = 0;
+    if (sf_study) {
         printf(
-                "No sampling fraction data found for run %d. Running "
-                "extract_sf().\n", run_no
+                "No sampling fraction data found for run %d. Extracting it "
+                "while reading %ld events from %s.\n",
+                run_no, n_events, filename_in
+        );
+        rge_sfstudy sf;
+        rge_sfstudy_init(&sf, false, false);
+        rge_pbar_set_nentries(n_events);
+        int err = read_fused(
+                &in, &opts, &sf, sampling_fraction_file, n_events, debug, &buf
         );
-        if (rge_extract_sf(filename_in, work_dir, data_dir, n_events, run_no)) {
+        if (err == 0) {
+            sflock_keeper keeper;
+            keeper.sf_filename = sampling_fraction_file;
+            keeper.stop        = false;
+            std::thread keeper_thread(keep_sflock, &keeper);
+
+            err = rge_sfstudy_fit(
+                    &sf, work_dir, sampling_fraction_file, run_no,
+                    static_cast<int>(nthreads)
+            );
+
+            {
+                std::lock_guard<std::mutex> lock(keeper.mtx);
+                keeper.stop = true;
+            }
+            keeper.cv.notify_one();
+            keeper_thread.join();
+        }
+        rge_sfstudy_free(&sf);
+
+        // Release the lock even if we failed, so that a waiting process can
+        //     try instead.
+        rge_sflock_release(sampling_fraction_file);
+        if (err) {
+            close_input(&in);
             return 1;
         }
+        bytes_read = rge_loader_bytes_read(&(in.loader));
+        if (!buf.complete) {
+            printf(
+                    "Track buffer is larger than %lu bytes, input will be read "
+                    "again.\n", FUSED_MAXBYTES
+            );
+            close_input(&in);
+            if (open_input(&in, &opts, false)) {
+                close_input(&in);
+                return 1;
+            }
+        }
         printf("Done!\n\n");
         rge_errno = RGEERR_UNDEFINED;
     }
     if (rge_get_sf_params(sampling_fraction_file, sampling_fraction_params)) {
+        close_input(&in);
         return 1;
     }
 
-    // Access input file.
-    TFile *file_in  = TFile::Open(filename_in, "READ");
-    if (!file_in || file_in->IsZombie()) {
-        rge_errno = RGEERR_BADINPUTFILE;
-        return 1;
+    // Create output file. The ntuples are created inside it so that their
+    //     baskets are written as they fill instead of being kept in memory.
+    char filename_out[PATH_MAX];
+    if (fmt_nlayers == 0) {
+        sprintf(filename_out, "%s/ntuples_dc_%06d.root", work_dir, run_no);
     }
-
-    // If fmt_nlayers != 0, check that FMT::Tracks bank exists.
-    if (fmt_nlayers != 0 && file_in->GetListOfKeys()->Contains(RGE_FMTTRACKS)) {
-        rge_errno = RGEERR_NOFMTBANK;
+    else {
+        sprintf(
+                filename_out, "%s/ntuples_fmt%1ld_%06d.root", work_dir,
+                fmt_nlayers, run_no
+        );
+    }
+    TFile *file_out = TFile::Open(filename_out, "RECREATE");
+    if (!file_out || file_out->IsZombie()) {
+        close_input(&in);
+        rge_errno = RGEERR_OUTPUTROOTFAILED;
         return 1;
     }
 
-    // Return to top directory (weird root stuff).
-    gROOT->cd();
-
-    // Generate lists of variables.
-    TString vars_string("");
-    for (int var_i = 0; var_i < RGE_VARS_SIZE; ++var_i) {
-        vars_string.Append(Form("%s", RGE_VARS[var_i]));
-        if (var_i != RGE_VARS_SIZE-1) vars_string.Append(":");
+    // Create output tree, with one typed branch per selected variable.
+    ntuples_output out;
+    out.is_event = event_layout;
+    out.ev       = rge_eventrow_init();
+    if (out.is_event) {
+        out.tree = new TTree(RGE_TREENAMEEVENTS, RGE_TREENAMEEVENTS);
+        if (rge_eventrow_branch(out.tree, &(out.ev), varmask)) {
+            close_input(&in);
+            discard_output(&out, file_out, filename_out);
+            return 1;
+        }
     }
-
-    // Create TTree and TNTuples.
-    TTree *tree_in = file_in->Get<TTree>(RGE_TREENAMEDATA);
-    if (tree_in == NULL) {
-        rge_errno = RGEERR_BADROOTFILE;
-        return 1;
+    else {
+        out.tree = new TTree(RGE_TREENAMEDATA, RGE_TREENAMEDATA);
+        rge_ntuple_branch(out.tree, out.row, varmask);
     }
-    TNtuple *tree_out;
-    tree_out = new TNtuple(RGE_TREENAMEDATA, RGE_TREENAMEDATA, vars_string);
-
-    // Change n_events to number of entries if it is equal to -1 or invalid.
-    if (n_events == -1 || n_events > tree_in->GetEntries()) {
-        n_events = tree_in->GetEntries();
+    out.tree->SetAutoFlush(OUT_AUTOFLUSH);
+    out.tree->SetAutoSave(OUT_AUTOSAVE);
+
+    // Iterate through input file, or through the buffered events. Buffered
+    //     events are processed in chunks of the same size, so that rows are
+    //     written as they are produced.
+    const ntuples_buffer *chunk_buf = NULL;
+    lint nentries = n_events;
+    if (buf.complete) {
+        close_input(&in);
+        chunk_buf = &buf;
+        nentries  = static_cast<lint>(buf.events.size());
+        printf("Processing %ld buffered events.\n", nentries);
+    }
+    else {
+        printf("Processing %ld events from %s.\n", n_events, filename_in);
     }
-
-    // Associate banks to TTree.
-    rge_hipobank bpart = rge_hipobank_init(RGE_RECPARTICLE,     tree_in);
-    rge_hipobank btrk  = rge_hipobank_init(RGE_RECTRACK,        tree_in);
-    rge_hipobank bcal  = rge_hipobank_init(RGE_RECCALORIMETER,  tree_in);
-    rge_hipobank bchkv = rge_hipobank_init(RGE_RECCHERENKOV,    tree_in);
-    rge_hipobank bsci  = rge_hipobank_init(RGE_RECSCINTILLATOR, tree_in);
-    rge_hipobank bfmt  = rge_hipobank_init(RGE_FMTTRACKS,       tree_in);
-
-    // Iterate through input file. Each TTree entry is one event.
-    printf("Processing %ld events from %s.\n", n_events, filename_in);
 
     // Prepare fancy progress bar.
     rge_pbar_reset();
-    rge_pbar_set_nentries(n_events);
+    rge_pbar_set_nentries(nentries);
 
     // Particle counters.
     int trigger_counter = 0;
     int pionp_counter   = 0;
     int pionm_counter   = 0;
 
-    // Loop through events in input file.
-    for (lint event = 0; event < n_events; ++event) {
-        // Print fancy progress bar.
-        if (!debug) rge_pbar_update(event);
-
-        // Get entries from input file.
-        rge_get_entries(&bpart, tree_in, event);
-        rge_get_entries(&btrk,  tree_in, event);
-        rge_get_entries(&bcal,  tree_in, event);
-        rge_get_entries(&bchkv, tree_in, event);
-        rge_get_entries(&bsci,  tree_in, event);
-        if (fmt_nlayers != 0) rge_get_entries(&bfmt, tree_in, event);
-
-        // Filter events without the necessary banks.
-        if (bpart.nrows == 0 || btrk.nrows == 0) continue;
-
-        // Check existence of trigger electron
-        rge_particle part_trigger;
-        bool trigger_exist  = false;
-        uint trigger_pos    = UINT_MAX;
-        uint trigger_pindex = UINT_MAX;
-        double trigger_tof  = -1.;
-        for (uint pos = 0; pos < btrk.nrows; ++pos) {
-            uint pindex = rge_get_uint(&btrk, "pindex", pos);
-
-            // Get reconstructed particle from DC and from FMT.
-            part_trigger = rge_particle_init(
-                &bpart, &btrk, &bfmt, pos, fmt_nlayers
-            );
-
-            // Skip particle if it doesn't fit requirements.
-            if (!part_trigger.is_valid) continue;
-
-            // Cut triggers outside of FMT's active region.
-            if (fmt_cut) {
-                int result = apply_fmtgeomtry_cut(&part_trigger);
-                if (result == 1) continue;
-                if (result == 2) return 1;
-            }
-
-            // Get energy deposited in calorimeters.
-            double energy_PCAL, energy_ECIN, energy_ECOU;
-            if (get_deposited_energy(
-                    &bcal, pindex, &energy_PCAL, &energy_ECIN, &energy_ECOU
-            )) return 1;
-
-            // Get number of photoelectrons from Cherenkov counters.
-            int nphe_HTCC, nphe_LTCC;
-            if (count_photoelectrons(&bchkv, pindex, &nphe_HTCC, &nphe_LTCC))
+    // Loop through events, one chunk at a time. Chunks are always written in
+    //     order, so the output doesn't depend on nthreads.
+    lint nchunks = (nentries + CHUNK_NEVENTS - 1) / CHUNK_NEVENTS;
+    std::chrono::steady_clock::time_point loop_start =
+            std::chrono::steady_clock::now();
+    if (nthreads == 1) {
+        ntuples_chunk chunk;
+        for (lint c = 0; c < nchunks; ++c) {
+            lint first = c * CHUNK_NEVENTS;
+            lint last  = std::min(first + CHUNK_NEVENTS, nentries);
+
+            reset_chunk(&chunk);
+            if (
+                    process_chunk(&in, &opts, chunk_buf, first, last, &chunk) ||
+                    write_chunk(
+                            &out, &chunk, &trigger_counter, &pionp_counter,
+                            &pionm_counter
+                    )
+            ) {
+                if (chunk_buf == NULL) close_input(&in);
+                discard_output(&out, file_out, filename_out);
                 return 1;
-
-            // Get time of flight from scintillators or calorimeters.
-            double tof = get_tof(&bsci, &bcal, pindex);
-
-            // Get miscellaneous data.
-            int status  = rge_get_double(&bpart, "status", pindex);
-            double chi2 = rge_get_double(&btrk,  "chi2",   pos);
-            double ndf  = rge_get_double(&btrk,  "NDF",    pos);
-
-            // Assign PID.
-            if (rge_set_pid(
-                    &part_trigger, rge_get_double(&bpart, "pid", pindex),
-                    status, energy_PCAL+energy_ECIN+energy_ECOU, energy_PCAL,
-                    nphe_HTCC, nphe_LTCC,
-                    sampling_fraction_params[rge_get_uint(&btrk, "sector", pos)]
-            )) return 1;
-
-            // Skip particle if its not the trigger electron.
-            if (!part_trigger.is_trigger) continue;
-
-            // Fill TNtuple with trigger electron information.
-            Float_t arr[RGE_VARS_SIZE];
-            if (rge_fill_ntuples_arr(
-                    arr, part_trigger, part_trigger, run_no, event, status,
-                    energy_beam, chi2, ndf, energy_PCAL, energy_ECIN,
-                    energy_ECOU, tof, tof, nphe_LTCC, nphe_HTCC
-            )) return 1;
-
-            tree_out->Fill(arr);
-
-            // Fill out trigger electron data and end loop.
-            trigger_exist  = true;
-            trigger_pindex = pindex;
-            trigger_pos    = pos;
-            trigger_tof    = tof;
-            break;
+            }
+            update_pbar(debug, first, last);
+        }
+        if (chunk_buf == NULL) {
+            bytes_read += rge_loader_bytes_read(&(in.loader));
+            close_input(&in);
+        }
+    }
+    else {
+        // Each worker opens its own input, unless events are buffered.
+        if (chunk_buf == NULL) close_input(&in);
+
+        ntuples_state st;
+        st.opts       = &opts;
+        st.buf        = chunk_buf;
+        st.n_events   = nentries;
+        st.nchunks    = nchunks;
+        st.window     = CHUNK_WINDOW * nthreads;
+        st.next_chunk = 0;
+        st.bytes_read = 0;
+        st.next_write = 0;
+        st.stop       = false;
+
+        std::vector<std::thread> workers;
+        for (lint t = 0; t < nthreads; ++t) {
+            workers.emplace_back(ntuples_worker, &st);
         }
 
-        // Skip events without a trigger electron.
-        if (!trigger_exist) continue;
-        ++trigger_counter;
-
-        // Processing particles.
-        for (uint pos = 0; pos < btrk.nrows; ++pos) {
-            uint pindex = rge_get_uint(&btrk, "pindex", pos);
-
-            // Avoid double-counting the trigger electron.
-            if (trigger_pindex == pindex && trigger_pos == pos) {
-                continue;
+        uint err = RGEERR_NOERR;
+        for (lint c = 0; c < nchunks; ++c) {
+            // Get next chunk in order.
+            ntuples_chunk chunk;
+            {
+                std::unique_lock<std::mutex> lock(st.mtx);
+                st.cv_ready.wait(lock, [&st, c] {
+                    return st.ready.count(c) > 0;
+                });
+                chunk = std::move(st.ready[c]);
+                st.ready.erase(c);
+                st.next_write = c + 1;
             }
+            st.cv_space.notify_all();
 
-            // Get reconstructed particle from DC and from FMT.
-            rge_particle part = rge_particle_init(
-                &bpart, &btrk, &bfmt, pos, fmt_nlayers
-            );
-
-            // Skip particle if it doesn't fit requirements.
-            if (!part.is_valid) continue;
-
-            // Cut particles outside of FMT's active region.
-            if (fmt_cut) {
-                int result = apply_fmtgeomtry_cut(&part);
-                if (result == 1) continue;
-                if (result == 2) return 1;
+            if (chunk.err != RGEERR_NOERR) {
+                err = chunk.err;
+                break;
             }
+            if (write_chunk(
+                    &out, &chunk, &trigger_counter, &pionp_counter,
+                    &pionm_counter
+            )) {
+                err = rge_errno;
+                break;
+            }
+            lint first = c * CHUNK_NEVENTS;
+            update_pbar(debug, first, std::min(first+CHUNK_NEVENTS, nentries));
+        }
 
-            // Get energy deposited in calorimeters.
-            double energy_PCAL, energy_ECIN, energy_ECOU;
-            if (get_deposited_energy(
-                    &bcal, pindex, &energy_PCAL, &energy_ECIN, &energy_ECOU
-            )) return 1;
-
-            // Get Cherenkov counters data.
-            int nphe_HTCC, nphe_LTCC;
-            if (count_photoelectrons(&bchkv, pindex, &nphe_HTCC, &nphe_LTCC))
-                return 1;
+        // Stop workers and wait for them to finish.
+        {
+            std::lock_guard<std::mutex> lock(st.mtx);
+            st.stop = true;
+        }
+        st.cv_space.notify_all();
+        for (std::thread &worker : workers) worker.join();
 
-            // Get time-of-flight (tof).
-            double tof = get_tof(&bsci, &bcal, pindex);
-
-            // Get miscellaneous data.
-            int status  = rge_get_double(&bpart, "status", pindex);
-            double chi2 = rge_get_double(&btrk,  "chi2",   pos);
-            double ndf  = rge_get_double(&btrk,  "NDF",    pos);
-
-            // Assign PID.
-            if (rge_set_pid(
-                    &part, rge_get_double(&bpart, "pid", pindex), status,
-                    energy_PCAL + energy_ECIN + energy_ECOU, energy_PCAL,
-                    nphe_HTCC, nphe_LTCC,
-                    sampling_fraction_params[rge_get_uint(&btrk, "sector", pos)]
-            )) return 1;
-
-            // Fill TNtuples. If adding new variables, check their order in
-            //     RGE_VARS.
-            Float_t arr[RGE_VARS_SIZE];
-            if (rge_fill_ntuples_arr(
-                    arr, part, part_trigger, run_no, event, status, energy_beam,
-                    chi2, ndf, energy_PCAL, energy_ECIN, energy_ECOU, tof,
-                    trigger_tof, nphe_LTCC, nphe_HTCC
-            )) return 1;
-
-            tree_out->Fill(arr);
-
-            if (part.pid ==  211) ++pionp_counter;
-            if (part.pid == -211) ++pionm_counter;
+        if (err != RGEERR_NOERR) {
+            discard_output(&out, file_out, filename_out);
+            rge_errno = err;
+            return 1;
         }
+        bytes_read += st.bytes_read;
     }
 
+    std::chrono::duration<double> loop_time =
+            std::chrono::steady_clock::now() - loop_start;
+
     // Print number of particles found to detect errors early.
     printf("e-  found: %d\n",   trigger_counter);
     printf("pi+ found: %d\n",   pionp_counter);
     printf("pi- found: %d\n\n", pionm_counter);
 
-    // Create output file.
-    char filename_out[PATH_MAX];
-    if (fmt_nlayers == 0) {
-        sprintf(filename_out, "%s/ntuples_dc_%06d.root", work_dir, run_no);
+    // Print event loop time, to compare the cost per event between versions.
+    if (nentries > 0) {
+        printf(
+                "Event loop took %.2f s (%.2f us per event).\n\n",
+                loop_time.count(), 1e6 * loop_time.count() / nentries
+        );
     }
-    else {
-        sprintf(
-                filename_out, "%s/ntuples_fmt%1ld_%06d.root", work_dir,
-                fmt_nlayers, run_no
+
+    // Print I/O usage to check that only the required columns are read.
+    if (bytes_read >= 0 && n_events > 0) {
+        printf(
+                "Read %ld bytes from input (%.1f per event).\n\n",
+                bytes_read, static_cast<double>(bytes_read) / n_events
         );
     }
-    TFile *file_out = TFile::Open(filename_out, "RECREATE");
 
-    // Write to output file.
+    // Write the remaining baskets and the final tree header to output file.
     file_out->cd();
-    tree_out->Write();
+    out.tree->Write("", TObject::kOverwrite);
 
     // Clean up after ourselves.
-    file_in ->Close();
     file_out->Close();
+    delete file_out;
+    rge_eventrow_free(&(out.ev));
 
     rge_errno = RGEERR_NOERR;
     return 0;
@@ -556,11 +1056,12 @@ static int run(
 static int handle_args(
         int argc, char **argv, char **filename_in, char **work_dir,
         char **data_dir, bool *debug, lint *fmt_nlayers, bool *fmt_cut,
-        lint *n_events, int *run_no, double *energy_beam
+        lint *n_events, int *run_no, double *energy_beam, lint *nthreads,
+        luint *varmask, bool *event_layout
 ) {
     // Handle arguments.
     int opt;
-    while ((opt = getopt(argc, argv, "-hDf:cn:w:d:")) != -1) {
+    while ((opt = getopt(argc, argv, "-hDf:cn:w:d:j:v:e")) != -1) {
         switch (opt) {
             case 'h':
                 rge_errno = RGEERR_USAGE;
@@ -585,6 +1086,15 @@ static int handle_args(
                 *data_dir = static_cast<char *>(malloc(strlen(optarg) + 1));
                 strcpy(*data_dir, optarg);
                 break;
+            case 'j':
+                if (rge_process_nthreads(nthreads, optarg)) return 1;
+                break;
+            case 'v':
+                if (rge_ntuple_parse_vars(optarg, varmask)) return 1;
+                break;
+            case 'e':
+                *event_layout = true;
+                break;
             case 1:
                 *filename_in = static_cast<char *>(malloc(strlen(optarg) + 1));
                 strcpy(*filename_in, optarg);
@@ -614,7 +1124,9 @@ static int handle_args(
         rge_errno = RGEERR_NOINPUTFILE;
         return 1;
     }
-    if (rge_handle_root_filename(*filename_in, run_no, energy_beam)) return 1;
+    if (rge_handle_input_filename(*filename_in, run_no, energy_beam)) {
+        return 1;
+    }
 
     return 0;
 }
@@ -631,17 +1143,22 @@ int main(int argc, char **argv) {
     lint n_events      = -1;
     int run_no         = -1;
     double energy_beam = -1;
+    lint nthreads      = 1;
+    luint varmask      = RGE_ALLVARS;
+    bool event_layout  = false;
 
     int err = handle_args(
             argc, argv, &filename_in, &work_dir, &data_dir, &debug,
-            &fmt_nlayers, &fmt_cut, &n_events, &run_no, &energy_beam
+            &fmt_nlayers, &fmt_cut, &n_events, &run_no, &energy_beam,
+            &nthreads, &varmask, &event_layout
     );
 
     // Run.
     if (rge_errno == RGEERR_UNDEFINED && err == 0) {
         run(
                 filename_in, work_dir, data_dir, debug, fmt_nlayers, fmt_cut,
-                n_events, run_no, energy_beam
+                n_events, run_no, energy_beam, nthreads, varmask,
+                event_layout
         );
     }
 
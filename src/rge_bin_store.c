@@ -0,0 +1,96 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022-2023 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+// details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#include "../lib/rge_bin_store.h"
+
+// --+ internal +---------------------------------------------------------------
+int make_dense(rge_binstore *store) {
+    store->dense =
+            static_cast<luint *>(calloc(store->ncells, sizeof(*store->dense)));
+    for (const std::pair<const luint, luint> &cell : *store->sparse) {
+        store->dense[cell.first] = cell.second;
+    }
+    delete store->sparse;
+    store->sparse = NULL;
+    return 0;
+}
+
+// --+ library +----------------------------------------------------------------
+int rge_binstore_init(rge_binstore *store, int ndims, luint *nbins) {
+    store->ndims  = ndims;
+    store->ncells = 1;
+    for (int dim_i = 0; dim_i < ndims; ++dim_i) {
+        store->nbins[dim_i] = nbins[dim_i];
+        store->ncells      *= nbins[dim_i];
+    }
+
+    store->dense  = NULL;
+    store->sparse = NULL;
+    if (store->ncells <= BINSTORE_MAXDENSE) {
+        store->dense = static_cast<luint *>(
+                calloc(store->ncells, sizeof(*store->dense))
+        );
+    }
+    else {
+        store->sparse = new std::unordered_map<luint, luint>();
+    }
+
+    return 0;
+}
+
+int rge_binstore_add(rge_binstore *store, luint cell, luint n) {
+    if (store->dense != NULL) {
+        store->dense[cell] += n;
+        return 0;
+    }
+
+    (*store->sparse)[cell] += n;
+    if (store->sparse->size() > store->ncells / BINSTORE_MAXFILL) {
+        make_dense(store);
+    }
+    return 0;
+}
+
+luint rge_binstore_get(rge_binstore *store, luint cell) {
+    if (store->dense != NULL) return store->dense[cell];
+
+    std::unordered_map<luint, luint>::const_iterator it =
+            store->sparse->find(cell);
+    return it == store->sparse->end() ? 0 : it->second;
+}
+
+int rge_binstore_merge(rge_binstore *dst, rge_binstore *src) {
+    if (src->dense != NULL) {
+        for (luint cell = 0; cell < src->ncells; ++cell) {
+            if (src->dense[cell] != 0) {
+                rge_binstore_add(dst, cell, src->dense[cell]);
+            }
+        }
+        return 0;
+    }
+
+    for (const std::pair<const luint, luint> &cell : *src->sparse) {
+        rge_binstore_add(dst, cell.first, cell.second);
+    }
+    return 0;
+}
+
+int rge_binstore_free(rge_binstore *store) {
+    free(store->dense);
+    delete store->sparse;
+    store->dense  = NULL;
+    store->sparse = NULL;
+    return 0;
+}
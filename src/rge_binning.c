@@ -0,0 +1,94 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022-2023 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+// details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#include "../lib/rge_binning.h"
+
+// --+ library +----------------------------------------------------------------
+int rge_binning_init(rge_binning *binning, luint nedges, double *edges) {
+    binning->nbins = nedges - 1;
+    binning->edges =
+            static_cast<double *>(malloc(nedges * sizeof(*binning->edges)));
+    for (luint edge_i = 0; edge_i < nedges; ++edge_i) {
+        binning->edges[edge_i] = edges[edge_i];
+    }
+
+    // Check if all bins have the same width.
+    double width = (edges[nedges-1] - edges[0]) / binning->nbins;
+    binning->uniform = width > 0;
+    for (luint bin_i = 0; bin_i < binning->nbins && binning->uniform; ++bin_i) {
+        double bin_width = edges[bin_i+1] - edges[bin_i];
+        if (fabs(bin_width - width) > BINNING_UNIFORMTOL * width) {
+            binning->uniform = false;
+        }
+    }
+    binning->inv_width = binning->uniform ? 1/width : 0;
+
+    return 0;
+}
+
+int rge_binning_init_uniform(
+        rge_binning *binning, double low, double high, luint nbins
+) {
+    double width = (high - low) / nbins;
+    double edges[nbins + 1];
+    for (luint bin_i = 0; bin_i <= nbins; ++bin_i) {
+        edges[bin_i] = low + width * bin_i;
+    }
+    return rge_binning_init(binning, nbins + 1, edges);
+}
+
+lint rge_binning_find(const rge_binning *binning, double value) {
+    const double *edges = binning->edges;
+    lint nbins = static_cast<lint>(binning->nbins);
+
+    // Written so that NaN also returns -1.
+    if (!(edges[0] < value && value < edges[nbins])) return -1;
+
+    // Find bin_i such that edges[bin_i] <= value < edges[bin_i+1]. In uniform
+    //     binnings, the arithmetic guess is only off by one bin at most due to
+    //     rounding, and it's corrected against the edges.
+    lint bin_i;
+    if (binning->uniform) {
+        bin_i = static_cast<lint>((value - edges[0]) * binning->inv_width);
+        if (bin_i > nbins - 1) bin_i = nbins - 1;
+        while (bin_i > 0 && value < edges[bin_i]) --bin_i;
+        while (bin_i < nbins - 1 && value >= edges[bin_i+1]) ++bin_i;
+    }
+    else {
+        bin_i = std::upper_bound(edges, edges + nbins + 1, value) - edges - 1;
+    }
+
+    // Values on an edge aren't in any bin.
+    if (value == edges[bin_i]) return -1;
+    return bin_i;
+}
+
+lint rge_binning_find_nd(
+        const rge_binning *binnings, luint ndims, const double *values
+) {
+    lint bin = 0;
+    for (luint dim_i = 0; dim_i < ndims; ++dim_i) {
+        lint dim_bin = rge_binning_find(&binnings[dim_i], values[dim_i]);
+        if (dim_bin < 0) return -1;
+        bin = bin * static_cast<lint>(binnings[dim_i].nbins) + dim_bin;
+    }
+    return bin;
+}
+
+int rge_binning_free(rge_binning *binning) {
+    free(binning->edges);
+    binning->edges = NULL;
+    return 0;
+}
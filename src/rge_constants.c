@@ -30,3 +30,15 @@ const char *RGE_VARS[RGE_VARS_SIZE] = {
         RGE_ZH.name, RGE_PT2.name, RGE_PL2.name, RGE_PHIPQ.name,
                 RGE_THETAPQ.name
 };
+
+const char RGE_VARTYPES[RGE_VARS_SIZE] = {
+        'I', 'L', 'F',                                    // Metadata.
+        'I', 'I', 'I', 'F', 'F', 'F', 'F', 'F', 'F', 'F', // Particle.
+                'F', 'F', 'F', 'F', 'O', 'I',
+        'F', 'I',                                         // Tracking.
+        'F', 'F', 'F', 'F',                               // Calorimeter.
+        'F',                                              // Scintillator.
+        'I', 'I',                                         // Cherenkov.
+        'F', 'F', 'F', 'F', 'F',                          // DIS.
+        'F', 'F', 'F', 'F', 'F'                           // SIDIS.
+};
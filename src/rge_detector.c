@@ -0,0 +1,127 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022-2023 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+// details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#include "../lib/rge_detector.h"
+
+// --+ internal +---------------------------------------------------------------
+int tof_rank(int tof_lyr) {
+    switch (tof_lyr) {
+        case FTOF1B_LYR:      return 6;
+        case FTOF1A_LYR:      return 5;
+        case FTOF2_LYR:       return 4;
+        case 10 + PCAL_LYR:   return 3;
+        case 10 + ECIN_LYR:   return 2;
+        case 10 + ECOU_LYR:   return 1;
+        default:              return 0;
+    }
+}
+
+// --+ library +----------------------------------------------------------------
+int rge_pindexmap_fill(
+        rge_pindexmap *m, rge_hipobank *b, uint col, luint npindex
+) {
+    m->npindex = npindex;
+    m->offsets.assign(npindex + 1, 0);
+
+    // Count rows per pindex, shifted by one.
+    for (luint row = 0; row < b->nrows; ++row) {
+        uint pindex = rge_get_uint(b, col, row);
+        if (pindex < npindex) ++m->offsets[pindex + 1];
+    }
+
+    // Turn counts into offsets.
+    for (luint pindex = 0; pindex < npindex; ++pindex) {
+        m->offsets[pindex + 1] += m->offsets[pindex];
+    }
+    m->rows.resize(m->offsets[npindex]);
+
+    // Scatter rows. After this, offsets[pindex] points to the end of pindex's
+    //     rows, so we shift them back by one afterwards.
+    for (luint row = 0; row < b->nrows; ++row) {
+        uint pindex = rge_get_uint(b, col, row);
+        if (pindex < npindex) m->rows[m->offsets[pindex]++] = row;
+    }
+    for (luint pindex = npindex; pindex > 0; --pindex) {
+        m->offsets[pindex] = m->offsets[pindex - 1];
+    }
+    m->offsets[0] = 0;
+
+    return 0;
+}
+
+int rge_detsummary_fill(
+        rge_hipobank *calorimeter, rge_hipobank *cherenkov,
+        rge_hipobank *scintillator, luint npart,
+        std::vector<rge_detsummary> *summaries
+) {
+    summaries->assign(npart, {0., 0., 0., 0, 0, INFINITY, 0});
+
+    // Deposited energy and ECAL TOF.
+    for (luint i = 0; i < calorimeter->nrows; ++i) {
+        uint pindex = rge_get_uint(calorimeter, RGE_CAL_PINDEX, i);
+        if (pindex >= npart) continue;
+        rge_detsummary *s = &(*summaries)[pindex];
+
+        int layer     = rge_get_int   (calorimeter, RGE_CAL_LAYER,  i);
+        double energy = rge_get_double(calorimeter, RGE_CAL_ENERGY, i);
+
+        if      (layer == PCAL_LYR) s->energy_PCAL += energy;
+        else if (layer == ECIN_LYR) s->energy_ECIN += energy;
+        else if (layer == ECOU_LYR) s->energy_ECOU += energy;
+        else {
+            rge_errno = RGEERR_INVALIDCALLAYER;
+            return 1;
+        }
+
+        if (tof_rank(10 + layer) > tof_rank(s->tof_lyr)) {
+            s->tof_lyr = 10 + layer;
+            s->tof     = rge_get_double(calorimeter, RGE_CAL_TIME, i);
+        }
+    }
+
+    // Photoelectrons.
+    for (luint i = 0; i < cherenkov->nrows; ++i) {
+        uint pindex = rge_get_uint(cherenkov, RGE_CHKV_PINDEX, i);
+        if (pindex >= npart) continue;
+        rge_detsummary *s = &(*summaries)[pindex];
+
+        int detector = rge_get_int(cherenkov, RGE_CHKV_DETECTOR, i);
+        int nphe     = rge_get_int(cherenkov, RGE_CHKV_NPHE,     i);
+        if      (detector == HTCC_ID) s->nphe_HTCC += nphe;
+        else if (detector == LTCC_ID) s->nphe_LTCC += nphe;
+        else {
+            rge_errno = RGEERR_INVALIDCHERENKOVID;
+            return 1;
+        }
+    }
+
+    // FTOF TOF. Any FTOF hit outranks the ECAL layers found above.
+    for (luint i = 0; i < scintillator->nrows; ++i) {
+        uint pindex = rge_get_uint(scintillator, RGE_SCI_PINDEX, i);
+        if (pindex >= npart) continue;
+        if (rge_get_uint(scintillator, RGE_SCI_DETECTOR, i) != FTOF_ID) {
+            continue;
+        }
+        rge_detsummary *s = &(*summaries)[pindex];
+
+        int layer = rge_get_int(scintillator, RGE_SCI_LAYER, i);
+        if (tof_rank(layer) > tof_rank(s->tof_lyr)) {
+            s->tof_lyr = layer;
+            s->tof     = rge_get_double(scintillator, RGE_SCI_TIME, i);
+        }
+    }
+
+    return 0;
+}
@@ -58,6 +58,15 @@ static const std::map<uint, const char *> ERRMAP = {
             "Too many numbers passed to -b, input only four."},
     {RGEERR_BADBINNING,
             "Numbers passed to -b are invalid, check argument format."},
+    {RGEERR_INVALIDNTHREADS,
+            "Number of threads is invalid. Input a positive number after -j."},
+    {RGEERR_INVALIDNTUPLEVARS,
+            "List of variables is invalid. Input a comma-separated list of "
+            "variable names and profiles after -v."},
+    {RGEERR_BADBINEDGES,
+            "Bin edges are invalid. At least two edges are required, in "
+            "increasing order. With -e, they should follow the index of the "
+            "binning variable."},
 
     // File errors.
     {RGEERR_NOINPUTFILE,
@@ -100,6 +109,31 @@ static const std::map<uint, const char *> ERRMAP = {
             "Failed to create output root file."},
     {RGEERR_OUTPUTTEXTFAILED,
             "Failed to create output text file."},
+    {RGEERR_INVALIDINPUTFILE,
+            "Input file is not valid. Input a .root or a .hipo file."},
+    {RGEERR_MISSINGBANK,
+            "A bank required by the program is not present in the input file."},
+    {RGEERR_OUTDATEDNTUPLEFILE,
+            "Ntuples file was written by an older version of make_ntuples, "
+            "without typed variables. Run make_ntuples again."},
+    {RGEERR_MISSINGNTUPLEVAR,
+            "Ntuples file is missing a variable required by the selected cuts, "
+            "binning, or plots. Run make_ntuples with a wider -v selection."},
+    {RGEERR_BADSFPARTIAL,
+            "Sampling fraction partial file is invalid, or it doesn't match "
+            "the other partial files. All partials should be written by "
+            "extract_sf -o, for the same run and with the same -p setting."},
+    {RGEERR_SFLOCKFAILED,
+            "Failed to create lock file for the sampling fraction file. Check "
+            "that the data directory is writable."},
+    {RGEERR_BADACCFILE,
+            "Acceptance correction file is invalid. It is either truncated or "
+            "written by a different version of acc_corr. Run acc_corr again."},
+    {RGEERR_OUTPUTACCFAILED,
+            "Failed to write acceptance correction file."},
+    {RGEERR_ACCMISMATCH,
+            "Acceptance correction files can't be merged. All files should be "
+            "written by acc_corr with the same binnings and list of PIDs."},
 
     // Detector errors.
     {RGEERR_INVALIDCALLAYER,
@@ -132,6 +166,16 @@ static const std::map<uint, const char *> ERRMAP = {
     {RGEERR_WRONGENTRYTYPE,
             "An invalid entry type was requested to the count_entries function."
             " Check the function input in acc_corr.c."},
+    {RGEERR_BADHIPOSCHEMA,
+            "A hipo bank schema is missing an entry required by rge_hipobank, "
+            "or stores it with a different type. Check ENTRYMAP in "
+            "rge_hipo_bank.c."},
+    {RGEERR_TOOMANYBANKS,
+            "Too many banks were added to an rge_eventloader. Increase "
+            "RGE_MAXBANKS in rge_event_loader.h."},
+    {RGEERR_THREADMISMATCH,
+            "Results of the threads differ from a single-threaded run. Check "
+            "the thread sanitizer report."},
 
     // Particle errors.
     {RGEERR_PIDNOTFOUND,
@@ -148,7 +192,10 @@ static const std::map<uint, const char *> ERRMAP = {
             "-180 (-pi) and 180 (pi)."},
     {RGEERR_NOACCDATA,
             "There's no acceptance correction data for the selected PID. Run "
-            "acc_corr and define a binning scheme to use this feature."}
+            "acc_corr and define a binning scheme to use this feature."},
+    {RGEERR_OUTOFMEMORY,
+            "Failed to allocate memory. Check the memory available to the "
+            "program."}
 };
 
 int handle_err() {
@@ -168,7 +215,7 @@ int handle_err() {
 }
 
 // --+ library +----------------------------------------------------------------
-uint rge_errno = RGEERR_UNDEFINED;
+thread_local uint rge_errno = RGEERR_UNDEFINED;
 
 int rge_print_usage(const char *msg) {
     int err = handle_err();
@@ -0,0 +1,149 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022-2023 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+// details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#include "../lib/rge_event_loader.h"
+
+// --+ library +----------------------------------------------------------------
+int rge_loader_open(rge_eventloader *l, const char *filename) {
+    l->is_hipo   = strstr(filename, ".hipo") != NULL;
+    l->nevents   = 0;
+    l->nbanks    = 0;
+    l->root_file = nullptr;
+    l->tree      = nullptr;
+    l->learning  = true;
+
+    if (l->is_hipo) {
+        // hipo's reader doesn't report whether the file could be opened.
+        if (access(filename, R_OK) != 0) {
+            rge_errno = RGEERR_BADINPUTFILE;
+            return 1;
+        }
+        l->reader.open(filename);
+        l->reader.readDictionary(l->factory);
+        l->nevents = l->reader.getEntries();
+        if (l->nevents < 0) {
+            rge_errno = RGEERR_BADINPUTFILE;
+            return 1;
+        }
+        return 0;
+    }
+
+    l->root_file = TFile::Open(filename, "READ");
+    if (!l->root_file || l->root_file->IsZombie()) {
+        delete l->root_file;
+        l->root_file = nullptr;
+        rge_errno = RGEERR_BADINPUTFILE;
+        return 1;
+    }
+    l->tree = l->root_file->Get<TTree>(RGE_TREENAMEDATA);
+    if (l->tree == NULL) {
+        rge_loader_close(l);
+        rge_errno = RGEERR_BADROOTFILE;
+        return 1;
+    }
+    l->nevents = l->tree->GetEntries();
+
+    // Disable all branches. Banks enable the ones they need when added.
+    l->tree->SetBranchStatus("*", false);
+    l->tree->SetCacheSize(RGE_TREECACHESIZE);
+
+    return 0;
+}
+
+bool rge_loader_has_bank(rge_eventloader *l, const char *bank_version) {
+    if (l->is_hipo) return l->factory.hasSchema(bank_version);
+
+    char count_addr[PATH_MAX];
+    rge_count_addr(bank_version, count_addr);
+    return l->tree->GetBranch(count_addr) != nullptr;
+}
+
+int rge_loader_add_bank(rge_eventloader *l, rge_hipobank *b, uint colmask) {
+    if (l->nbanks >= RGE_MAXBANKS) {
+        rge_errno = RGEERR_TOOMANYBANKS;
+        return 1;
+    }
+    if (!rge_loader_has_bank(l, b->name)) {
+        rge_errno = RGEERR_MISSINGBANK;
+        return 1;
+    }
+
+    b->colmask &= colmask;
+
+    if (l->is_hipo) {
+        l->hbanks[l->nbanks] = hipo::bank(l->factory.getSchema(b->name));
+        if (rge_link_schema(b, &(l->hbanks[l->nbanks].getSchema()))) return 1;
+    }
+    else {
+        // Enable and cache the count branch and the entries in use.
+        char count_addr[PATH_MAX];
+        rge_count_addr(b->name, count_addr);
+        l->tree->SetBranchStatus(count_addr, true);
+        l->tree->AddBranchToCache(count_addr, true);
+        for (uint col = 0; col < b->ncols; ++col) {
+            if (!(b->colmask & RGE_COL(col))) continue;
+            l->tree->SetBranchStatus(b->entries[col].addr, true);
+            l->tree->AddBranchToCache(b->entries[col].addr, true);
+        }
+        if (rge_set_branch_addresses(b, l->tree)) return 1;
+    }
+
+    l->banks[l->nbanks] = b;
+    ++l->nbanks;
+
+    return 0;
+}
+
+int rge_loader_get_event(rge_eventloader *l, lint idx) {
+    if (!l->is_hipo) {
+        // All branches have been added to the cache by now.
+        if (l->learning) {
+            l->tree->StopCacheLearningPhase();
+            l->learning = false;
+        }
+
+        Long64_t local_idx = l->tree->LoadTree(idx);
+        for (uint i = 0; i < l->nbanks; ++i) {
+            if (rge_get_entries(l->banks[i], local_idx)) return 1;
+        }
+        return 0;
+    }
+
+    l->reader.gotoEvent(static_cast<int>(idx));
+    l->reader.read(l->event);
+    for (uint i = 0; i < l->nbanks; ++i) {
+        l->event.getStructure(l->hbanks[i]);
+        if (rge_fill(l->banks[i], &(l->hbanks[i]))) return 1;
+    }
+
+    return 0;
+}
+
+lint rge_loader_bytes_read(rge_eventloader *l) {
+    if (l->is_hipo) return -1;
+    return l->root_file->GetBytesRead();
+}
+
+int rge_loader_close(rge_eventloader *l) {
+    if (l->root_file != nullptr) {
+        l->root_file->Close();
+        delete l->root_file;
+    }
+    l->root_file = nullptr;
+    l->tree      = nullptr;
+    l->nbanks    = 0;
+
+    return 0;
+}
@@ -43,334 +43,542 @@ static const double PLIMITSARR[NCALS][2] = {
         {0.150, 0.300}
 };
 
-int insert_TH1F(
-        std::map<const char *, TH1 *> *map, const char *k, const char *n,
-        const char *xn, int bins, double min, double max
-) {
-    map->insert(std::pair<const char *, TH1 *> (n, new TH1F(
-            Form("%s: %s", k, n), Form("%s;%s", n, xn), bins, min, max
-    )));
+int name_1D(char *name, int cal_i, int sector_i, int pbin) {
+    double p = SF_PMIN + pbin * SF_PSTEP;
+    sprintf(
+            name, "%s%d (%5.2f < p < %5.2f)", SFARR1D[cal_i], sector_i + 1, p,
+            p + SF_PSTEP
+    );
     return 0;
 }
 
-int insert_TH2F(
-        std::map<const char *, TH1 *> *map, const char *k, const char *n,
-        const char *nx, const char *ny, int xbins, double xmin, double xmax,
-        int ybins, double ymin, double ymax
-) {
-    map->insert(std::pair<const char *, TH1 *> (n, new TH2F(
-            Form("%s: %s", k, n), Form("%s;%s;%s", n, nx, ny),
-            xbins, xmin, xmax, ybins, ymin, ymax
-    )));
+int partial_key_2D(char *key, int cal_i, int sector_i) {
+    sprintf(key, "h2D_%d_%d", cal_i, sector_i);
     return 0;
 }
 
-// --+ library +----------------------------------------------------------------
-int rge_extract_sf(
-        char *in_filename, char *work_dir, char *data_dir, lint nevn, int run_no
+int partial_key_1D(char *key, int cal_i, int sector_i, int pbin) {
+    sprintf(key, "h1D_%d_%d_%02d", cal_i, sector_i, pbin);
+    return 0;
+}
+
+int get_pbin(double p) {
+    if (p < SF_PMIN || p > SF_PMAX) return -1;
+    int pbin = static_cast<int>((p - SF_PMIN) / SF_PSTEP);
+    return pbin < SF_NPBINS ? pbin : SF_NPBINS - 1;
+}
+
+bool estimate_gaus(TH1 *h, double lo, double hi, double *seed) {
+    TAxis *x_axis = h->GetXaxis();
+    int first = x_axis->FindBin(lo);
+    int last  = x_axis->FindBin(hi);
+    if (last - first + 1 <= 2*SF_SEED_NSIDEBAND) return false;
+
+    // Fit a line through the mean of each sideband.
+    double x_lo = 0, y_lo = 0, x_hi = 0, y_hi = 0;
+    for (int bin_i = 0; bin_i < SF_SEED_NSIDEBAND; ++bin_i) {
+        x_lo += h->GetBinCenter(first + bin_i);
+        y_lo += h->GetBinContent(first + bin_i);
+        x_hi += h->GetBinCenter(last - bin_i);
+        y_hi += h->GetBinContent(last - bin_i);
+    }
+    double slope     = (y_hi - y_lo) / (x_hi - x_lo);
+    double intercept = (y_lo - slope * x_lo) / SF_SEED_NSIDEBAND;
+
+    // Compute the truncated mean and RMS of the signal, shrinking the window
+    //     around the mean on each iteration.
+    double mean = 0, rms = 0;
+    int win_first = first, win_last = last;
+    for (int iter = 0; iter < SF_SEED_NITER; ++iter) {
+        double sum_w = 0, sum_wx = 0, sum_wx2 = 0;
+        for (int bin = win_first; bin <= win_last; ++bin) {
+            double x = h->GetBinCenter(bin);
+            double w = h->GetBinContent(bin) - (slope * x + intercept);
+            if (w <= 0) continue;
+            sum_w   += w;
+            sum_wx  += w * x;
+            sum_wx2 += w * x * x;
+        }
+        if (sum_w <= 0) return false;
+
+        mean = sum_wx / sum_w;
+        rms  = sqrt(fmax(sum_wx2 / sum_w - mean * mean, 0));
+        if (rms <= 0) return false;
+        win_first = std::max(first, x_axis->FindBin(mean - SF_SEED_NSIGMA*rms));
+        win_last  = std::min(last,  x_axis->FindBin(mean + SF_SEED_NSIGMA*rms));
+    }
+    if (mean <= lo || mean >= hi) return false;
+
+    // Correct the RMS for the truncation of the last window.
+    double sigma = rms / SF_SEED_RMSCORR;
+    int peak_bin = x_axis->FindBin(mean);
+    double peak_x = h->GetBinCenter(peak_bin);
+
+    seed[0] = h->GetBinContent(peak_bin) - (slope * peak_x + intercept);
+    seed[1] = mean;
+    seed[2] = fmin(sigma, 0.1);
+    seed[3] = 0;
+    seed[4] = slope;
+    seed[5] = intercept;
+    return seed[0] > 0;
+}
+
+double range_chi2(TH1 *h, TF1 *f, double lo, double hi, int *npt) {
+    TAxis *x_axis = h->GetXaxis();
+    double chi2 = 0;
+    *npt = 0;
+    for (int bin = x_axis->FindBin(lo); bin <= x_axis->FindBin(hi); ++bin) {
+        double content = h->GetBinContent(bin);
+        if (content <= 0) continue;
+        double diff = content - f->Eval(h->GetBinCenter(bin));
+        chi2 += diff * diff / content;
+        ++(*npt);
+    }
+    return chi2;
+}
+
+int fit_sector(
+        rge_sfstudy *sf, int cal_i, int sector_i, TF1 *sf_gaus,
+        std::mutex *minuit_mtx, double fitresults[RGE_NSFPARAMS][2],
+        sf_fitstats *stats
 ) {
-    // Configure ROOT fitting.
-    gStyle->SetOptFit();
+    double lo = PLIMITSARR[cal_i][0];
+    double hi = PLIMITSARR[cal_i][1];
+    double zeros[SF_GAUS_NPARS] = {0};
+
+    // Fit 1D plots for each momentum bin to fill dotgraphs.
+    int point_idx = 0;
+    for (int pbin = 0; pbin < SF_NPBINS; ++pbin) {
+        double p = SF_PMIN + pbin * SF_PSTEP;
+
+        // Get ref to histogram.
+        TH1 *EdivP = sf->h1D[cal_i][sector_i][pbin];
+
+        // Name the fit after the histogram, since a copy of it is stored in
+        //     the histogram.
+        char name[SF_NAMELEN];
+        name_1D(name, cal_i, sector_i, pbin);
+        strcat(name, " fit");
+        sf_gaus->SetName(name);
+
+        // Reset everything the previous fit left in sf_gaus, so that the result
+        //     doesn't depend on which fits ran before in this thread.
+        sf_gaus->SetRange(lo, hi);
+        sf_gaus->SetParErrors(zeros);
+        sf_gaus->SetChisquare(0);
+        sf_gaus->SetNDF(0);
+        sf_gaus->SetNumberFitPoints(0);
+
+        // Seed parameters from the moments of the histogram, falling back to
+        //     fixed values if there is no signal to estimate them from.
+        double seed[SF_GAUS_NPARS] = {
+                EdivP->GetBinContent(EdivP->GetMaximumBin()) /* amp   */,
+                (hi + lo)/2                                  /* mean  */,
+                0.05                                         /* sigma */,
+                0 /* p0 */, 0 /* p1 */, 0 /* p2 */
+        };
+        bool estimated = !sf->fixed_seeds && estimate_gaus(EdivP, lo, hi, seed);
+        sf_gaus->SetParLimits(1, lo, hi);
+        sf_gaus->SetParLimits(2, 0., 0.1);
+        sf_gaus->SetParameters(seed);
+        ++(stats->nslices);
+
+        // Use the estimate as is if it already describes the histogram, and
+        //     fit otherwise.
+        int npt = 0;
+        double chi2 = estimated ? range_chi2(EdivP, sf_gaus, lo, hi, &npt) : 0;
+        int ndf = npt - SF_GAUS_NPARS;
+        if (estimated && ndf > 0 && chi2 / ndf < SF_SEED_MAXCHI2) {
+            sf_gaus->SetChisquare(chi2);
+            sf_gaus->SetNDF(ndf);
+            sf_gaus->SetNumberFitPoints(npt);
+            EdivP->GetListOfFunctions()->Add(sf_gaus->Clone());
+            ++(stats->nestimate);
+        }
+        else {
+            std::unique_lock<std::mutex> lock;
+            if (minuit_mtx != NULL) {
+                lock = std::unique_lock<std::mutex>(*minuit_mtx);
+            }
+            TFitResultPtr result = EdivP->Fit(sf_gaus, "QRS", "", lo, hi);
+            ++(stats->nminuit);
+            if (result.Get() != NULL) stats->ncalls += result->NCalls();
+            if (static_cast<int>(result) != 0) ++(stats->nfailed);
+        }
 
-    // Create output root file.
-    char out_rootfilename[PATH_MAX];
-    sprintf(out_rootfilename, "%s/sf_study_%06d.root", work_dir, run_no);
-    TFile *out_rootfile = TFile::Open(out_rootfilename, "RECREATE");
-    if (!out_rootfile || out_rootfile->IsZombie()) {
-        rge_errno = RGEERR_OUTPUTROOTFAILED;
-        return 1;
+        // Extract mean and sigma from fit and add it to 2D plots.
+        double mean  = sf_gaus->GetParameter(1);
+        double sigma = sf_gaus->GetParameter(2);
+
+        // Only add points within PLIMITSARR borders and with an acceptable
+        //     chi2.
+        if (
+                (mean - 2*sigma > lo && mean + 2*sigma < hi) &&
+                (
+                        sf_gaus->GetChisquare() / sf_gaus->GetNDF() <
+                        SF_CHI2CONFORMITY
+                )
+        ) {
+            sf->dotgraph[cal_i][sector_i]->SetPoint(
+                    point_idx, p + SF_PSTEP/2, mean
+            );
+            point_idx++;
+        }
+    }
+    stats->npoints = point_idx;
+
+    // Fit dotgraphs.
+    TF1 *polyfit = sf->polyfit[cal_i][sector_i];
+    if (sf->dotgraph[cal_i][sector_i]->GetN() > 0) {
+        std::unique_lock<std::mutex> lock;
+        if (minuit_mtx != NULL) {
+            lock = std::unique_lock<std::mutex>(*minuit_mtx);
+        }
+        sf->dotgraph[cal_i][sector_i]->Fit(
+                polyfit, "QR", "", SF_PMIN+SF_PSTEP, SF_PMAX-SF_PSTEP
+        );
     }
 
-    // Create output data file.
-    char out_textfilename[PATH_MAX];
-    sprintf(out_textfilename, "%s/sf_params_%06d.txt", data_dir, run_no);
-    FILE *out_textfile = fopen(out_textfilename, "w");
-    if (out_textfile == NULL) {
-        rge_errno = RGEERR_OUTPUTTEXTFAILED;
-        return 1;
+    // Extract and save dotgraph fits parameters to make cuts from them.
+    for (int param_i = 0; param_i < polyfit->GetNpar(); ++param_i) {
+        // Sampling fraction (sf in CCDB).
+        fitresults[param_i][0] = polyfit->GetParameter(param_i);
+        // Sampling fraction sigma (sfs in CCDB).
+        fitresults[param_i][1] = polyfit->GetParError(param_i);
     }
 
-    // Access input file.
-    TFile *f_in = TFile::Open(in_filename, "READ");
-    if (!f_in || f_in->IsZombie()) {
-        rge_errno = RGEERR_BADINPUTFILE;
+    return 0;
+}
+
+void fit_worker(
+        rge_sfstudy *sf, std::atomic<int> *next_task, int thread_i,
+        std::mutex *minuit_mtx,
+        double fitresults[NCALS][RGE_NSECTORS][RGE_NSFPARAMS][2],
+        sf_fitstats stats[NCALS][RGE_NSECTORS]
+) {
+    // Fit function reused by all fits of this thread. It's kept out of ROOT's
+    //     global list of functions, so threads don't share it.
+    char name[SF_NAMELEN];
+    sprintf(name, "sf_gaus_%d", thread_i);
+    TF1 sf_gaus(
+            name, "[0]*TMath::Gaus(x,[1],[2]) + [3]*x*x + [4]*x + [5]", 0, 1,
+            TF1::EAddToList::kNo
+    );
+
+    while (true) {
+        int task = (*next_task)++;
+        if (task >= NCALS * RGE_NSECTORS) break;
+
+        int cal_i    = task / RGE_NSECTORS;
+        int sector_i = task % RGE_NSECTORS;
+        fit_sector(
+                sf, cal_i, sector_i, &sf_gaus, minuit_mtx,
+                fitresults[cal_i][sector_i], &stats[cal_i][sector_i]
+        );
+    }
+}
+
+int add_partial(
+        rge_sfstudy *sf, bool *sf_init, TFile *file, bool fixed_seeds,
+        int *run_no
+) {
+    int file_run_no;
+    bool file_project;
+    if (rge_sfstudy_read_info(file, &file_run_no, &file_project)) return 1;
+    if (!*sf_init) {
+        rge_sfstudy_init(sf, file_project, fixed_seeds);
+        *sf_init = true;
+        *run_no  = file_run_no;
+    }
+    else if (file_run_no != *run_no || file_project != sf->project) {
+        rge_errno = RGEERR_BADSFPARTIAL;
         return 1;
     }
 
-    // Create histogram and name arrays.
-    std::map<const char *, TH1 *> histos;
+    return rge_sfstudy_add(sf, file);
+}
 
-    char *sf1D_name_arr[NCALS][RGE_NSECTORS][
-            static_cast<luint>(((SF_PMAX - SF_PMIN)/SF_PSTEP))
-    ];
-    char *sf2D_name_arr[NCALS][RGE_NSECTORS];
-    TGraphErrors *sf_dotgraph[NCALS][RGE_NSECTORS];
-    char *sf2Dfit_name_arr[NCALS][RGE_NSECTORS];
-    TF1 *sf_polyfit[NCALS][RGE_NSECTORS];
-    double sf_fitresults[NCALS][RGE_NSECTORS][RGE_NSFPARAMS][2];
+// --+ library +----------------------------------------------------------------
+int rge_sfstudy_init(rge_sfstudy *sf, bool project, bool fixed_seeds) {
+    // Configure ROOT fitting.
+    gStyle->SetOptFit();
 
-    // Configure 2D histogram arrays.
-    int cal_idx = -1;
-    for (const char *cal : SFARR2D) {
-        cal_idx++;
+    // Configure 2D histogram arrays. Histograms are detached from the current
+    //     directory, so that they outlive any file opened or closed before
+    //     rge_sfstudy_free().
+    sf->project     = project;
+    sf->fixed_seeds = fixed_seeds;
+    for (int cal_i = 0; cal_i < NCALS; ++cal_i) {
         for (int sector_i = 0; sector_i < RGE_NSECTORS; ++sector_i) {
-            // Initialize dotgraphs.
-            char *tmp_str = Form("%s%d)", cal, sector_i+1);
-            sf2D_name_arr[cal_idx][sector_i] =
-                    static_cast<char *>(malloc(strlen(tmp_str)+1));
-            strncpy(sf2D_name_arr[cal_idx][sector_i], tmp_str, strlen(tmp_str));
-            insert_TH2F(
-                    &histos, CALNAME[ECAL_IDX],
-                    sf2D_name_arr[cal_idx][sector_i], RGE_P.name, R_EDIVP,
+            // Initialize histograms and dotgraphs.
+            char *name = Form("%s%d)", SFARR2D[cal_i], sector_i+1);
+            sf->h2D[cal_i][sector_i] = new TH2F(
+                    Form("%s: %s", CALNAME[ECAL_IDX], name),
+                    Form("%s;%s;%s", name, RGE_P.name, R_EDIVP),
                     200, 0, 10, 200, 0, 0.4
             );
-            sf_dotgraph[cal_idx][sector_i] = new TGraphErrors();
-            sf_dotgraph[cal_idx][sector_i]->SetMarkerStyle(kFullCircle);
-            sf_dotgraph[cal_idx][sector_i]->SetMarkerColor(kRed);
+            sf->h2D[cal_i][sector_i]->SetDirectory(NULL);
+            sf->dotgraph[cal_i][sector_i] = new TGraphErrors();
+            sf->dotgraph[cal_i][sector_i]->SetMarkerStyle(kFullCircle);
+            sf->dotgraph[cal_i][sector_i]->SetMarkerColor(kRed);
 
             // Initialize fits.
-            sf2Dfit_name_arr[cal_idx][sector_i] =
-                    static_cast<char *>(malloc(strlen(tmp_str)+1));
-            strncpy(
-                    sf2Dfit_name_arr[cal_idx][sector_i], tmp_str,
-                    strlen(tmp_str)
-            );
-            sf_polyfit[cal_idx][sector_i] = new TF1(
-                    sf2Dfit_name_arr[cal_idx][sector_i],
-                    "[0]*([1]+[2]/x + [3]/(x*x))", SF_PMIN+SF_PSTEP,
+            sf->polyfit[cal_i][sector_i] = new TF1(
+                    name, "[0]*([1]+[2]/x + [3]/(x*x))", SF_PMIN+SF_PSTEP,
                     SF_PMAX-SF_PSTEP
             );
-            sf_polyfit[cal_idx][sector_i]->SetParameter(0 /* p0 */, 0.25);
-            sf_polyfit[cal_idx][sector_i]->SetParameter(1 /* p1 */, 1);
-            sf_polyfit[cal_idx][sector_i]->SetParameter(2 /* p2 */, 0);
-            sf_polyfit[cal_idx][sector_i]->SetParameter(3 /* p3 */, 0);
+            sf->polyfit[cal_i][sector_i]->SetParameter(0 /* p0 */, 0.25);
+            sf->polyfit[cal_i][sector_i]->SetParameter(1 /* p1 */, 1);
+            sf->polyfit[cal_i][sector_i]->SetParameter(2 /* p2 */, 0);
+            sf->polyfit[cal_i][sector_i]->SetParameter(3 /* p3 */, 0);
         }
     }
 
-    // Configure 1D histogram arrays.
-    cal_idx = -1;
-    for (const char *cal : SFARR1D) {
-        cal_idx++;
+    // Configure 1D histogram arrays. If projecting, they're created by
+    //     rge_sfstudy_fit().
+    for (int cal_i = 0; cal_i < NCALS; ++cal_i) {
         for (int sector_i = 0; sector_i < RGE_NSECTORS; ++sector_i) {
-            int param_i = -1;
-            for (double p = SF_PMIN; p < SF_PMAX; p += SF_PSTEP) {
-                param_i++;
-                char *tmp_str = Form(
-                        "%s%d (%5.2f < p < %5.2f)", cal, sector_i + 1, p,
-                        p + SF_PSTEP
-                );
-                sf1D_name_arr[cal_idx][sector_i][param_i] =
-                        static_cast<char *>(malloc(strlen(tmp_str)+1));
-                strncpy(
-                        sf1D_name_arr[cal_idx][sector_i][param_i], tmp_str,
-                        strlen(tmp_str)
-                );
-                insert_TH1F(
-                        &histos, CALNAME[ECAL_IDX],
-                        sf1D_name_arr[cal_idx][sector_i][param_i], R_EDIVP,
-                        200, 0, 0.4
+            for (int pbin = 0; pbin < SF_NPBINS; ++pbin) {
+                sf->h1D[cal_i][sector_i][pbin] = NULL;
+                if (project) continue;
+
+                char name[SF_NAMELEN];
+                name_1D(name, cal_i, sector_i, pbin);
+                sf->h1D[cal_i][sector_i][pbin] = new TH1F(
+                        Form("%s: %s", CALNAME[ECAL_IDX], name),
+                        Form("%s;%s", name, R_EDIVP), 200, 0, 0.4
                 );
+                sf->h1D[cal_i][sector_i][pbin]->SetDirectory(NULL);
             }
         }
     }
 
-    // Create TTree and link rge_hipobanks.
-    TTree *t = f_in->Get<TTree>(RGE_TREENAMEDATA);
-    rge_hipobank particle    = rge_hipobank_init(RGE_RECPARTICLE,    t);
-    rge_hipobank track       = rge_hipobank_init(RGE_RECTRACK,       t);
-    rge_hipobank calorimeter = rge_hipobank_init(RGE_RECCALORIMETER, t);
-
-    // Iterate through input file. Each TTree entry is one event.
-    if (nevn == -1 || t->GetEntries() < nevn) nevn = t->GetEntries();
-    rge_pbar_set_nentries(nevn);
+    return 0;
+}
 
-    printf("Reading %ld events from %s.\n", nevn, in_filename);
-    for (lint evn = 0; evn < nevn; ++evn) {
-        rge_pbar_update(evn);
+int rge_sfstudy_fill(
+        rge_sfstudy *sf, rge_hipobank *particle, rge_hipobank *track,
+        rge_hipobank *calorimeter
+) {
+    // Skip events without the necessary banks.
+    if (particle->nrows == 0 || track->nrows == 0 || calorimeter->nrows == 0) {
+        return 0;
+    }
 
-        // Get entries from bank containers.
-        rge_get_entries(&particle,    t, evn);
-        rge_get_entries(&track,       t, evn);
-        rge_get_entries(&calorimeter, t, evn);
+    // Check that the columns read are loaded. Rows are only read within
+    //     bounds below, so the accessors can't fail after this.
+    if (
+            (particle->colmask    & RGE_SFSTUDY_PARTCOLS) !=
+                    RGE_SFSTUDY_PARTCOLS ||
+            (track->colmask       & RGE_SFSTUDY_TRKCOLS)  !=
+                    RGE_SFSTUDY_TRKCOLS  ||
+            (calorimeter->colmask & RGE_SFSTUDY_CALCOLS)  !=
+                    RGE_SFSTUDY_CALCOLS
+    ) {
+        rge_errno = RGEERR_INVALIDENTRY;
+        return 1;
+    }
 
-        // Skip events without the necessary banks.
-        if (particle.nrows == 0 || track.nrows == 0 || calorimeter.nrows == 0) {
-            continue;
+    // Group calorimeter rows by pindex.
+    rge_pindexmap *cal_map = &(sf->cal_map);
+    rge_pindexmap_fill(cal_map, calorimeter, RGE_CAL_PINDEX, particle->nrows);
+
+    // Iterate through entries and write data to histograms.
+    for (luint row = 0; row < track->nrows; ++row) {
+        // Get basic data from track and particle banks.
+        uint pindex = rge_get_uint(track, RGE_TRK_PINDEX, row);
+        if (pindex >= particle->nrows) continue;
+
+        // Get particle momentum.
+        double px = rge_get_double(particle, RGE_PART_PX, pindex);
+        double py = rge_get_double(particle, RGE_PART_PY, pindex);
+        double pz = rge_get_double(particle, RGE_PART_PZ, pindex);
+        double total_p = rge_calc_magnitude(px, py, pz);
+
+        // Compute energy deposited in each calorimeter per sector.
+        double sf_E[NCALS][RGE_NSECTORS];
+        for (int cal_i = 0; cal_i < NCALS; ++cal_i) {
+            for (int sector_i = 0; sector_i < RGE_NSECTORS; ++sector_i) {
+                sf_E[cal_i][sector_i] = 0;
+            }
         }
 
-        // Iterate through entries and write data to histograms.
-        for (luint row = 0; row < track.nrows; ++row) {
-            // Get basic data from track and particle banks.
-            uint pindex = rge_get_uint(&track, "pindex", row);
-
-            // Get particle momentum.
-            double px = rge_get_double(&particle, "px", pindex);
-            double py = rge_get_double(&particle, "py", pindex);
-            double pz = rge_get_double(&particle, "pz", pindex);
-            if (rge_errno != RGEERR_UNDEFINED) return 1;
-            double total_p = rge_calc_magnitude(px, py, pz);
-
-            // Compute energy deposited in each calorimeter per sector.
-            double sf_E[NCALS][RGE_NSECTORS];
-            for (int cal_i = 0; cal_i < NCALS; ++cal_i) {
-                for (int sector_i = 0; sector_i < RGE_NSECTORS; ++sector_i) {
-                    sf_E[cal_i][sector_i] = 0;
-                }
+        for (
+                luint map_i = cal_map->offsets[pindex];
+                map_i < cal_map->offsets[pindex + 1];
+                ++map_i
+        ) {
+            luint entry_i = cal_map->rows[map_i];
+
+            // Get sector.
+            int sector_i =
+                    rge_get_int(calorimeter, RGE_CAL_SECTOR, entry_i) - 1;
+            if (sector_i == -1) continue;
+            if (sector_i < -1 || sector_i > RGE_NSECTORS-1) {
+                rge_errno = RGEERR_INVALIDCALSECTOR;
+                return 1;
             }
 
-            for (luint entry_i = 0; entry_i < calorimeter.nrows; ++entry_i) {
-                if (rge_get_uint(&calorimeter, "pindex", entry_i) != pindex) {
-                    continue;
-                }
-
-                // Get sector.
-                int sector_i =
-                        rge_get_double(&calorimeter, "sector", entry_i) - 1;
-                if (rge_errno != RGEERR_UNDEFINED) return 1;
-                if (sector_i == -1) continue;
-                if (sector_i < -1 || sector_i > RGE_NSECTORS-1) {
-                    rge_errno = RGEERR_INVALIDCALSECTOR;
+            // Get detector.
+            double energy =
+                    rge_get_double(calorimeter, RGE_CAL_ENERGY, entry_i);
+            switch(rge_get_int(calorimeter, RGE_CAL_LAYER, entry_i)) {
+                case PCAL_LYR:
+                    sf_E[PCAL_IDX][sector_i] += energy;
+                    break;
+                case ECIN_LYR:
+                    sf_E[ECIN_IDX][sector_i] += energy;
+                    break;
+                case ECOU_LYR:
+                    sf_E[ECOU_IDX][sector_i] += energy;
+                    break;
+                default:
+                    rge_errno = RGEERR_INVALIDCALLAYER;
                     return 1;
-                }
-
-                // Get detector.
-                double energy = rge_get_double(&calorimeter, "energy", entry_i);
-                if (rge_errno != RGEERR_UNDEFINED) return 1;
-                switch(rge_get_int(&calorimeter, "layer", entry_i)) {
-                    case PCAL_LYR:
-                        sf_E[PCAL_IDX][sector_i] += energy;
-                        break;
-                    case ECIN_LYR:
-                        sf_E[ECIN_IDX][sector_i] += energy;
-                        break;
-                    case ECOU_LYR:
-                        sf_E[ECOU_IDX][sector_i] += energy;
-                        break;
-                    default:
-                        rge_errno = RGEERR_INVALIDCALLAYER;
-                        return 1;
-                }
-            }
-
-            for (int cal_i = 0; cal_i < NCALS-1; ++cal_i) {
-                for (int sector_i = 0; sector_i < RGE_NSECTORS; ++sector_i) {
-                    sf_E[ECAL_IDX][sector_i] += sf_E[cal_i][sector_i];
-                }
             }
+        }
 
-            // Get momentum bin.
-            if (total_p < SF_PMIN || total_p > SF_PMAX) continue;
-            int param_i = -1;
-            for (double p_cnt = SF_PMIN; p_cnt <= SF_PMAX; p_cnt += SF_PSTEP) {
-                if (total_p < p_cnt) break;
-                ++param_i;
+        for (int cal_i = 0; cal_i < NCALS-1; ++cal_i) {
+            for (int sector_i = 0; sector_i < RGE_NSECTORS; ++sector_i) {
+                sf_E[ECAL_IDX][sector_i] += sf_E[cal_i][sector_i];
             }
+        }
 
-            // Write to histograms.
-            for (int cal_i = 0; cal_i < NCALS; ++cal_i) {
-                for (int sector_i = 0; sector_i < RGE_NSECTORS; ++sector_i) {
-                    if (sf_E[cal_i][sector_i] <= 0) continue;
-                    histos[sf2D_name_arr[cal_i][sector_i]]->Fill(
-                            total_p, sf_E[cal_i][sector_i]/total_p
-                    );
-                    histos[sf1D_name_arr[cal_i][sector_i][param_i]]->Fill(
-                            sf_E[cal_i][sector_i]/total_p
-                    );
-                }
+        // Get momentum bin.
+        int pbin = get_pbin(total_p);
+        if (pbin == -1) continue;
+
+        // Write to histograms.
+        for (int cal_i = 0; cal_i < NCALS; ++cal_i) {
+            for (int sector_i = 0; sector_i < RGE_NSECTORS; ++sector_i) {
+                if (sf_E[cal_i][sector_i] <= 0) continue;
+                double EdivP = sf_E[cal_i][sector_i]/total_p;
+                sf->h2D[cal_i][sector_i]->Fill(total_p, EdivP);
+                if (!sf->project) sf->h1D[cal_i][sector_i][pbin]->Fill(EdivP);
             }
         }
     }
 
-    // Fit histograms.
-    cal_idx = -1;
-    for (const char *cal : SFARR1D) {
-        ++cal_idx;
-        for (int sector_i = 0; sector_i < RGE_NSECTORS; ++sector_i) {
-            int param_idx = -1;
-            int point_idx = 0;
-            // Fit 1D plots for each momentum bin to fill dotgraphs.
-            for (double p = SF_PMIN; p < SF_PMAX; p += SF_PSTEP) {
-                ++param_idx;
-
-                // Get ref to histogram.
-                TH1 *EdivP = histos[
-                        sf1D_name_arr[cal_idx][sector_i][param_idx]
-                ];
-
-                // Form fit string name.
-                char *tmp_str = Form(
-                        "%s%d (%5.2f < p < %5.2f) fit", cal, sector_i+1,
-                        p, p+SF_PSTEP
-                );
+    return 0;
+}
 
-                // Fit.
-                TF1 *sf_gaus = new TF1(tmp_str,
-                        "[0]*TMath::Gaus(x,[1],[2]) + [3]*x*x + [4]*x + [5]",
-                        PLIMITSARR[cal_idx][0], PLIMITSARR[cal_idx][1]);
-                sf_gaus->SetParameter(0 /* amp   */,
-                        EdivP->GetBinContent(EdivP->GetMaximumBin()));
-                sf_gaus->SetParLimits(1,
-                        PLIMITSARR[cal_idx][0], PLIMITSARR[cal_idx][1]
-                );
-                sf_gaus->SetParameter(1 /* mean  */,
-                        (PLIMITSARR[cal_idx][1] + PLIMITSARR[cal_idx][0])/2
-                );
-                sf_gaus->SetParLimits(2, 0., 0.1);
-                sf_gaus->SetParameter(2 /* sigma */, 0.05);
-                sf_gaus->SetParameter(3 /* p0 */,    0);
-                sf_gaus->SetParameter(4 /* p1 */,    0);
-                sf_gaus->SetParameter(5 /* p2 */,    0);
-                EdivP->Fit(
-                        sf_gaus, "QR", "",
-                        PLIMITSARR[cal_idx][0], PLIMITSARR[cal_idx][1]
-                );
+int rge_sfstudy_fit(
+        rge_sfstudy *sf, char *work_dir, const char *sf_filename, int run_no,
+        int nthreads
+) {
+    // Create output root file.
+    char out_rootfilename[PATH_MAX];
+    sprintf(out_rootfilename, "%s/sf_study_%06d.root", work_dir, run_no);
+    TFile *out_rootfile = TFile::Open(out_rootfilename, "RECREATE");
+    if (!out_rootfile || out_rootfile->IsZombie()) {
+        delete out_rootfile;
+        rge_errno = RGEERR_OUTPUTROOTFAILED;
+        return 1;
+    }
 
-                // Extract mean and sigma from fit and add it to 2D plots.
-                double mean  = sf_gaus->GetParameter(1);
-                double sigma = sf_gaus->GetParameter(2);
-
-                // Only add points within PLIMITSARR borders and with an
-                // acceptable chi2.
-                if (
-                        (
-                                mean - 2*sigma > PLIMITSARR[cal_idx][0] &&
-                                mean + 2*sigma < PLIMITSARR[cal_idx][1]
-                        ) &&
-                        (
-                                sf_gaus->GetChisquare() / sf_gaus->GetNDF() <
-                                SF_CHI2CONFORMITY
-                        )
-                ) {
-                    sf_dotgraph[cal_idx][sector_i]->SetPoint(
-                            point_idx, p + SF_PSTEP/2, mean
+    // Create output data file. It's written under a temporary name and renamed
+    //     once complete, so other processes never read a partially written
+    //     file.
+    char tmp_textfilename[PATH_MAX];
+    sprintf(tmp_textfilename, "%s.tmp.%d", sf_filename, getpid());
+    FILE *out_textfile = fopen(tmp_textfilename, "w");
+    if (out_textfile == NULL) {
+        out_rootfile->Close();
+        delete out_rootfile;
+        rge_errno = RGEERR_OUTPUTTEXTFAILED;
+        return 1;
+    }
+
+    double sf_fitresults[NCALS][RGE_NSECTORS][RGE_NSFPARAMS][2];
+    sf_fitstats sf_stats[NCALS][RGE_NSECTORS] = {};
+
+    // Project 1D histograms from the p bins of the 2D histograms that fall
+    //     inside each momentum bin.
+    if (sf->project) {
+        for (int cal_i = 0; cal_i < NCALS; ++cal_i) {
+            for (int sector_i = 0; sector_i < RGE_NSECTORS; ++sector_i) {
+                TH2 *h2D = sf->h2D[cal_i][sector_i];
+                TAxis *p_axis = h2D->GetXaxis();
+                double half_width = p_axis->GetBinWidth(1) / 2;
+                for (int pbin = 0; pbin < SF_NPBINS; ++pbin) {
+                    double p = SF_PMIN + pbin * SF_PSTEP;
+                    char name[SF_NAMELEN];
+                    name_1D(name, cal_i, sector_i, pbin);
+
+                    TH1 *h1D = h2D->ProjectionY(
+                            Form("%s: %s", CALNAME[ECAL_IDX], name),
+                            p_axis->FindBin(p + half_width),
+                            p_axis->FindBin(p + SF_PSTEP - half_width)
                     );
-                    point_idx++;
+                    h1D->SetTitle(Form("%s;%s", name, R_EDIVP));
+                    h1D->SetDirectory(NULL);
+                    sf->h1D[cal_i][sector_i][pbin] = h1D;
                 }
             }
+        }
+    }
 
-            // Fit dotgraphs.
-            if (sf_dotgraph[cal_idx][sector_i]->GetN() > 0) {
-                sf_dotgraph[cal_idx][sector_i]->Fit(
-                        sf_polyfit[cal_idx][sector_i], "QR", "",
-                        SF_PMIN+SF_PSTEP, SF_PMAX-SF_PSTEP
-                );
-            }
+    // Fit histograms, one calorimeter and sector per task.
+    if (nthreads > NCALS * RGE_NSECTORS) nthreads = NCALS * RGE_NSECTORS;
+    printf("Fitting sampling fraction with %d threads.\n", nthreads);
+    std::chrono::steady_clock::time_point fit_start =
+            std::chrono::steady_clock::now();
 
-            // Extract and save dotgraph fits parameters to make cuts from them.
-            for (
-                    int param_i = 0;
-                    param_i < sf_polyfit[cal_idx][sector_i]->GetNpar();
-                    ++param_i
-            ) {
-                // Sampling fraction (sf in CCDB).
-                sf_fitresults[cal_idx][sector_i][param_i][0] =
-                        sf_polyfit[cal_idx][sector_i]->GetParameter(param_i);
-                // Sampling fraction sigma (sfs in CCDB).
-                sf_fitresults[cal_idx][sector_i][param_i][1] =
-                        sf_polyfit[cal_idx][sector_i]->GetParError(param_i);
-            }
+    std::atomic<int> next_task(0);
+    if (nthreads == 1) {
+        fit_worker(sf, &next_task, 0, NULL, sf_fitresults, sf_stats);
+    }
+    else {
+        // Fits use ROOT's default minimizer, so the results don't depend on
+        //     nthreads. Unless it's Minuit2, which is set in rootrc with
+        //     Root.Fitter, calls to it are serialized, since TMinuit can't run
+        //     in several threads at once. The rest of each task still runs in
+        //     parallel.
+        ROOT::EnableThreadSafety();
+        std::mutex minuit_mtx;
+        std::mutex *fit_mtx = &minuit_mtx;
+        if (ROOT::Math::MinimizerOptions::DefaultMinimizerType() == "Minuit2") {
+            fit_mtx = NULL;
+        }
+        std::vector<std::thread> workers;
+        for (int thread_i = 0; thread_i < nthreads; ++thread_i) {
+            workers.emplace_back(
+                    fit_worker, sf, &next_task, thread_i, fit_mtx,
+                    sf_fitresults, sf_stats
+            );
+        }
+        for (std::thread &worker : workers) worker.join();
+    }
+
+    std::chrono::duration<double> fit_time =
+            std::chrono::steady_clock::now() - fit_start;
+    printf("Fit stage took %.2f s.\n", fit_time.count());
+
+    // Print fit statistics, summed in task order so they don't depend on
+    //     nthreads.
+    sf_fitstats total = {};
+    for (int cal_i = 0; cal_i < NCALS; ++cal_i) {
+        for (int sector_i = 0; sector_i < RGE_NSECTORS; ++sector_i) {
+            total.nslices   += sf_stats[cal_i][sector_i].nslices;
+            total.nestimate += sf_stats[cal_i][sector_i].nestimate;
+            total.nminuit   += sf_stats[cal_i][sector_i].nminuit;
+            total.nfailed   += sf_stats[cal_i][sector_i].nfailed;
+            total.npoints   += sf_stats[cal_i][sector_i].npoints;
+            total.ncalls    += sf_stats[cal_i][sector_i].ncalls;
         }
     }
+    printf(
+            "%d slices: %d from the moment estimate, %d fitted (%.1f calls "
+            "per fit, %d failed).\n",
+            total.nslices, total.nestimate, total.nminuit,
+            total.nminuit > 0 ?
+                    static_cast<double>(total.ncalls) / total.nminuit : 0.,
+            total.nfailed
+    );
+    printf(
+            "%d of %d slices passed the chi2 and range cuts.\n",
+            total.npoints, total.nslices
+    );
 
     // Write to output root file to visualize the fits.
     TString dir;
@@ -384,22 +592,14 @@ int rge_extract_sf(
             out_rootfile->mkdir(dir);
             out_rootfile->cd(dir);
 
-            histos[sf2D_name_arr[cal_i][sector_i]]->Draw("colz");
-            sf_dotgraph[cal_i][sector_i]->Draw("Psame");
-            sf_polyfit[cal_i][sector_i]->Draw("same");
-            gcvs->Write(sf2D_name_arr[cal_i][sector_i]);
-
-            // Free arrays after writing.
-            free(sf2D_name_arr[cal_i][sector_i]);
-            for (
-                    int param_i = 0;
-                    param_i < static_cast<int>(((SF_PMAX-SF_PMIN) / SF_PSTEP));
-                    ++param_i
-            ) {
-                histos[sf1D_name_arr[cal_i][sector_i][param_i]]->Write();
-                free(sf1D_name_arr[cal_i][sector_i][param_i]);
+            sf->h2D[cal_i][sector_i]->Draw("colz");
+            sf->dotgraph[cal_i][sector_i]->Draw("Psame");
+            sf->polyfit[cal_i][sector_i]->Draw("same");
+            gcvs->Write(sf->h2D[cal_i][sector_i]->GetTitle());
+
+            for (int pbin = 0; pbin < SF_NPBINS; ++pbin) {
+                sf->h1D[cal_i][sector_i][pbin]->Write();
             }
-            free(sf2Dfit_name_arr[cal_i][sector_i]);
         }
     }
 
@@ -418,12 +618,228 @@ int rge_extract_sf(
         }
     }
 
-    // Clean up after ourselves.
-    fclose(out_textfile);
-    f_in ->Close();
+    // Close output files.
+    delete gcvs;
     out_rootfile->Close();
+    delete out_rootfile;
+    if (fclose(out_textfile) != 0) {
+        unlink(tmp_textfilename);
+        rge_errno = RGEERR_OUTPUTTEXTFAILED;
+        return 1;
+    }
+    if (rename(tmp_textfilename, sf_filename) != 0) {
+        unlink(tmp_textfilename);
+        rge_errno = RGEERR_OUTPUTTEXTFAILED;
+        return 1;
+    }
+
+    return 0;
+}
+
+int rge_sfstudy_write(rge_sfstudy *sf, char *filename, int run_no) {
+    TFile *file = TFile::Open(filename, "RECREATE");
+    if (!file || file->IsZombie()) {
+        delete file;
+        rge_errno = RGEERR_OUTPUTROOTFAILED;
+        return 1;
+    }
+
+    // Write run number and projection setting, so that partials of different
+    //     runs or settings aren't merged by mistake.
+    TParameter<int>(SF_PARTIAL_RUNNO, run_no).Write();
+    TParameter<int>(SF_PARTIAL_PROJECT, sf->project ? 1 : 0).Write();
+
+    // Write histograms. 1D histograms are skipped if they're projected, since
+    //     they're empty.
+    char key[SF_NAMELEN];
+    for (int cal_i = 0; cal_i < NCALS; ++cal_i) {
+        for (int sector_i = 0; sector_i < RGE_NSECTORS; ++sector_i) {
+            partial_key_2D(key, cal_i, sector_i);
+            sf->h2D[cal_i][sector_i]->Write(key);
+            if (sf->project) continue;
+            for (int pbin = 0; pbin < SF_NPBINS; ++pbin) {
+                partial_key_1D(key, cal_i, sector_i, pbin);
+                sf->h1D[cal_i][sector_i][pbin]->Write(key);
+            }
+        }
+    }
+
+    file->Close();
+    delete file;
+    return 0;
+}
+
+int rge_sfstudy_read_info(TFile *file, int *run_no, bool *project) {
+    TParameter<int> *run_par = file->Get<TParameter<int>>(SF_PARTIAL_RUNNO);
+    TParameter<int> *prj_par = file->Get<TParameter<int>>(SF_PARTIAL_PROJECT);
+    if (run_par == NULL || prj_par == NULL) {
+        rge_errno = RGEERR_BADSFPARTIAL;
+        return 1;
+    }
+
+    *run_no  = run_par->GetVal();
+    *project = prj_par->GetVal() != 0;
+    return 0;
+}
+
+int rge_sfstudy_add(rge_sfstudy *sf, TFile *file) {
+    char key[SF_NAMELEN];
+    for (int cal_i = 0; cal_i < NCALS; ++cal_i) {
+        for (int sector_i = 0; sector_i < RGE_NSECTORS; ++sector_i) {
+            partial_key_2D(key, cal_i, sector_i);
+            TH2 *h2D = file->Get<TH2>(key);
+            if (h2D == NULL) {
+                rge_errno = RGEERR_BADSFPARTIAL;
+                return 1;
+            }
+            sf->h2D[cal_i][sector_i]->Add(h2D);
+
+            if (sf->project) continue;
+            for (int pbin = 0; pbin < SF_NPBINS; ++pbin) {
+                partial_key_1D(key, cal_i, sector_i, pbin);
+                TH1 *h1D = file->Get<TH1>(key);
+                if (h1D == NULL) {
+                    rge_errno = RGEERR_BADSFPARTIAL;
+                    return 1;
+                }
+                sf->h1D[cal_i][sector_i][pbin]->Add(h1D);
+            }
+        }
+    }
+
+    return 0;
+}
+
+int rge_sfstudy_free(rge_sfstudy *sf) {
+    for (int cal_i = 0; cal_i < NCALS; ++cal_i) {
+        for (int sector_i = 0; sector_i < RGE_NSECTORS; ++sector_i) {
+            for (int pbin = 0; pbin < SF_NPBINS; ++pbin) {
+                delete sf->h1D[cal_i][sector_i][pbin];
+                sf->h1D[cal_i][sector_i][pbin] = NULL;
+            }
+            delete sf->h2D[cal_i][sector_i];
+            delete sf->dotgraph[cal_i][sector_i];
+            delete sf->polyfit[cal_i][sector_i];
+        }
+    }
+
+    return 0;
+}
+
+int rge_extract_sf(
+        char *in_filename, char *work_dir, char *data_dir, lint nevn,
+        int run_no, bool project, bool fixed_seeds, int nthreads,
+        char *partial_filename
+) {
+    // Create histograms.
+    rge_sfstudy sf;
+    rge_sfstudy_init(&sf, project, fixed_seeds);
+
+    // Access input file, either a hipo2root output or a HIPO file.
+    rge_eventloader loader;
+    if (rge_loader_open(&loader, in_filename)) return 1;
+
+    // Link rge_hipobanks to input file.
+    rge_hipobank particle    = rge_hipobank_init(RGE_RECPARTICLE);
+    rge_hipobank track       = rge_hipobank_init(RGE_RECTRACK);
+    rge_hipobank calorimeter = rge_hipobank_init(RGE_RECCALORIMETER);
+    if (
+            rge_loader_add_bank(&loader, &particle,    RGE_SFSTUDY_PARTCOLS) ||
+            rge_loader_add_bank(&loader, &track,       RGE_SFSTUDY_TRKCOLS)  ||
+            rge_loader_add_bank(&loader, &calorimeter, RGE_SFSTUDY_CALCOLS)
+    ) return 1;
+
+    // Iterate through input file.
+    if (nevn == -1 || loader.nevents < nevn) nevn = loader.nevents;
+    rge_pbar_set_nentries(nevn);
+
+    printf("Reading %ld events from %s.\n", nevn, in_filename);
+    for (lint evn = 0; evn < nevn; ++evn) {
+        rge_pbar_update(evn);
+
+        // Get entries from bank containers and write them to histograms.
+        if (rge_loader_get_event(&loader, evn)) return 1;
+        if (rge_sfstudy_fill(&sf, &particle, &track, &calorimeter)) return 1;
+    }
+
+    // Print I/O usage to check that only the required columns are read.
+    lint bytes_read = rge_loader_bytes_read(&loader);
+    if (bytes_read >= 0 && nevn > 0) {
+        printf(
+                "Read %ld bytes from input (%.1f per event).\n",
+                bytes_read, static_cast<double>(bytes_read) / nevn
+        );
+    }
+
+    // Write histograms to partial file, or fit them and write output files.
+    if (partial_filename != NULL) {
+        if (rge_sfstudy_write(&sf, partial_filename, run_no)) return 1;
+    }
+    else {
+        char sf_filename[PATH_MAX];
+        sprintf(sf_filename, "%s/sf_params_%06d.txt", data_dir, run_no);
+        if (rge_sfstudy_fit(&sf, work_dir, sf_filename, run_no, nthreads)) {
+            return 1;
+        }
+    }
+
+    // Clean up after ourselves.
+    rge_loader_close(&loader);
+    rge_hipobank_free(&particle);
+    rge_hipobank_free(&track);
+    rge_hipobank_free(&calorimeter);
+    rge_sfstudy_free(&sf);
 
     // Exit.
     rge_errno = RGEERR_NOERR;
     return 0;
 }
+
+int rge_merge_sf(
+        char **in_filenames, int n_in, char *work_dir, char *data_dir,
+        bool fixed_seeds, int nthreads, char *partial_filename
+) {
+    rge_sfstudy sf;
+    bool sf_init = false;
+    int run_no   = -1;
+
+    // Add up partial files. The study is created from the settings of the
+    //     first one, and every other one has to match them.
+    printf("Merging %d partial files.\n", n_in);
+    for (int file_i = 0; file_i < n_in; ++file_i) {
+        TFile *file = TFile::Open(in_filenames[file_i], "READ");
+        if (!file || file->IsZombie()) {
+            delete file;
+            if (sf_init) rge_sfstudy_free(&sf);
+            rge_errno = RGEERR_BADINPUTFILE;
+            return 1;
+        }
+
+        int err = add_partial(&sf, &sf_init, file, fixed_seeds, &run_no);
+        file->Close();
+        delete file;
+        if (err) {
+            if (sf_init) rge_sfstudy_free(&sf);
+            return 1;
+        }
+    }
+
+    // Write merged histograms to partial file, or fit them and write output
+    //     files.
+    int err = 0;
+    if (partial_filename != NULL) {
+        err = rge_sfstudy_write(&sf, partial_filename, run_no);
+    }
+    else {
+        char sf_filename[PATH_MAX];
+        sprintf(sf_filename, "%s/sf_params_%06d.txt", data_dir, run_no);
+        err = rge_sfstudy_fit(&sf, work_dir, sf_filename, run_no, nthreads);
+    }
+
+    // Clean up after ourselves.
+    rge_sfstudy_free(&sf);
+    if (err) return 1;
+
+    rge_errno = RGEERR_NOERR;
+    return 0;
+}
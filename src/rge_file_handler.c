@@ -16,6 +16,44 @@
 #include "../lib/rge_file_handler.h"
 
 // --+ internal +---------------------------------------------------------------
+int sflock_name(char *lock_filename, const char *sf_filename) {
+    snprintf(lock_filename, PATH_MAX, "%s.lock", sf_filename);
+    return 0;
+}
+
+bool break_sflock(const char *lock_filename, const struct stat *stale_stat) {
+    // Processes sharing the data directory can run on different hosts.
+    char host[HOST_NAME_MAX + 1];
+    if (gethostname(host, sizeof(host)) != 0) host[0] = '\0';
+    host[HOST_NAME_MAX] = '\0';
+    char taken_filename[PATH_MAX];
+    snprintf(
+            taken_filename, PATH_MAX, "%s.stale.%s.%d", lock_filename, host,
+            getpid()
+    );
+    if (rename(lock_filename, taken_filename) != 0) return false;
+
+    // Check that the file taken is the stale lock. Inodes can be reused, so
+    //     its modification time is checked too.
+    struct stat taken_stat;
+    if (
+            stat(taken_filename, &taken_stat) == 0 && (
+                    taken_stat.st_dev != stale_stat->st_dev     ||
+                    taken_stat.st_ino != stale_stat->st_ino     ||
+                    time(NULL) - taken_stat.st_mtime <= SFLOCK_STALE
+            )
+    ) {
+        // Put the new lock back. link() fails instead of replacing a lock
+        //     taken in the meantime.
+        link(taken_filename, lock_filename);
+        unlink(taken_filename);
+        return false;
+    }
+
+    unlink(taken_filename);
+    return true;
+}
+
 int get_bin_edges(
         FILE *file_in, luint *bin_nedges, double **bin_edges, luint *pids_size
 ) {
@@ -41,8 +79,8 @@ int get_bin_edges(
 }
 
 int get_acc_corr(
-        FILE *file_in, luint pids_size, luint nbins, lint *pids, int **n_thrown,
-        int **n_simul
+        FILE *file_in, luint pids_size, luint nbins, lint *pids,
+        luint **n_thrown, luint **n_simul
 ) {
     // Get PIDs.
     for (luint pid_i = 0; pid_i < pids_size; ++pid_i) {
@@ -52,22 +90,247 @@ int get_acc_corr(
     // Get acceptance correction.
     for (luint pid_i = 0; pid_i < pids_size; ++pid_i) {
         // Get number of thrown events.
-        n_thrown[pid_i] = static_cast<int *>(
+        n_thrown[pid_i] = static_cast<luint *>(
                 malloc(nbins * sizeof(*n_thrown[pid_i]))
         );
         for (luint bin_i = 0; bin_i < nbins; ++bin_i) {
-            fscanf_dump = fscanf(file_in, "%d ", &(n_thrown[pid_i][bin_i]));
+            fscanf_dump = fscanf(file_in, "%lu ", &(n_thrown[pid_i][bin_i]));
         }
 
         // Get number of simulated events.
-        n_simul[pid_i] = static_cast<int *>(
+        n_simul[pid_i] = static_cast<luint *>(
                 malloc(nbins * sizeof(*n_simul[pid_i]))
         );
         for (luint bin_i = 0; bin_i < nbins; ++bin_i) {
-            fscanf_dump = fscanf(file_in, "%d ", &(n_simul[pid_i][bin_i]));
+            fscanf_dump = fscanf(file_in, "%lu ", &(n_simul[pid_i][bin_i]));
+        }
+    }
+
+    return 0;
+}
+
+int write_counts(FILE *file, rge_binstore *evn_cnt, luint nbins[5], bool text) {
+    luint nfill = 1;
+    for (int bi = evn_cnt->ndims; bi < 5; ++bi) nfill *= nbins[bi];
+
+    if (text) {
+        for (luint cell = 0; cell < evn_cnt->ncells; ++cell) {
+            fprintf(file, "%lu ", rge_binstore_get(evn_cnt, cell));
+            for (luint fill_i = 1; fill_i < nfill; ++fill_i) {
+                fprintf(file, "0 ");
+            }
+        }
+        fprintf(file, "\n");
+        return 0;
+    }
+
+    // Write binary counts in chunks.
+    luint chunk[ACCFILE_CHUNK];
+    luint chunk_size = 0;
+    for (luint cell = 0; cell < evn_cnt->ncells; ++cell) {
+        for (luint fill_i = 0; fill_i < nfill; ++fill_i) {
+            chunk[chunk_size++] =
+                    fill_i == 0 ? rge_binstore_get(evn_cnt, cell) : 0;
+            if (chunk_size == ACCFILE_CHUNK) {
+                fwrite(chunk, sizeof(*chunk), chunk_size, file);
+                chunk_size = 0;
+            }
+        }
+    }
+    fwrite(chunk, sizeof(*chunk), chunk_size, file);
+
+    return 0;
+}
+
+int write_acc_header(
+        FILE *file, luint nedges[5], double **edges, luint npids,
+        const lint *pids, bool text
+) {
+    if (text) {
+        // Write binning nedges and edges.
+        for (int bi = 0; bi < 5; ++bi) fprintf(file, "%lu ", nedges[bi]);
+        fprintf(file, "\n");
+        for (int bi = 0; bi < 5; ++bi) {
+            for (luint bii = 0; bii < nedges[bi]; ++bii) {
+                fprintf(file, "%12.9f ", edges[bi][bii]);
+            }
+            fprintf(file, "\n");
+        }
+
+        // Write list of PIDs.
+        fprintf(file, "%lu\n", npids);
+        for (luint pid_i = 0; pid_i < npids; ++pid_i) {
+            fprintf(file, "%ld ", pids[pid_i]);
+        }
+        fprintf(file, "\n");
+    }
+    else {
+        // Write header, edges, and PIDs, and pad up to the counts.
+        rge_accheader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, ACCFILE_MAGIC, sizeof(header.magic));
+        header.version = RGE_ACCFILE_VERSION;
+        luint nedges_total = 0;
+        for (int bi = 0; bi < 5; ++bi) {
+            header.nedges[bi] = nedges[bi];
+            nedges_total     += nedges[bi];
+        }
+        header.npids = npids;
+        header.nbins = 1;
+        for (int bi = 0; bi < 5; ++bi) header.nbins *= nedges[bi] - 1;
+        luint offset = sizeof(header) + nedges_total * sizeof(double) +
+                npids * sizeof(lint);
+        header.counts_offset =
+                (offset + ACCFILE_ALIGN - 1) / ACCFILE_ALIGN * ACCFILE_ALIGN;
+
+        fwrite(&header, sizeof(header), 1, file);
+        for (int bi = 0; bi < 5; ++bi) {
+            fwrite(edges[bi], sizeof(*edges[bi]), nedges[bi], file);
+        }
+        fwrite(pids, sizeof(*pids), npids, file);
+        char padding[ACCFILE_ALIGN];
+        memset(padding, 0, sizeof(padding));
+        fwrite(padding, 1, header.counts_offset - offset, file);
+    }
+
+    return 0;
+}
+
+int write_count_array(FILE *file, luint *counts, luint nbins, bool text) {
+    if (text) {
+        for (luint bin = 0; bin < nbins; ++bin) {
+            fprintf(file, "%lu ", counts[bin]);
         }
+        fprintf(file, "\n");
+        return 0;
+    }
+
+    fwrite(counts, sizeof(*counts), nbins, file);
+    return 0;
+}
+
+bool acc_header_valid(const rge_accheader *header, luint file_size) {
+    if (
+            header->version != RGE_ACCFILE_VERSION ||
+            header->counts_offset % ACCFILE_ALIGN != 0
+    ) return false;
+
+    // Recompute the number of bins from the edges.
+    luint nbins        = 1;
+    luint nedges_total = 0;
+    for (int bi = 0; bi < 5; ++bi) {
+        if (header->nedges[bi] < 2) return false;
+        if (
+                __builtin_mul_overflow(nbins, header->nedges[bi] - 1, &nbins) ||
+                __builtin_add_overflow(
+                        nedges_total, header->nedges[bi], &nedges_total
+                )
+        ) return false;
+    }
+    if (nbins != header->nbins) return false;
+
+    // Edges and PIDs must fit before the counts, and the counts must fill the
+    //     rest of the file.
+    luint list_size;
+    luint pids_size;
+    luint counts_size;
+    if (
+            __builtin_mul_overflow(nedges_total, sizeof(double), &list_size) ||
+            __builtin_mul_overflow(header->npids, sizeof(lint), &pids_size)  ||
+            __builtin_add_overflow(list_size, pids_size, &list_size)         ||
+            __builtin_add_overflow(list_size, sizeof(*header), &list_size)   ||
+            __builtin_mul_overflow(header->npids, nbins, &counts_size)       ||
+            __builtin_mul_overflow(
+                    counts_size, 2 * sizeof(luint), &counts_size
+            )
+    ) return false;
+
+    return
+            list_size <= header->counts_offset &&
+            header->counts_offset <= file_size &&
+            file_size - header->counts_offset == counts_size;
+}
+
+int map_acc_corr(int fd, rge_accdata *acc) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 0) {
+        rge_errno = RGEERR_BADACCFILE;
+        return 1;
+    }
+    luint file_size = static_cast<luint>(st.st_size);
+    if (file_size < sizeof(rge_accheader)) {
+        rge_errno = RGEERR_BADACCFILE;
+        return 1;
+    }
+
+    // Pages are mapped copy-on-write, so the data can be used as any other
+    //     array without touching the file.
+    void *map = mmap(
+            NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0
+    );
+    if (map == MAP_FAILED) {
+        rge_errno = RGEERR_BADACCFILE;
+        return 1;
     }
 
+    // Check that the header matches this version and the size of the file.
+    rge_accheader *header = static_cast<rge_accheader *>(map);
+    if (!acc_header_valid(header, file_size)) {
+        munmap(map, file_size);
+        rge_errno = RGEERR_BADACCFILE;
+        return 1;
+    }
+
+    // Point the arrays to the mapped file.
+    char *bytes = static_cast<char *>(map);
+    double *edges = reinterpret_cast<double *>(bytes + sizeof(*header));
+    for (int bi = 0; bi < 5; ++bi) {
+        acc->nedges[bi] = header->nedges[bi];
+        acc->edges[bi]  = edges;
+        edges += header->nedges[bi];
+    }
+    acc->npids = header->npids;
+    acc->pids  = reinterpret_cast<lint *>(edges);
+    acc->nbins = header->nbins;
+
+    luint *counts = reinterpret_cast<luint *>(bytes + header->counts_offset);
+    acc->n_thrown =
+            static_cast<luint **>(malloc(acc->npids * sizeof(*acc->n_thrown)));
+    acc->n_simul =
+            static_cast<luint **>(malloc(acc->npids * sizeof(*acc->n_simul)));
+    for (luint pid_i = 0; pid_i < acc->npids; ++pid_i) {
+        acc->n_thrown[pid_i] = counts + (2*pid_i)     * acc->nbins;
+        acc->n_simul[pid_i]  = counts + (2*pid_i + 1) * acc->nbins;
+    }
+
+    acc->map      = map;
+    acc->map_size = file_size;
+    return 0;
+}
+
+int read_acc_corr_text(FILE *file, rge_accdata *acc) {
+    // Get bin_nedges, bin_edges, and pids_size.
+    get_bin_edges(file, acc->nedges, acc->edges, &acc->npids);
+
+    // Compute total number of bins.
+    acc->nbins = 1;
+    for (int bi = 0; bi < 5; ++bi) acc->nbins *= (acc->nedges[bi] - 1);
+
+    // Malloc list of pids and first dimension of pids and events.
+    acc->pids = static_cast<lint *>(malloc(acc->npids * sizeof(*acc->pids)));
+    acc->n_thrown =
+            static_cast<luint **>(malloc(acc->npids * sizeof(*acc->n_thrown)));
+    acc->n_simul =
+            static_cast<luint **>(malloc(acc->npids * sizeof(*acc->n_simul)));
+
+    // Get pids and acc_corr from acceptance correction file.
+    get_acc_corr(
+            file, acc->npids, acc->nbins, acc->pids, acc->n_thrown,
+            acc->n_simul
+    );
+
+    acc->map      = NULL;
+    acc->map_size = 0;
     return 0;
 }
 
@@ -95,36 +358,230 @@ int rge_get_sf_params(
     return 0;
 }
 
-int rge_read_acc_corr_file(
-        char *acc_filename, luint bin_nedges[5], double ***bin_edges,
-        luint *pids_size, luint *nbins, lint **pids, int ***n_thrown,
-        int ***n_simul
-) {
+int rge_sflock_acquire(const char *sf_filename, bool *acquired) {
+    char lock_filename[PATH_MAX];
+    sflock_name(lock_filename, sf_filename);
+
+    bool waiting = false;
+    while (true) {
+        // Another process already wrote the file.
+        if (access(sf_filename, F_OK) == 0) {
+            *acquired = false;
+            return 0;
+        }
+
+        // Try to get the lock.
+        int fd = open(lock_filename, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd != -1) {
+            dprintf(fd, "%d\n", getpid());
+            close(fd);
+
+            // The file might have been written right before we got the lock.
+            if (access(sf_filename, F_OK) == 0) {
+                unlink(lock_filename);
+                *acquired = false;
+                return 0;
+            }
+            *acquired = true;
+            return 0;
+        }
+        if (errno != EEXIST) {
+            rge_errno = RGEERR_SFLOCKFAILED;
+            return 1;
+        }
+
+        // Remove the lock if its owner stopped touching it.
+        struct stat lock_stat;
+        if (
+                stat(lock_filename, &lock_stat) == 0 &&
+                time(NULL) - lock_stat.st_mtime > SFLOCK_STALE
+        ) {
+            if (break_sflock(lock_filename, &lock_stat)) {
+                fprintf(stderr, "Removed stale lock %s.\n", lock_filename);
+            }
+            continue;
+        }
+
+        if (!waiting) {
+            printf(
+                    "Waiting for another process to write %s.\n", sf_filename
+            );
+            waiting = true;
+        }
+        sleep(SFLOCK_POLL);
+    }
+}
+
+int rge_sflock_touch(const char *sf_filename) {
+    char lock_filename[PATH_MAX];
+    sflock_name(lock_filename, sf_filename);
+    utimensat(AT_FDCWD, lock_filename, NULL, 0);
+    return 0;
+}
+
+int rge_sflock_release(const char *sf_filename) {
+    char lock_filename[PATH_MAX];
+    sflock_name(lock_filename, sf_filename);
+    unlink(lock_filename);
+    return 0;
+}
+
+int rge_read_acc_corr_file(char *acc_filename, rge_accdata *acc) {
     // Access file.
     if (access(acc_filename, F_OK) != 0) {
         rge_errno = RGEERR_NOACCCORRFILE;
         return 1;
     }
-    FILE *acc_file = fopen(acc_filename, "r");
+    FILE *acc_file = fopen(acc_filename, "rb");
+    if (acc_file == NULL) {
+        rge_errno = RGEERR_NOACCCORRFILE;
+        return 1;
+    }
 
-    // Get bin_nedges, bin_edges, and pids_size.
-    *bin_edges = static_cast<double **>(malloc(5 * sizeof(**bin_edges)));
-    get_bin_edges(acc_file, bin_nedges, *bin_edges, pids_size);
+    // Binary files start with ACCFILE_MAGIC, and text files with a number.
+    char magic[sizeof(ACCFILE_MAGIC)];
+    bool binary =
+            fread(magic, 1, sizeof(magic), acc_file) == sizeof(magic) &&
+            memcmp(magic, ACCFILE_MAGIC, sizeof(magic)) == 0;
 
-    // Compute total number of bins.
-    *nbins = 1;
-    for (int bi = 0; bi < 5; ++bi) *nbins *= (bin_nedges[bi] - 1);
+    int err;
+    if (binary) {
+        err = map_acc_corr(fileno(acc_file), acc);
+    }
+    else {
+        rewind(acc_file);
+        err = read_acc_corr_text(acc_file, acc);
+    }
 
-    // Malloc list of pids and first dimension of pids and events.
-    *pids     = static_cast<lint *>(malloc(*pids_size * sizeof(**pids)));
-    *n_thrown = static_cast<int **>(malloc(*pids_size * sizeof(**n_thrown)));
-    *n_simul  = static_cast<int **>(malloc(*pids_size * sizeof(**n_simul)));
+    // Clean up. The mapping stays valid after closing the file.
+    fclose(acc_file);
 
-    // Get pids and acc_corr from acceptance correction file.
-    get_acc_corr(acc_file, *pids_size, *nbins, *pids, *n_thrown, *n_simul);
+    return err;
+}
 
-    // Clean up.
-    fclose(acc_file);
+int rge_write_acc_corr_file(
+        char *filename, luint nedges[5], double **edges, luint npids,
+        int *pids, rge_binstore *n_thrown, rge_binstore *n_simul, bool text
+) {
+    FILE *file = fopen(filename, text ? "w" : "wb");
+    if (file == NULL) {
+        rge_errno = RGEERR_OUTPUTACCFAILED;
+        return 1;
+    }
+
+    luint nbins[5];
+    for (int bi = 0; bi < 5; ++bi) nbins[bi] = nedges[bi] - 1;
+
+    // Write binnings and PIDs.
+    lint pids_l[npids];
+    for (luint pid_i = 0; pid_i < npids; ++pid_i) pids_l[pid_i] = pids[pid_i];
+    write_acc_header(file, nedges, edges, npids, pids_l, text);
 
+    // Write number of thrown and simulated events in each bin.
+    for (luint pid_i = 0; pid_i < npids; ++pid_i) {
+        write_counts(file, &n_thrown[pid_i], nbins, text);
+        write_counts(file, &n_simul[pid_i],  nbins, text);
+    }
+
+    if (ferror(file) || fclose(file) != 0) {
+        rge_errno = RGEERR_OUTPUTACCFAILED;
+        return 1;
+    }
+    return 0;
+}
+
+int rge_write_acc_data(char *filename, rge_accdata *acc, bool text) {
+    FILE *file = fopen(filename, text ? "w" : "wb");
+    if (file == NULL) {
+        rge_errno = RGEERR_OUTPUTACCFAILED;
+        return 1;
+    }
+
+    // Write binnings and PIDs.
+    write_acc_header(
+            file, acc->nedges, acc->edges, acc->npids, acc->pids, text
+    );
+
+    // Write number of thrown and simulated events in each bin.
+    for (luint pid_i = 0; pid_i < acc->npids; ++pid_i) {
+        write_count_array(file, acc->n_thrown[pid_i], acc->nbins, text);
+        write_count_array(file, acc->n_simul[pid_i],  acc->nbins, text);
+    }
+
+    if (ferror(file) || fclose(file) != 0) {
+        rge_errno = RGEERR_OUTPUTACCFAILED;
+        return 1;
+    }
+    return 0;
+}
+
+int rge_merge_acc_data(rge_accdata *dst, rge_accdata *src) {
+    // Check that both binnings are the same. Text files only keep 9 decimals
+    //     of each edge, so edges are compared with a tolerance.
+    for (int bi = 0; bi < 5; ++bi) {
+        if (dst->nedges[bi] != src->nedges[bi]) {
+            rge_errno = RGEERR_ACCMISMATCH;
+            return 1;
+        }
+        for (luint edge_i = 0; edge_i < dst->nedges[bi]; ++edge_i) {
+            double dst_edge = dst->edges[bi][edge_i];
+            double src_edge = src->edges[bi][edge_i];
+            if (
+                    fabs(dst_edge - src_edge) >
+                    ACCFILE_EDGETOL * fmax(1, fabs(dst_edge))
+            ) {
+                rge_errno = RGEERR_ACCMISMATCH;
+                return 1;
+            }
+        }
+    }
+
+    // Check that both lists have the same PIDs, in any order.
+    if (dst->npids != src->npids) {
+        rge_errno = RGEERR_ACCMISMATCH;
+        return 1;
+    }
+    luint dst_pos[src->npids];
+    for (luint src_i = 0; src_i < src->npids; ++src_i) {
+        lint *pid = std::find(
+                dst->pids, dst->pids + dst->npids, src->pids[src_i]
+        );
+        if (pid == dst->pids + dst->npids) {
+            rge_errno = RGEERR_ACCMISMATCH;
+            return 1;
+        }
+        dst_pos[src_i] = static_cast<luint>(pid - dst->pids);
+    }
+
+    // Add counts.
+    for (luint src_i = 0; src_i < src->npids; ++src_i) {
+        luint *dst_thrown = dst->n_thrown[dst_pos[src_i]];
+        luint *dst_simul  = dst->n_simul[dst_pos[src_i]];
+        luint *src_thrown = src->n_thrown[src_i];
+        luint *src_simul  = src->n_simul[src_i];
+        for (luint bin = 0; bin < dst->nbins; ++bin) {
+            dst_thrown[bin] += src_thrown[bin];
+            dst_simul[bin]  += src_simul[bin];
+        }
+    }
+
+    return 0;
+}
+
+int rge_acc_corr_free(rge_accdata *acc) {
+    if (acc->map != NULL) {
+        munmap(acc->map, acc->map_size);
+    }
+    else {
+        for (int bi = 0; bi < 5; ++bi) free(acc->edges[bi]);
+        free(acc->pids);
+        for (luint pid_i = 0; pid_i < acc->npids; ++pid_i) {
+            free(acc->n_thrown[pid_i]);
+            free(acc->n_simul[pid_i]);
+        }
+    }
+    free(acc->n_thrown);
+    free(acc->n_simul);
+    acc->map = NULL;
     return 0;
 }
@@ -113,7 +113,7 @@ int rge_handle_root_filename(char *filename, int *run_no) {
     int err = rge_handle_root_filename(filename, run_no, &dump);
 
     // We don't care about missing beam energy here.
-    if (rge_errno == RGEERR_UNIMPLEMENTEDBEAMENERGY) {
+    if (err && rge_errno == RGEERR_UNIMPLEMENTEDBEAMENERGY) {
         rge_errno = RGEERR_NOERR;
         err = 0;
     }
@@ -121,6 +121,26 @@ int rge_handle_root_filename(char *filename, int *run_no) {
     return err;
 }
 
+int rge_handle_input_filename(
+        char *filename, int *run_no, double *beam_energy
+) {
+    if (strstr(filename, ".hipo")) {
+        if (rge_handle_hipo_filename(filename, run_no)) return 1;
+        return get_beam_energy(*run_no, beam_energy);
+    }
+    if (strstr(filename, ".root")) {
+        return rge_handle_root_filename(filename, run_no, beam_energy);
+    }
+
+    rge_errno = RGEERR_INVALIDINPUTFILE;
+    return 1;
+}
+
+int rge_handle_input_filename(char *filename, int *run_no) {
+    double dump = 0.;
+    return rge_handle_input_filename(filename, run_no, &dump);
+}
+
 int rge_handle_hipo_filename(char *filename, int *run_no) {
     if (check_hipo_filename(filename)) return 1;
     if (get_run_no(filename, run_no))  return 1;
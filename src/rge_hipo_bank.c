@@ -16,180 +16,392 @@
 #include "../lib/rge_hipo_bank.h"
 
 // --+ internal +---------------------------------------------------------------
-rge_hipoentry entry_init(const char *in_addr, uint in_type) {
+rge_hipoentry entry_init(
+        const char *in_name, const char *in_addr, uint in_type
+) {
     return (rge_hipoentry) {
-            .addr = in_addr, .data = {}, .branch = nullptr, .type = in_type
+            .name = in_name, .addr = in_addr, .data = nullptr,
+            .branch = nullptr, .type = in_type, .item = -1
     };
 }
 
-int set_nrows(rge_hipobank *b, luint in_nrows) {
-    // Set internal variable.
-    b->nrows = in_nrows;
+size_t type_size(uint type) {
+    switch (type) {
+        case BYTE:  return sizeof(Char_t);
+        case SHORT: return sizeof(Short_t);
+        case INT:   return sizeof(Int_t);
+        case FLOAT: return sizeof(Float_t);
+        default:    return 0;
+    }
+}
 
-    // Resize vectors.
-    for (it = b->entries.begin(); it != b->entries.end(); ++it) {
-        const char *key = it->first;
-        b->entries.at(key).data->resize(b->nrows);
+char type_code(uint type) {
+    switch (type) {
+        case BYTE:  return 'B';
+        case SHORT: return 'S';
+        case INT:   return 'I';
+        case FLOAT: return 'F';
+        default:    return '\0';
     }
+}
 
-    return 0;
+int hipo_type(uint type) {
+    switch (type) {
+        case BYTE:  return 1;
+        case SHORT: return 2;
+        case INT:   return 3;
+        case FLOAT: return 4;
+        default:    return 0;
+    }
+}
+
+void leaf_name(char *out, const char *addr) {
+    while (*addr != '\0') {
+        if (addr[0] == ':' && addr[1] == ':') {
+            *out++ = '_';
+            addr += 2;
+        }
+        else {
+            *out++ = *addr++;
+        }
+    }
+    *out = '\0';
 }
 
-double get_entry(rge_hipobank *b, const char *var, luint idx) {
-    double entry;
-    try {
-        entry = b->entries.at(var).data->at(idx);
+int reserve_rows(rge_hipobank *b, luint nrows) {
+    if (nrows <= b->capacity) return 0;
+
+    // Grow geometrically to avoid reallocating on every event.
+    luint capacity = 2 * b->capacity;
+    if (capacity < nrows) capacity = nrows;
+
+    for (uint col = 0; col < b->ncols; ++col) {
+        rge_hipoentry *e = &(b->entries[col]);
+        void *data = realloc(e->data, capacity * type_size(e->type));
+        if (data == nullptr) {
+            rge_errno = RGEERR_OUTOFMEMORY;
+            return 1;
+        }
+        e->data = data;
+        if (e->branch != nullptr) e->branch->SetAddress(e->data);
     }
-    catch (...) {
-        entry = 0;
+    b->capacity = capacity;
+
+    return 0;
+}
+
+int set_nrows(rge_hipobank *b, luint in_nrows) {
+    // Make room for the new rows.
+    if (reserve_rows(b, in_nrows)) return 1;
+
+    // Set internal variables.
+    b->nrows = in_nrows;
+    b->count = static_cast<Int_t>(in_nrows);
+
+    return 0;
+}
+
+double get_entry(rge_hipobank *b, uint col, luint idx) {
+    if (col >= b->ncols || !(b->colmask & RGE_COL(col)) || idx >= b->nrows) {
         rge_errno = RGEERR_INVALIDENTRY;
+        return 0;
     }
 
-    return entry;
+    void *data = b->entries[col].data;
+    switch (b->entries[col].type) {
+        case BYTE:  return static_cast<Char_t  *>(data)[idx];
+        case SHORT: return static_cast<Short_t *>(data)[idx];
+        case INT:   return static_cast<Int_t   *>(data)[idx];
+        case FLOAT: return static_cast<Float_t *>(data)[idx];
+        default:
+            rge_errno = RGEERR_UNSUPPORTEDTYPE;
+            return 0;
+    }
 }
 
-/** Static map containing all entry lists. */
-static std::map<
-        const char *, std::map<const char *, rge_hipoentry, cmp_str>, cmp_str
+/**
+ * Static map containing all entry lists. Entries of each bank *must* follow the
+ *     order of the column indices in rge_hipo_bank.h.
+ */
+static const std::map<
+        const char *, std::vector<rge_hipoentry>, cmp_str
 > ENTRYMAP = {
     {RGE_RECPARTICLE, {
-        {"pid",     entry_init("REC::Particle::pid",     INT)},
-        {"vx",      entry_init("REC::Particle::vx",      FLOAT)},
-        {"vy",      entry_init("REC::Particle::vy",      FLOAT)},
-        {"vz",      entry_init("REC::Particle::vz",      FLOAT)},
-        {"px",      entry_init("REC::Particle::px",      FLOAT)},
-        {"py",      entry_init("REC::Particle::py",      FLOAT)},
-        {"pz",      entry_init("REC::Particle::pz",      FLOAT)},
-        {"vt",      entry_init("REC::Particle::vt",      FLOAT)},
-        {"charge",  entry_init("REC::Particle::charge",  BYTE)},
-        {"beta",    entry_init("REC::Particle::beta",    FLOAT)},
-        {"chi2pid", entry_init("REC::Particle::chi2pid", FLOAT)},
-        {"status",  entry_init("REC::Particle::status",  SHORT)}
+        entry_init("pid",     "REC::Particle::pid",     INT),
+        entry_init("vx",      "REC::Particle::vx",      FLOAT),
+        entry_init("vy",      "REC::Particle::vy",      FLOAT),
+        entry_init("vz",      "REC::Particle::vz",      FLOAT),
+        entry_init("px",      "REC::Particle::px",      FLOAT),
+        entry_init("py",      "REC::Particle::py",      FLOAT),
+        entry_init("pz",      "REC::Particle::pz",      FLOAT),
+        entry_init("vt",      "REC::Particle::vt",      FLOAT),
+        entry_init("charge",  "REC::Particle::charge",  BYTE),
+        entry_init("beta",    "REC::Particle::beta",    FLOAT),
+        entry_init("chi2pid", "REC::Particle::chi2pid", FLOAT),
+        entry_init("status",  "REC::Particle::status",  SHORT)
     }},
     {RGE_RECTRACK, {
-        {"index",  entry_init("REC::Track::index",  SHORT)},
-        {"pindex", entry_init("REC::Track::pindex", SHORT)},
-        {"sector", entry_init("REC::Track::sector", BYTE)},
-        {"NDF",    entry_init("REC::Track::ndf",    SHORT)},
-        {"chi2",   entry_init("REC::Track::chi2",   FLOAT)}
+        entry_init("index",  "REC::Track::index",  SHORT),
+        entry_init("pindex", "REC::Track::pindex", SHORT),
+        entry_init("sector", "REC::Track::sector", BYTE),
+        entry_init("NDF",    "REC::Track::ndf",    SHORT),
+        entry_init("chi2",   "REC::Track::chi2",   FLOAT)
     }},
     {RGE_RECCALORIMETER, {
-        {"pindex", entry_init("REC::Calorimeter::pindex", SHORT)},
-        {"layer",  entry_init("REC::Calorimeter::layer",  BYTE)},
-        {"sector", entry_init("REC::Calorimeter::sector", BYTE)},
-        {"energy", entry_init("REC::Calorimeter::energy", FLOAT)},
-        {"time",   entry_init("REC::Calorimeter::time",   FLOAT)}
+        entry_init("pindex", "REC::Calorimeter::pindex", SHORT),
+        entry_init("layer",  "REC::Calorimeter::layer",  BYTE),
+        entry_init("sector", "REC::Calorimeter::sector", BYTE),
+        entry_init("energy", "REC::Calorimeter::energy", FLOAT),
+        entry_init("time",   "REC::Calorimeter::time",   FLOAT)
     }},
     {RGE_RECCHERENKOV, {
-        {"pindex",   entry_init("REC::Cherenkov::pindex",   SHORT)},
-        {"detector", entry_init("REC::Cherenkov::detector", BYTE)},
-        {"nphe",     entry_init("REC::Cherenkov::nphe",     FLOAT)}
+        entry_init("pindex",   "REC::Cherenkov::pindex",   SHORT),
+        entry_init("detector", "REC::Cherenkov::detector", BYTE),
+        entry_init("nphe",     "REC::Cherenkov::nphe",     FLOAT)
     }},
     {RGE_RECSCINTILLATOR, {
-        {"pindex",   entry_init("REC::Scintillator::pindex",   SHORT)},
-        {"time",     entry_init("REC::Scintillator::time",     FLOAT)},
-        {"detector", entry_init("REC::Scintillator::detector", BYTE)},
-        {"layer",    entry_init("REC::Scintillator::layer",    BYTE)}
+        entry_init("pindex",   "REC::Scintillator::pindex",   SHORT),
+        entry_init("time",     "REC::Scintillator::time",     FLOAT),
+        entry_init("detector", "REC::Scintillator::detector", BYTE),
+        entry_init("layer",    "REC::Scintillator::layer",    BYTE)
     }},
     {RGE_FMTTRACKS, {
-        {"index",  entry_init("FMT::Tracks::index", SHORT)},
-        {"NDF",    entry_init("FMT::Tracks::ndf",   INT)},
-        {"Vtx0_x", entry_init("FMT::Tracks::vx",    FLOAT)},
-        {"Vtx0_y", entry_init("FMT::Tracks::vy",    FLOAT)},
-        {"Vtx0_z", entry_init("FMT::Tracks::vz",    FLOAT)},
-        {"p0_x",   entry_init("FMT::Tracks::px",    FLOAT)},
-        {"p0_y",   entry_init("FMT::Tracks::py",    FLOAT)},
-        {"p0_z",   entry_init("FMT::Tracks::pz",    FLOAT)}
+        entry_init("index",  "FMT::Tracks::index", SHORT),
+        entry_init("NDF",    "FMT::Tracks::ndf",   INT),
+        entry_init("Vtx0_x", "FMT::Tracks::vx",    FLOAT),
+        entry_init("Vtx0_y", "FMT::Tracks::vy",    FLOAT),
+        entry_init("Vtx0_z", "FMT::Tracks::vz",    FLOAT),
+        entry_init("p0_x",   "FMT::Tracks::px",    FLOAT),
+        entry_init("p0_y",   "FMT::Tracks::py",    FLOAT),
+        entry_init("p0_z",   "FMT::Tracks::pz",    FLOAT)
     }}
 };
 
 // --+ library +----------------------------------------------------------------
 rge_hipobank rge_hipobank_init(const char *bank_version) {
     rge_hipobank b;
-    b.nrows = 0;
+    b.name         = bank_version;
+    b.nrows        = 0;
+    b.ncols        = 0;
+    b.colmask      = 0;
+    b.capacity     = 0;
+    b.count        = 0;
+    b.count_branch = nullptr;
 
-    try {b.entries = ENTRYMAP.at(bank_version);}
-    catch (...) {rge_errno = RGEERR_INVALIDBANKID;}
+    std::map<
+            const char *, std::vector<rge_hipoentry>, cmp_str
+    >::const_iterator bank_it = ENTRYMAP.find(bank_version);
+    if (bank_it == ENTRYMAP.end() || bank_it->second.size() > RGE_MAXCOLS) {
+        rge_errno = RGEERR_INVALIDBANKID;
+        return b;
+    }
+
+    b.ncols   = static_cast<uint>(bank_it->second.size());
+    b.colmask = RGE_COL(b.ncols) - 1;
+    for (uint col = 0; col < b.ncols; ++col) {
+        b.entries[col] = bank_it->second[col];
+    }
+    reserve_rows(&b, INIT_CAPACITY);
 
     return b;
 }
 
-rge_hipobank rge_hipobank_init(const char *bank_version, TTree *t) {
-    rge_hipobank b = rge_hipobank_init(bank_version);
+int rge_count_addr(const char *bank_version, char *addr) {
+    sprintf(addr, "%s::nrows", bank_version);
+    return 0;
+}
+
+int rge_set_branch_addresses(rge_hipobank *b, TTree *t) {
+    // Link count branch, and size arrays to the largest event in the tree.
+    char count_addr[PATH_MAX];
+    char count_leaf[PATH_MAX];
+    rge_count_addr(b->name, count_addr);
+    leaf_name(count_leaf, count_addr);
+    t->SetBranchAddress(count_addr, &(b->count), &(b->count_branch));
+
+    TLeaf *leaf = t->GetLeaf(count_leaf);
+    if (leaf != nullptr) {
+        if (reserve_rows(b, static_cast<luint>(leaf->GetMaximum()))) return 1;
+    }
 
-    for (it = b.entries.begin(); it != b.entries.end(); ++it) {
-        const char *key = it->first;
+    // Link entry branches.
+    for (uint col = 0; col < b->ncols; ++col) {
+        if (!(b->colmask & RGE_COL(col))) continue;
         t->SetBranchAddress(
-                b.entries.at(key).addr,
-                &(b.entries.at(key).data),
-                &(b.entries.at(key).branch)
+                b->entries[col].addr, b->entries[col].data,
+                &(b->entries[col].branch)
         );
     }
 
-    return b;
+    return 0;
 }
 
 int rge_link_branches(rge_hipobank *b, TTree *t) {
-    for (it = b->entries.begin(); it != b->entries.end(); ++it) {
-        const char *key = it->first;
-        t->Branch(b->entries.at(key).addr, &(b->entries.at(key).data));
+    // Count branch.
+    char count_addr[PATH_MAX];
+    char count_leaf[PATH_MAX];
+    char leaflist[PATH_MAX];
+    rge_count_addr(b->name, count_addr);
+    leaf_name(count_leaf, count_addr);
+    sprintf(leaflist, "%s/I", count_leaf);
+    b->count_branch = t->Branch(count_addr, &(b->count), leaflist);
+
+    // Entry branches, with their length given by the count branch.
+    for (uint col = 0; col < b->ncols; ++col) {
+        rge_hipoentry *e = &(b->entries[col]);
+        char entry_leaf[PATH_MAX];
+        leaf_name(entry_leaf, e->addr);
+        sprintf(
+                leaflist, "%s[%s]/%c", entry_leaf, count_leaf,
+                type_code(e->type)
+        );
+        e->branch = t->Branch(e->addr, e->data, leaflist);
+    }
+
+    return 0;
+}
+
+int rge_hipobank_free(rge_hipobank *b) {
+    for (uint col = 0; col < b->ncols; ++col) {
+        free(b->entries[col].data);
+        b->entries[col].data = nullptr;
     }
+    b->capacity = 0;
+    b->nrows    = 0;
 
     return 0;
 }
 
-int rge_fill(rge_hipobank *rb, hipo::bank hb) {
-    set_nrows(rb, static_cast<luint>(hb.getRows()));
-
-    for (luint row = 0; row < rb->nrows; ++row) {
-        for (it = rb->entries.begin(); it != rb->entries.end(); ++it) {
-            const char *key = it->first;
-            double bank_data = 0;
-            switch (rb->entries.at(key).type) {
-                case BYTE:
-                    bank_data = static_cast<double>(hb.getByte(key, row));
-                    break;
-                case SHORT:
-                    bank_data = static_cast<double>(hb.getShort(key, row));
-                    break;
-                case INT:
-                    bank_data = static_cast<double>(hb.getInt(key, row));
-                    break;
-                case FLOAT:
-                    bank_data = static_cast<double>(hb.getFloat(key, row));
-                    break;
-                default:
-                    rge_errno = RGEERR_UNSUPPORTEDTYPE;
-                    return 1;
+int rge_link_schema(rge_hipobank *rb, hipo::schema *s) {
+    for (uint col = 0; col < rb->ncols; ++col) {
+        if (!(rb->colmask & RGE_COL(col))) continue;
+        rge_hipoentry *e = &(rb->entries[col]);
+        e->item = s->getEntryOrder(e->name);
+        if (e->item < 0 || s->getEntryType(e->item) != hipo_type(e->type)) {
+            rge_errno = RGEERR_BADHIPOSCHEMA;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int rge_fill(rge_hipobank *rb, hipo::bank *hb) {
+    int nrows = hb->getRows();
+    if (set_nrows(rb, static_cast<luint>(nrows))) return 1;
+    hipo::schema &s = hb->getSchema();
+
+    // hipo banks are stored column by column, so each entry is a contiguous
+    //     block starting at the offset of its first row.
+    for (uint col = 0; col < rb->ncols; ++col) {
+        if (!(rb->colmask & RGE_COL(col))) continue;
+        rge_hipoentry *e = &(rb->entries[col]);
+        if (e->item < 0) {
+            rge_errno = RGEERR_BADHIPOSCHEMA;
+            return 1;
+        }
+        int offset = s.getOffset(e->item, 0, nrows);
+        switch (e->type) {
+            case BYTE: {
+                Char_t *data = static_cast<Char_t *>(e->data);
+                for (int row = 0; row < nrows; ++row) {
+                    data[row] = hb->getByteAt(offset + row);
+                }
+                break;
+            }
+            case SHORT: {
+                Short_t *data = static_cast<Short_t *>(e->data);
+                for (int row = 0; row < nrows; ++row) {
+                    data[row] = hb->getShortAt(offset + 2*row);
+                }
+                break;
             }
-            rb->entries.at(key).data->at(row) = bank_data;
+            case INT: {
+                Int_t *data = static_cast<Int_t *>(e->data);
+                for (int row = 0; row < nrows; ++row) {
+                    data[row] = hb->getIntAt(offset + 4*row);
+                }
+                break;
+            }
+            case FLOAT: {
+                Float_t *data = static_cast<Float_t *>(e->data);
+                for (int row = 0; row < nrows; ++row) {
+                    data[row] = hb->getFloatAt(offset + 4*row);
+                }
+                break;
+            }
+            default:
+                rge_errno = RGEERR_UNSUPPORTEDTYPE;
+                return 1;
         }
     }
 
     return 0;
 }
 
-int rge_get_entries(rge_hipobank *b, TTree *t, int idx) {
+int rge_pack(rge_hipobank *b, std::vector<char> *buf) {
+    luint pos = buf->size();
+    luint size = sizeof(luint);
+    for (uint col = 0; col < b->ncols; ++col) {
+        size += b->nrows * type_size(b->entries[col].type);
+    }
+    buf->resize(pos + size);
+
+    memcpy(buf->data() + pos, &(b->nrows), sizeof(luint));
+    pos += sizeof(luint);
+    for (uint col = 0; col < b->ncols; ++col) {
+        luint col_size = b->nrows * type_size(b->entries[col].type);
+        memcpy(buf->data() + pos, b->entries[col].data, col_size);
+        pos += col_size;
+    }
+
+    return 0;
+}
+
+int rge_unpack(rge_hipobank *b, const std::vector<char> *buf, luint *pos) {
+    luint nrows;
+    memcpy(&nrows, buf->data() + *pos, sizeof(luint));
+    *pos += sizeof(luint);
+    if (set_nrows(b, nrows)) return 1;
+
+    for (uint col = 0; col < b->ncols; ++col) {
+        luint col_size = b->nrows * type_size(b->entries[col].type);
+        memcpy(b->entries[col].data, buf->data() + *pos, col_size);
+        *pos += col_size;
+    }
+
+    return 0;
+}
+
+int rge_get_entries(rge_hipobank *b, Long64_t local_idx) {
+    // Get number of rows first, so that arrays can be grown before reading.
+    b->count_branch->GetEntry(local_idx);
+    if (b->count < 0) {
+        rge_errno = RGEERR_BADROOTFILE;
+        return 1;
+    }
+    if (reserve_rows(b, static_cast<luint>(b->count))) return 1;
+
     // Get entries from TTree.
-    for (it = b->entries.begin(); it != b->entries.end(); ++it) {
-        const char *key = it->first;
-        b->entries.at(key).branch->GetEntry(t->LoadTree(idx));
+    for (uint col = 0; col < b->ncols; ++col) {
+        if (!(b->colmask & RGE_COL(col))) continue;
+        b->entries[col].branch->GetEntry(local_idx);
     }
 
     // Set nrows.
-    b->nrows = b->entries.begin()->second.data->size();
+    b->nrows = static_cast<luint>(b->count);
 
     return 0;
 }
 
-double rge_get_double(rge_hipobank *b, const char *var, luint idx) {
-    return get_entry(b, var, idx);
+double rge_get_double(rge_hipobank *b, uint col, luint idx) {
+    return get_entry(b, col, idx);
 }
 
-int rge_get_int(rge_hipobank *b, const char *var, luint idx) {
-    return static_cast<int>(get_entry(b, var, idx));
+int rge_get_int(rge_hipobank *b, uint col, luint idx) {
+    return static_cast<int>(get_entry(b, col, idx));
 }
 
-uint rge_get_uint(rge_hipobank *b, const char *var, luint idx) {
-    return static_cast<uint>(get_entry(b, var, idx));
+uint rge_get_uint(rge_hipobank *b, uint col, luint idx) {
+    return static_cast<uint>(get_entry(b, col, idx));
 }
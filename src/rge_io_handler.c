@@ -149,6 +149,14 @@ int rge_process_fmtnlayers(lint *nlayers, char *arg) {
     return 0;
 }
 
+int rge_process_nthreads(lint *nthreads, char *arg) {
+    if (run_strtol(nthreads, arg) || *nthreads <= 0) {
+        rge_errno = RGEERR_INVALIDNTHREADS;
+        return 1;
+    }
+    return 0;
+}
+
 bool rge_catch_yn() {
     while (true) {
         char str[32];
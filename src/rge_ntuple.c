@@ -0,0 +1,319 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022-2023 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+// details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#include "../lib/rge_ntuple.h"
+
+// --+ internal +---------------------------------------------------------------
+const char *type_name(char t) {
+    switch (t) {
+        case 'O': return "Bool_t";
+        case 'I': return "Int_t";
+        case 'L': return "Long64_t";
+        case 'F': return "Float_t";
+        default:  return "";
+    }
+}
+
+luint name_mask(const char *name) {
+    for (int profile_i = 0; profile_i < NPROFILES; ++profile_i) {
+        if (!strcmp(name, PROFILE_NAMES[profile_i])) {
+            return PROFILE_MASKS[profile_i];
+        }
+    }
+    for (int var_i = 0; var_i < RGE_VARS_SIZE; ++var_i) {
+        if (!strcmp(name, RGE_VARS[var_i])) return RGE_VARBIT(var_i);
+    }
+    return 0;
+}
+
+size_t vartype_size(char t) {
+    switch (t) {
+        case 'O': return sizeof(Bool_t);
+        case 'I': return sizeof(Int_t);
+        case 'L': return sizeof(Long64_t);
+        case 'F': return sizeof(Float_t);
+        default:  return 0;
+    }
+}
+
+int reserve_particles(rge_eventrow *ev, luint npart) {
+    if (npart <= ev->capacity) return 0;
+
+    luint capacity = ev->capacity == 0 ? INIT_NPART : ev->capacity;
+    while (capacity < npart) capacity *= 2;
+
+    for (int var_i = 0; var_i < RGE_VARS_SIZE; ++var_i) {
+        if (RGE_EVENTVARS & RGE_VARBIT(var_i)) continue;
+        void *array = realloc(
+                ev->arrays[var_i], capacity * vartype_size(RGE_VARTYPES[var_i])
+        );
+        if (array == NULL) {
+            rge_errno = RGEERR_OUTOFMEMORY;
+            return 1;
+        }
+        ev->arrays[var_i] = array;
+        if (ev->branches[var_i] != NULL) {
+            ev->branches[var_i]->SetAddress(ev->arrays[var_i]);
+        }
+    }
+    ev->capacity = capacity;
+
+    return 0;
+}
+
+int set_event_addresses(rge_ntuplereader *r) {
+    TTree *t         = r->tree;
+    rge_eventrow *ev = &(r->ev);
+
+    if (rge_ntuple_check(t, 0)) return 1;
+    TLeaf *count = t->GetLeaf(RGE_NPARTNAME);
+    if (count == NULL) {
+        rge_errno = RGEERR_BADROOTFILE;
+        return 1;
+    }
+
+    // Find present variables and size the arrays for the largest event.
+    r->varmask = 0;
+    for (int var_i = 0; var_i < RGE_VARS_SIZE; ++var_i) {
+        r->vals[var_i].l = 0;
+        if (t->GetLeaf(RGE_VARS[var_i]) != NULL) {
+            r->varmask |= RGE_VARBIT(var_i);
+        }
+    }
+    ev->varmask = r->varmask;
+    luint max_npart = count->GetMaximum() > 0 ? count->GetMaximum() : 1;
+    if (reserve_particles(ev, max_npart)) return 1;
+
+    // Link branches.
+    t->SetBranchAddress(RGE_NPARTNAME, &(ev->npart));
+    for (int var_i = 0; var_i < RGE_VARS_SIZE; ++var_i) {
+        if (!(r->varmask & RGE_VARBIT(var_i))) continue;
+        if (RGE_EVENTVARS & RGE_VARBIT(var_i)) {
+            t->SetBranchAddress(RGE_VARS[var_i], &(ev->scalars[var_i]));
+        }
+        else {
+            ev->branches[var_i] = t->GetBranch(RGE_VARS[var_i]);
+            t->SetBranchAddress(RGE_VARS[var_i], ev->arrays[var_i]);
+        }
+    }
+
+    return 0;
+}
+
+// --+ library +----------------------------------------------------------------
+int rge_ntuple_parse_vars(const char *arg, luint *varmask) {
+    char *list = strdup(arg);
+    char *save;
+    *varmask = 0;
+
+    for (
+            char *name = strtok_r(list, VARS_SEPARATOR, &save);
+            name != NULL;
+            name = strtok_r(NULL, VARS_SEPARATOR, &save)
+    ) {
+        luint mask = name_mask(name);
+        if (mask == 0) {
+            free(list);
+            rge_errno = RGEERR_INVALIDNTUPLEVARS;
+            return 1;
+        }
+        *varmask |= mask;
+    }
+
+    free(list);
+    if (*varmask == 0) {
+        rge_errno = RGEERR_INVALIDNTUPLEVARS;
+        return 1;
+    }
+    return 0;
+}
+
+int rge_ntuple_branch(TTree *t, rge_varval *vals, luint varmask) {
+    for (int var_i = 0; var_i < RGE_VARS_SIZE; ++var_i) {
+        if (!(varmask & RGE_VARBIT(var_i))) continue;
+        t->Branch(
+                RGE_VARS[var_i], &(vals[var_i]),
+                Form("%s/%c", RGE_VARS[var_i], RGE_VARTYPES[var_i])
+        );
+    }
+
+    return 0;
+}
+
+int rge_ntuple_check(TTree *t, luint varmask) {
+    for (int var_i = 0; var_i < RGE_VARS_SIZE; ++var_i) {
+        TLeaf *leaf = t->GetLeaf(RGE_VARS[var_i]);
+        if (leaf == NULL) {
+            if (!(varmask & RGE_VARBIT(var_i))) continue;
+            rge_errno = RGEERR_MISSINGNTUPLEVAR;
+            return 1;
+        }
+        if (strcmp(leaf->GetTypeName(), type_name(RGE_VARTYPES[var_i]))) {
+            rge_errno = RGEERR_OUTDATEDNTUPLEFILE;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int rge_ntuple_set_addresses(TTree *t, rge_varval *vals, luint *varmask) {
+    if (rge_ntuple_check(t, 0)) return 1;
+
+    *varmask = 0;
+    for (int var_i = 0; var_i < RGE_VARS_SIZE; ++var_i) {
+        vals[var_i].l = 0;
+        if (t->GetLeaf(RGE_VARS[var_i]) == NULL) continue;
+        t->SetBranchAddress(RGE_VARS[var_i], &(vals[var_i]));
+        *varmask |= RGE_VARBIT(var_i);
+    }
+
+    return 0;
+}
+
+rge_eventrow rge_eventrow_init() {
+    rge_eventrow ev;
+    ev.npart    = 0;
+    ev.capacity = 0;
+    ev.varmask  = 0;
+    for (int var_i = 0; var_i < RGE_VARS_SIZE; ++var_i) {
+        ev.scalars[var_i].l = 0;
+        ev.arrays[var_i]    = NULL;
+        ev.branches[var_i]  = NULL;
+    }
+    return ev;
+}
+
+int rge_eventrow_branch(TTree *t, rge_eventrow *ev, luint varmask) {
+    ev->varmask = varmask;
+    if (reserve_particles(ev, 1)) return 1;
+
+    t->Branch(RGE_NPARTNAME, &(ev->npart), RGE_NPARTNAME "/I");
+    for (int var_i = 0; var_i < RGE_VARS_SIZE; ++var_i) {
+        if (!(varmask & RGE_VARBIT(var_i))) continue;
+        if (RGE_EVENTVARS & RGE_VARBIT(var_i)) {
+            t->Branch(
+                    RGE_VARS[var_i], &(ev->scalars[var_i]),
+                    Form("%s/%c", RGE_VARS[var_i], RGE_VARTYPES[var_i])
+            );
+        }
+        else {
+            ev->branches[var_i] = t->Branch(
+                    RGE_VARS[var_i], ev->arrays[var_i],
+                    Form(
+                            "%s[%s]/%c", RGE_VARS[var_i], RGE_NPARTNAME,
+                            RGE_VARTYPES[var_i]
+                    )
+            );
+        }
+    }
+
+    return 0;
+}
+
+int rge_eventrow_add(rge_eventrow *ev, const rge_varval *row) {
+    // Event variables are kept even if they aren't written, since they are
+    //     used to tell events apart.
+    if (ev->npart == 0) {
+        for (int var_i = 0; var_i < RGE_VARS_SIZE; ++var_i) {
+            if (RGE_EVENTVARS & RGE_VARBIT(var_i)) {
+                ev->scalars[var_i] = row[var_i];
+            }
+        }
+    }
+
+    luint idx = static_cast<luint>(ev->npart);
+    if (reserve_particles(ev, idx + 1)) return 1;
+    for (int var_i = 0; var_i < RGE_VARS_SIZE; ++var_i) {
+        if (RGE_EVENTVARS & RGE_VARBIT(var_i)) continue;
+        if (!(ev->varmask & RGE_VARBIT(var_i))) continue;
+        size_t size = vartype_size(RGE_VARTYPES[var_i]);
+        memcpy(
+                static_cast<char *>(ev->arrays[var_i]) + idx*size,
+                &(row[var_i]), size
+        );
+    }
+    ++ev->npart;
+
+    return 0;
+}
+
+int rge_eventrow_get(const rge_eventrow *ev, luint idx, rge_varval *row) {
+    for (int var_i = 0; var_i < RGE_VARS_SIZE; ++var_i) {
+        if (RGE_EVENTVARS & RGE_VARBIT(var_i)) {
+            row[var_i] = ev->scalars[var_i];
+            continue;
+        }
+        if (!(ev->varmask & RGE_VARBIT(var_i))) continue;
+        size_t size = vartype_size(RGE_VARTYPES[var_i]);
+        memcpy(
+                &(row[var_i]),
+                static_cast<const char *>(ev->arrays[var_i]) + idx*size, size
+        );
+    }
+
+    return 0;
+}
+
+int rge_eventrow_free(rge_eventrow *ev) {
+    for (int var_i = 0; var_i < RGE_VARS_SIZE; ++var_i) {
+        free(ev->arrays[var_i]);
+        ev->arrays[var_i]   = NULL;
+        ev->branches[var_i] = NULL;
+    }
+    ev->capacity = 0;
+    ev->npart    = 0;
+
+    return 0;
+}
+
+int rge_ntuplereader_open(rge_ntuplereader *r, TFile *f) {
+    r->ev       = rge_eventrow_init();
+    r->tree     = f->Get<TTree>(RGE_TREENAMEEVENTS);
+    r->is_event = r->tree != NULL;
+    if (!r->is_event) r->tree = f->Get<TTree>(RGE_TREENAMEDATA);
+    if (r->tree == NULL) {
+        rge_errno = RGEERR_BADROOTFILE;
+        return 1;
+    }
+
+    if (r->is_event) return set_event_addresses(r);
+    return rge_ntuple_set_addresses(r->tree, r->vals, &(r->varmask));
+}
+
+luint rge_ntuplereader_get_entry(rge_ntuplereader *r, Long64_t entry) {
+    r->tree->GetEntry(entry);
+    if (!r->is_event) return 1;
+    return static_cast<luint>(r->ev.npart);
+}
+
+int rge_ntuplereader_get_particle(rge_ntuplereader *r, luint idx) {
+    if (r->is_event) rge_eventrow_get(&(r->ev), idx, r->vals);
+    return 0;
+}
+
+int rge_ntuplereader_free(rge_ntuplereader *r) {
+    return rge_eventrow_free(&(r->ev));
+}
+
+double rge_varval_get(const rge_varval *vals, int addr) {
+    switch (RGE_VARTYPES[addr]) {
+        case 'O': return vals[addr].o;
+        case 'I': return vals[addr].i;
+        case 'L': return static_cast<double>(vals[addr].l);
+        case 'F': return vals[addr].f;
+        default:  return 0;
+    }
+}
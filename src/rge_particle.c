@@ -210,43 +210,43 @@ rge_particle rge_particle_init(
         rge_hipobank *particle, rge_hipobank *track, rge_hipobank *fmttrack,
         uint pos, lint fmt_nlayers
 ) {
-    uint pindex = rge_get_uint(track, "pindex", pos);
+    uint pindex = rge_get_uint(track, RGE_TRK_PINDEX, pos);
 
     // Use only DC tracking data.
     if (fmt_nlayers == 0) {
         return particle_init(
-                rge_get_double(particle, "charge", pindex),
-                rge_get_double(particle, "beta",   pindex),
-                rge_get_double(track,    "sector", pos),
-                rge_get_double(particle, "vx", pindex),
-                rge_get_double(particle, "vy", pindex),
-                rge_get_double(particle, "vz", pindex),
-                rge_get_double(particle, "px", pindex),
-                rge_get_double(particle, "py", pindex),
-                rge_get_double(particle, "pz", pindex)
+                rge_get_double(particle, RGE_PART_CHARGE, pindex),
+                rge_get_double(particle, RGE_PART_BETA,   pindex),
+                rge_get_double(track,    RGE_TRK_SECTOR, pos),
+                rge_get_double(particle, RGE_PART_VX, pindex),
+                rge_get_double(particle, RGE_PART_VY, pindex),
+                rge_get_double(particle, RGE_PART_VZ, pindex),
+                rge_get_double(particle, RGE_PART_PX, pindex),
+                rge_get_double(particle, RGE_PART_PY, pindex),
+                rge_get_double(particle, RGE_PART_PZ, pindex)
         );
     }
 
     // Use DC+FMT tracking data.
-    uint index = rge_get_uint(track, "index", pos);
+    uint index = rge_get_uint(track, RGE_TRK_INDEX, pos);
 
     // Apply FMT cuts.
     // Track reconstructed by FMT.
-    if (fmttrack->nrows < 1) return particle_init();
+    if (index >= fmttrack->nrows) return particle_init();
     // Track crossed enough FMT layers.
-    if (rge_get_uint(fmttrack, "NDF", index) < fmt_nlayers)
+    if (rge_get_uint(fmttrack, RGE_FMT_NDF, index) < fmt_nlayers)
         return particle_init();
 
     return particle_init(
-            rge_get_double(particle, "charge", pindex),
-            rge_get_double(particle, "beta",   pindex),
-            rge_get_double(track,    "sector", pos),
-            rge_get_double(fmttrack, "Vtx0_x", index),
-            rge_get_double(fmttrack, "Vtx0_y", index),
-            rge_get_double(fmttrack, "Vtx0_z", index),
-            rge_get_double(fmttrack, "p0_x",   index),
-            rge_get_double(fmttrack, "p0_y",   index),
-            rge_get_double(fmttrack, "p0_z",   index)
+            rge_get_double(particle, RGE_PART_CHARGE, pindex),
+            rge_get_double(particle, RGE_PART_BETA,   pindex),
+            rge_get_double(track,    RGE_TRK_SECTOR, pos),
+            rge_get_double(fmttrack, RGE_FMT_VX, index),
+            rge_get_double(fmttrack, RGE_FMT_VY, index),
+            rge_get_double(fmttrack, RGE_FMT_VZ, index),
+            rge_get_double(fmttrack, RGE_FMT_PX,   index),
+            rge_get_double(fmttrack, RGE_FMT_PY,   index),
+            rge_get_double(fmttrack, RGE_FMT_PZ,   index)
     );
 }
 
@@ -296,63 +296,74 @@ int rge_set_pid(
 }
 
 int rge_fill_ntuples_arr(
-        Float_t *arr, rge_particle p, rge_particle e, int run_no, int evn,
-        int status, double beam_E, float chi2, float ndf, double pcal_energy,
+        rge_varval *arr, rge_particle p, rge_particle e, int run_no, lint evn,
+        int status, double beam_E, float chi2, int ndf, double pcal_energy,
         double ecin_E, double ecou_E, double tof, double tre_tof, int nphe_ltcc,
-        int nphe_htcc
+        int nphe_htcc, luint varmask
 ) {
     // Metadata.
-    arr[RGE_RUNNO.addr]   = static_cast<Float_t>(run_no);
-    arr[RGE_EVENTNO.addr] = static_cast<Float_t>(evn);
-    arr[RGE_BEAME.addr]   = beam_E;
+    arr[RGE_RUNNO.addr].i   = run_no;
+    arr[RGE_EVENTNO.addr].l = evn;
+    arr[RGE_BEAME.addr].f   = beam_E;
     // Particle.
-    arr[RGE_PID.addr]    = static_cast<Float_t>(p.pid);
-    arr[RGE_CHARGE.addr] = p.charge;
-    arr[RGE_STATUS.addr] = static_cast<Float_t>(status);
-    arr[RGE_MASS.addr]   = p.mass;
-    arr[RGE_VX.addr]     = p.vx;
-    arr[RGE_VY.addr]     = p.vy;
-    arr[RGE_VZ.addr]     = p.vz;
-    arr[RGE_PX.addr]     = p.px;
-    arr[RGE_PY.addr]     = p.py;
-    arr[RGE_PZ.addr]     = p.pz;
-    arr[RGE_P.addr]      = momentum(p);
-    arr[RGE_THETA.addr]  = theta_lab(p);
-    arr[RGE_PHI.addr]    = phi_lab(p);
-    arr[RGE_BETA.addr]   = p.beta;
-    arr[RGE_TRIGGERSTATUS.addr] = p.is_trigger;
-    arr[RGE_SECTOR.addr] = p.sector;
+    arr[RGE_PID.addr].i    = p.pid;
+    arr[RGE_CHARGE.addr].i = p.charge;
+    arr[RGE_STATUS.addr].i = status;
+    arr[RGE_MASS.addr].f   = p.mass;
+    arr[RGE_VX.addr].f     = p.vx;
+    arr[RGE_VY.addr].f     = p.vy;
+    arr[RGE_VZ.addr].f     = p.vz;
+    arr[RGE_PX.addr].f     = p.px;
+    arr[RGE_PY.addr].f     = p.py;
+    arr[RGE_PZ.addr].f     = p.pz;
+    arr[RGE_BETA.addr].f   = p.beta;
+    if (varmask & RGE_VARBIT(RGE_P.addr)) {
+        arr[RGE_P.addr].f = momentum(p);
+    }
+    if (varmask & RGE_VARBIT(RGE_THETA.addr)) {
+        arr[RGE_THETA.addr].f = theta_lab(p);
+    }
+    if (varmask & RGE_VARBIT(RGE_PHI.addr)) {
+        arr[RGE_PHI.addr].f = phi_lab(p);
+    }
+    arr[RGE_TRIGGERSTATUS.addr].o = p.is_trigger;
+    arr[RGE_SECTOR.addr].i = p.sector;
 
     // Tracking.
-    arr[RGE_CHI2.addr] = chi2;
-    arr[RGE_NDF.addr]  = ndf;
+    arr[RGE_CHI2.addr].f = chi2;
+    arr[RGE_NDF.addr].i  = ndf;
 
     // Calorimeter.
-    arr[RGE_PCALE.addr] = pcal_energy;
-    arr[RGE_ECINE.addr] = ecin_E;
-    arr[RGE_ECOUE.addr] = ecou_E;
-    arr[RGE_TOTE.addr]  = pcal_energy + ecin_E + ecou_E;
+    arr[RGE_PCALE.addr].f = pcal_energy;
+    arr[RGE_ECINE.addr].f = ecin_E;
+    arr[RGE_ECOUE.addr].f = ecou_E;
+    arr[RGE_TOTE.addr].f  = pcal_energy + ecin_E + ecou_E;
 
     // Scintillator.
-    arr[RGE_DTOF.addr] = tof - tre_tof;
+    arr[RGE_DTOF.addr].f = tof - tre_tof;
 
     // Cherenkov.
-    arr[RGE_NPHELTCC.addr] = nphe_ltcc;
-    arr[RGE_NPHEHTCC.addr] = nphe_htcc;
-
-    // DIS -- For hadrons, just use e- data.
-    arr[RGE_Q2.addr] = Q2(e, beam_E);
-    arr[RGE_NU.addr] = nu(e, beam_E);
-    arr[RGE_XB.addr] = Xb(e, beam_E);
-    arr[RGE_YB.addr] = Yb(e, beam_E);
-    arr[RGE_W2.addr] = W2(e, beam_E);
-    if (rge_errno == RGEERR_PIDNOTFOUND) return 1;
+    arr[RGE_NPHELTCC.addr].i = nphe_ltcc;
+    arr[RGE_NPHEHTCC.addr].i = nphe_htcc;
+
+    // DIS -- For hadrons, just use e- data. Xb and W2 need the proton mass.
+    if (varmask & DIS_VARS) {
+        double proton_mass;
+        if (rge_get_mass(2212, &proton_mass)) return 1;
+        arr[RGE_Q2.addr].f = Q2(e, beam_E);
+        arr[RGE_NU.addr].f = nu(e, beam_E);
+        arr[RGE_XB.addr].f = Xb(e, beam_E);
+        arr[RGE_YB.addr].f = Yb(e, beam_E);
+        arr[RGE_W2.addr].f = W2(e, beam_E);
+    }
 
     // SIDIS -- if p is trigger electron, all will be 0 by default.
-    arr[RGE_ZH.addr]      = zh(p, e, beam_E);
-    arr[RGE_PT2.addr]     = Pt2(p, e, beam_E);
-    arr[RGE_PL2.addr]     = Pl2(p, e, beam_E);
-    arr[RGE_PHIPQ.addr]   = phi_pq(p, e, beam_E);
-    arr[RGE_THETAPQ.addr] = theta_pq(p, e, beam_E);
+    if (varmask & SIDIS_VARS) {
+        arr[RGE_ZH.addr].f      = zh(p, e, beam_E);
+        arr[RGE_PT2.addr].f     = Pt2(p, e, beam_E);
+        arr[RGE_PL2.addr].f     = Pl2(p, e, beam_E);
+        arr[RGE_PHIPQ.addr].f   = phi_pq(p, e, beam_E);
+        arr[RGE_THETAPQ.addr].f = theta_pq(p, e, beam_E);
+    }
     return 0;
 }
@@ -81,12 +81,12 @@ int rge_get_pidlist_size_by_charge(int charge, uint *size) {
 
 int rge_get_pidlist_by_charge(int charge, int pidlist[]) {
     uint counter = 0;
-    for (pid_it = PID_MAP.begin(); pid_it != PID_MAP.end(); ++pid_it) {
+    for (const std::pair<const int, rge_pidconstants> &pid_pair : PID_MAP) {
         if (
-                (charge == 0 && pid_it->second.charge == 0) || // both neutral.
-                (charge * pid_it->second.charge > 0)           // equal signs.
+                (charge == 0 && pid_pair.second.charge == 0) || // both neutral.
+                (charge * pid_pair.second.charge > 0)           // equal signs.
         ) {
-            pidlist[counter] = pid_it->first;
+            pidlist[counter] = pid_pair.first;
             ++counter;
         }
     }
@@ -95,8 +95,8 @@ int rge_get_pidlist_by_charge(int charge, int pidlist[]) {
 }
 
 int rge_print_pid_names() {
-    for (pid_it = PID_MAP.begin(); pid_it != PID_MAP.end(); ++pid_it) {
-        printf("  * %5d (%s).\n", pid_it->first, pid_it->second.name);
+    for (const std::pair<const int, rge_pidconstants> &pid_pair : PID_MAP) {
+        printf("  * %5d (%s).\n", pid_pair.first, pid_pair.second.name);
     }
 
     return 0;
@@ -0,0 +1,476 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022-2023 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+// FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+// details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+// C.
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+// C++.
+#include <thread>
+#include <vector>
+
+// ROOT.
+#include "TFile.h"
+#include "TROOT.h"
+#include "TTree.h"
+
+// rge-analysis.
+#include "../lib/rge_constants.h"
+#include "../lib/rge_detector.h"
+#include "../lib/rge_err_handler.h"
+#include "../lib/rge_event_loader.h"
+#include "../lib/rge_file_handler.h"
+#include "../lib/rge_filename_handler.h"
+#include "../lib/rge_hipo_bank.h"
+#include "../lib/rge_io_handler.h"
+#include "../lib/rge_ntuple.h"
+#include "../lib/rge_particle.h"
+#include "../lib/rge_pid_utils.h"
+
+static const char *USAGE_MESSAGE =
+"Usage: tsan_check [-hn:j:] workdir\n"
+" * -h         : show this message and exit.\n"
+" * -n nevents : number of events in the fixture. Default is 1000.\n"
+" * -j nthreads: number of threads processing the fixture at once. Default\n"
+"                is 4.\n"
+" * workdir    : directory where the fixture is written.\n\n"
+"    Write a small banks_012016.root file and its sf_params_012016.txt file\n"
+"    to workdir, and process them from several threads at once with the\n"
+"    bank, particle, PID, and file handlers, as make_ntuples does. Each\n"
+"    thread must get the same result as a single-threaded pass. Meant to be\n"
+"    built with the thread sanitizer, through `make tsan-test`.\n";
+
+/** Run number of the fixture. Its beam energy is known by the library. */
+static const int FIXTURE_RUNNO = 12016;
+
+/** Banks written to the fixture, same as hipo2root without FMT. */
+#define FIXTURE_NBANKS 5
+static const char *FIXTURE_BANKS[FIXTURE_NBANKS] = {
+        RGE_RECPARTICLE, RGE_RECTRACK, RGE_RECCALORIMETER, RGE_RECCHERENKOV,
+        RGE_RECSCINTILLATOR
+};
+enum {F_PART, F_TRK, F_CAL, F_CHKV, F_SCI};
+
+/** Maximum number of rows of a fixture bank in one event. */
+#define FIXTURE_MAXROWS 4
+
+/**
+ * Sampling fraction parameters of every sector in the fixture: mean and sigma
+ *     of E/p are constant, and the electrons are generated at the mean.
+ */
+static const double FIXTURE_SF = 0.25;
+static const char *FIXTURE_SFLINE = "0.25 1.0 0.0 0.0 0.02 1.0 0.0 0.0\n";
+
+/**
+ * Result of processing the fixture.
+ *
+ * @param nrows    : number of ntuple rows filled.
+ * @param ntrigger : number of trigger electrons found.
+ * @param checksum : sum of every variable of every row.
+ * @param err      : rge_errno of the thread if it failed or if the code it
+ *                   set before processing changed, RGEERR_NOERR otherwise.
+ */
+typedef struct {
+    luint nrows;
+    luint ntrigger;
+    double checksum;
+    uint err;
+} check_result;
+
+/** Append size bytes from src to buf. */
+static int append(std::vector<char> *buf, const void *src, size_t size) {
+    const char *bytes = static_cast<const char *>(src);
+    buf->insert(buf->end(), bytes, bytes + size);
+    return 0;
+}
+
+/**
+ * Set the rows of b to the first nrows rows of vals, converted to the type of
+ *     each column. The rows are packed like rge_pack() does and unpacked into
+ *     b, so that the bank sets its row count and grows its arrays itself.
+ */
+static int set_rows(
+        rge_hipobank *b, luint nrows, double vals[FIXTURE_MAXROWS][RGE_MAXCOLS]
+) {
+    std::vector<char> buf;
+    append(&buf, &nrows, sizeof(nrows));
+    for (uint col = 0; col < b->ncols; ++col) {
+        for (luint row = 0; row < nrows; ++row) {
+            double v = vals[row][col];
+            if (b->entries[col].type == BYTE) {
+                Char_t x = static_cast<Char_t>(v);
+                append(&buf, &x, sizeof(x));
+            }
+            else if (b->entries[col].type == SHORT) {
+                Short_t x = static_cast<Short_t>(v);
+                append(&buf, &x, sizeof(x));
+            }
+            else if (b->entries[col].type == INT) {
+                Int_t x = static_cast<Int_t>(v);
+                append(&buf, &x, sizeof(x));
+            }
+            else {
+                Float_t x = static_cast<Float_t>(v);
+                append(&buf, &x, sizeof(x));
+            }
+        }
+    }
+
+    luint pos = 0;
+    return rge_unpack(b, &buf, &pos);
+}
+
+/**
+ * Fill banks with event evn of the fixture: a trigger electron and a positive
+ *     pion, with momenta that change from event to event.
+ */
+static int fill_event(rge_hipobank banks[FIXTURE_NBANKS], lint evn) {
+    double e_p   = 3.0 + 0.01 * static_cast<double>(evn % 100);
+    double pi_p  = 1.5 + 0.01 * static_cast<double>(evn % 50);
+    double phi   = 0.006 * static_cast<double>(evn % 1000);
+    double e_th  = 0.30;
+    double pi_th = 0.45;
+    double e_sector  = static_cast<double>(1 + evn % 5);
+    double pi_sector = static_cast<double>(1 + (evn+2) % 5);
+    double e_E = FIXTURE_SF * e_p;
+
+    double part[FIXTURE_MAXROWS][RGE_MAXCOLS] = {
+        {11, 0.0, 0.0, -3.0, e_p*sin(e_th)*cos(phi), e_p*sin(e_th)*sin(phi),
+                e_p*cos(e_th), 0.0, -1, 1.00, 0.0, -2110},
+        {211, 0.1, 0.0, -3.0, pi_p*sin(pi_th)*cos(-phi),
+                pi_p*sin(pi_th)*sin(-phi), pi_p*cos(pi_th), 0.0, 1, 0.99,
+                0.0, 2110}
+    };
+    double trk[FIXTURE_MAXROWS][RGE_MAXCOLS] = {
+        {0, 0, e_sector,  20, 25.0},
+        {1, 1, pi_sector, 18, 30.0}
+    };
+    double cal[FIXTURE_MAXROWS][RGE_MAXCOLS] = {
+        {0, PCAL_LYR, e_sector,  0.5*e_E, 20.0},
+        {0, ECIN_LYR, e_sector,  0.3*e_E, 21.0},
+        {0, ECOU_LYR, e_sector,  0.2*e_E, 22.0},
+        {1, PCAL_LYR, pi_sector, 0.05,    25.0}
+    };
+    double chkv[FIXTURE_MAXROWS][RGE_MAXCOLS] = {
+        {0, HTCC_ID, 12},
+        {1, LTCC_ID,  3}
+    };
+    double sci[FIXTURE_MAXROWS][RGE_MAXCOLS] = {
+        {0, 20.5, FTOF_ID, FTOF1B_LYR},
+        {1, 21.3, FTOF_ID, FTOF1B_LYR}
+    };
+
+    if (
+            set_rows(&banks[F_PART], 2, part) ||
+            set_rows(&banks[F_TRK],  2, trk)  ||
+            set_rows(&banks[F_CAL],  4, cal)  ||
+            set_rows(&banks[F_CHKV], 2, chkv) ||
+            set_rows(&banks[F_SCI],  2, sci)
+    ) return 1;
+
+    return 0;
+}
+
+/** Write the fixture banks and sampling fraction files. */
+static int write_fixture(
+        const char *banks_filename, const char *sf_filename, lint nevents
+) {
+    FILE *sf_file = fopen(sf_filename, "w");
+    if (sf_file == NULL) {
+        rge_errno = RGEERR_OUTPUTTEXTFAILED;
+        return 1;
+    }
+    for (int sector_i = 0; sector_i < RGE_NSECTORS; ++sector_i) {
+        fputs(FIXTURE_SFLINE, sf_file);
+    }
+    fclose(sf_file);
+
+    TFile *file = TFile::Open(banks_filename, "RECREATE");
+    if (!file || file->IsZombie()) {
+        delete file;
+        rge_errno = RGEERR_OUTPUTROOTFAILED;
+        return 1;
+    }
+    TTree *tree = new TTree(RGE_TREENAMEDATA, RGE_TREENAMEDATA);
+
+    rge_hipobank banks[FIXTURE_NBANKS];
+    for (uint i = 0; i < FIXTURE_NBANKS; ++i) {
+        banks[i] = rge_hipobank_init(FIXTURE_BANKS[i]);
+        rge_link_branches(&banks[i], tree);
+    }
+
+    int err = 0;
+    for (lint evn = 0; evn < nevents && err == 0; ++evn) {
+        err = fill_event(banks, evn);
+        if (err == 0) tree->Fill();
+    }
+
+    if (err == 0) tree->Write();
+    file->Close();
+    delete file;
+    for (uint i = 0; i < FIXTURE_NBANKS; ++i) rge_hipobank_free(&banks[i]);
+
+    return err;
+}
+
+/**
+ * Assign PIDs to the particles of the event loaded in the banks and add their
+ *     ntuple rows to res, as make_ntuples does.
+ */
+static int process_event(
+        rge_hipobank banks[FIXTURE_NBANKS], lint evn, double beam_E,
+        double sf[RGE_NSECTORS][RGE_NSFPARAMS][2],
+        std::vector<rge_detsummary> *ds, check_result *res
+) {
+    rge_hipobank *bpart = &banks[F_PART];
+    rge_hipobank *btrk  = &banks[F_TRK];
+    if (rge_detsummary_fill(
+            &banks[F_CAL], &banks[F_CHKV], &banks[F_SCI], bpart->nrows, ds
+    )) return 1;
+
+    // Trigger electron first, then the rest, as in make_ntuples.
+    rge_particle parts[FIXTURE_MAXROWS];
+    uint pindexes[FIXTURE_MAXROWS];
+    uint positions[FIXTURE_MAXROWS];
+    uint npart = 0;
+    luint trigger_i = FIXTURE_MAXROWS;
+    for (uint pos = 0; pos < btrk->nrows && pos < FIXTURE_MAXROWS; ++pos) {
+        uint pindex = rge_get_uint(btrk, RGE_TRK_PINDEX, pos);
+        rge_particle p = rge_particle_init(bpart, btrk, NULL, pos, 0);
+        if (!p.is_valid) continue;
+
+        rge_detsummary *s = &(*ds)[pindex];
+        if (rge_set_pid(
+                &p, rge_get_int(bpart, RGE_PART_PID, pindex),
+                rge_get_int(bpart, RGE_PART_STATUS, pindex),
+                s->energy_PCAL + s->energy_ECIN + s->energy_ECOU,
+                s->energy_PCAL, s->nphe_HTCC, s->nphe_LTCC,
+                sf[rge_get_uint(btrk, RGE_TRK_SECTOR, pos) - 1]
+        )) return 1;
+
+        if (p.is_trigger && trigger_i == FIXTURE_MAXROWS) trigger_i = npart;
+        parts[npart]     = p;
+        pindexes[npart]  = pindex;
+        positions[npart] = pos;
+        ++npart;
+    }
+    if (trigger_i == FIXTURE_MAXROWS) return 0;
+    ++res->ntrigger;
+
+    rge_particle e = parts[trigger_i];
+    double trigger_tof = (*ds)[pindexes[trigger_i]].tof;
+    for (uint i = 0; i < npart; ++i) {
+        rge_detsummary *s = &(*ds)[pindexes[i]];
+        rge_varval arr[RGE_VARS_SIZE];
+        if (rge_fill_ntuples_arr(
+                arr, parts[i], e, FIXTURE_RUNNO, evn,
+                rge_get_int(bpart, RGE_PART_STATUS, pindexes[i]), beam_E,
+                rge_get_double(btrk, RGE_TRK_CHI2, positions[i]),
+                rge_get_int(btrk, RGE_TRK_NDF, positions[i]), s->energy_PCAL,
+                s->energy_ECIN, s->energy_ECOU, s->tof, trigger_tof,
+                s->nphe_LTCC, s->nphe_HTCC, RGE_ALLVARS
+        )) return 1;
+
+        for (int var_i = 0; var_i < RGE_VARS_SIZE; ++var_i) {
+            res->checksum += rge_varval_get(arr, var_i);
+        }
+        ++res->nrows;
+    }
+
+    return 0;
+}
+
+/**
+ * Process every event of the fixture with its own loader and banks, as each
+ *     make_ntuples worker does. Before starting, set an rge_errno that depends
+ *     on thread_i and check at the end that no other thread changed it.
+ */
+static void check_worker(
+        const char *banks_filename, const char *sf_filename, double beam_E,
+        int thread_i, check_result *res
+) {
+    res->nrows    = 0;
+    res->ntrigger = 0;
+    res->checksum = 0.;
+
+    // Leave a code in rge_errno from a call that fails on purpose. Threads
+    //     of different parity leave different codes.
+    double sf[RGE_NSECTORS][RGE_NSFPARAMS][2];
+    char sf_copy[PATH_MAX];
+    uint expected_err;
+    if (thread_i % 2 == 0) {
+        rge_pid_invalid(INT_MAX);
+        expected_err = RGEERR_PIDNOTFOUND;
+    }
+    else {
+        sprintf(sf_copy, "%s.missing", sf_filename);
+        rge_get_sf_params(sf_copy, sf);
+        expected_err = RGEERR_NOSAMPFRACFILE;
+    }
+
+    strcpy(sf_copy, sf_filename);
+    if (rge_get_sf_params(sf_copy, sf)) {
+        res->err = rge_errno;
+        return;
+    }
+
+    rge_eventloader loader;
+    rge_hipobank banks[FIXTURE_NBANKS];
+    for (uint i = 0; i < FIXTURE_NBANKS; ++i) {
+        banks[i] = rge_hipobank_init(FIXTURE_BANKS[i]);
+    }
+
+    int err = rge_loader_open(&loader, banks_filename);
+    for (uint i = 0; i < FIXTURE_NBANKS && err == 0; ++i) {
+        err = rge_loader_add_bank(&loader, &banks[i], RGE_ALLCOLS);
+    }
+
+    std::vector<rge_detsummary> ds;
+    for (lint evn = 0; evn < loader.nevents && err == 0; ++evn) {
+        err = rge_loader_get_event(&loader, evn);
+        if (err == 0) err = process_event(banks, evn, beam_E, sf, &ds, res);
+    }
+
+    rge_loader_close(&loader);
+    for (uint i = 0; i < FIXTURE_NBANKS; ++i) rge_hipobank_free(&banks[i]);
+
+    if (err != 0) {
+        res->err = rge_errno;
+        return;
+    }
+    if (rge_errno != expected_err) {
+        res->err = RGEERR_THREADMISMATCH;
+        return;
+    }
+    res->err = RGEERR_NOERR;
+}
+
+/** run() function of the program. Check USAGE_MESSAGE for details. */
+static int run(char *work_dir, lint nevents, lint nthreads) {
+    // Make ROOT thread-safe before any of its objects are created.
+    ROOT::EnableThreadSafety();
+
+    char banks_filename[PATH_MAX];
+    char sf_filename[PATH_MAX];
+    sprintf(banks_filename, "%s/banks_%06d.root", work_dir, FIXTURE_RUNNO);
+    sprintf(sf_filename, "%s/sf_params_%06d.txt", work_dir, FIXTURE_RUNNO);
+
+    printf("Writing %ld events to %s.\n", nevents, banks_filename);
+    if (write_fixture(banks_filename, sf_filename, nevents)) return 1;
+
+    int run_no;
+    double beam_E;
+    if (rge_handle_root_filename(banks_filename, &run_no, &beam_E)) return 1;
+
+    // Single-threaded pass, used as reference.
+    check_result ref;
+    check_worker(banks_filename, sf_filename, beam_E, 1, &ref);
+    if (ref.err != RGEERR_NOERR) {
+        rge_errno = ref.err;
+        return 1;
+    }
+    printf("Single thread: %lu rows, %lu trigger electrons.\n",
+            ref.nrows, ref.ntrigger);
+    if (ref.ntrigger != static_cast<luint>(nevents)) {
+        rge_errno = RGEERR_THREADMISMATCH;
+        return 1;
+    }
+
+    // Same work from nthreads threads at once.
+    printf("Processing the fixture from %ld threads.\n", nthreads);
+    std::vector<check_result> results(static_cast<size_t>(nthreads));
+    std::vector<std::thread> workers;
+    for (lint thread_i = 0; thread_i < nthreads; ++thread_i) {
+        workers.emplace_back(
+                check_worker, banks_filename, sf_filename, beam_E,
+                static_cast<int>(thread_i), &results[thread_i]
+        );
+    }
+    for (std::thread &worker : workers) worker.join();
+
+    for (const check_result &res : results) {
+        if (res.err != RGEERR_NOERR) {
+            rge_errno = res.err;
+            return 1;
+        }
+        if (
+                res.nrows != ref.nrows || res.ntrigger != ref.ntrigger ||
+                res.checksum != ref.checksum
+        ) {
+            rge_errno = RGEERR_THREADMISMATCH;
+            return 1;
+        }
+    }
+    printf("All threads match the single-threaded pass.\n");
+
+    rge_errno = RGEERR_NOERR;
+    return 0;
+}
+
+/**
+ * Handle arguments for tsan_check using optarg. Error codes used are
+ *     explained in the handle_err() function.
+ */
+static int handle_args(
+        int argc, char **argv, char **work_dir, lint *nevents, lint *nthreads
+) {
+    int opt;
+    while ((opt = getopt(argc, argv, "-hn:j:")) != -1) {
+        switch (opt) {
+            case 'h':
+                rge_errno = RGEERR_USAGE;
+                return 1;
+            case 'n':
+                if (rge_process_nentries(nevents, optarg)) return 1;
+                break;
+            case 'j':
+                if (rge_process_nthreads(nthreads, optarg)) return 1;
+                break;
+            case 1:
+                *work_dir = static_cast<char *>(malloc(strlen(optarg) + 1));
+                strcpy(*work_dir, optarg);
+                break;
+            default:
+                rge_errno = RGEERR_BADOPTARGS;
+                return 1;
+        }
+    }
+
+    // Check that a positional argument was given.
+    if (*work_dir == NULL) {
+        rge_errno = RGEERR_BADOPTARGS;
+        return 1;
+    }
+
+    return 0;
+}
+
+/** Entry point of tsan_check. Check USAGE_MESSAGE for details. */
+int main(int argc, char **argv) {
+    char *work_dir = NULL;
+    lint nevents   = 1000;
+    lint nthreads  = 4;
+
+    int err = handle_args(argc, argv, &work_dir, &nevents, &nthreads);
+
+    if (rge_errno == RGEERR_UNDEFINED && err == 0) {
+        run(work_dir, nevents, nthreads);
+    }
+
+    if (work_dir != NULL) free(work_dir);
+
+    return rge_print_usage(USAGE_MESSAGE);
+}